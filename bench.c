@@ -0,0 +1,423 @@
+// 基准测试程序：生成各类合成负载，直接调用calculate_expression或通过消息队列驱动服务端，输出吞吐量、延迟百分位数和每次请求的内存分配次数
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+
+#include "msg_mycs.h" // 包含消息结构体的头文件
+#include "my_calculate_expression.h" // 包含计算表达式的头文件
+#include "my_expression_cache.h" // 包含表达式结果缓存的头文件
+#include "my_async_client.h" // 包含异步客户端的头文件
+
+// 表达式的最大长度
+#define BENCH_EXPRESSION_LENGTH 512
+// 预热的次数
+#define BENCH_WARMUP_OPS 100
+
+// 统计堆分配次数：替换malloc系列函数，转调glibc的实现
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void __libc_free(void *pointer);
+
+unsigned long benchMallocCount = 0;
+
+void *malloc(size_t size) {
+    benchMallocCount++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    benchMallocCount++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    benchMallocCount++;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+    __libc_free(pointer);
+}
+
+// 伪随机数(线性同余)，保证同一个种子生成相同的负载
+unsigned int benchRandom(unsigned int *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return (*seed >> 16) & 0x7fff;
+}
+
+// 负载：纯数值计算
+void generateArithmetic(unsigned int *seed, char *expression) {
+    sprintf(expression, "(%u+%u)*%u-%u/%u+%u%%%u", benchRandom(seed) % 1000, benchRandom(seed) % 1000,
+            benchRandom(seed) % 100, benchRandom(seed) % 1000, benchRandom(seed) % 99 + 1, benchRandom(seed) % 1000,
+            benchRandom(seed) % 9 + 1);
+}
+
+// 负载：8~16层括号嵌套的纯数值计算
+void generateNested(unsigned int *seed, char *expression) {
+    int depth = 8 + (int) (benchRandom(seed) % 9);
+    const char operators[] = "+-*";
+    int length = 0;
+    for (int i = 0; i < depth; i++) {
+        expression[length++] = '(';
+    }
+    length += sprintf(expression + length, "%u", benchRandom(seed) % 10 + 1);
+    for (int i = 0; i < depth; i++) {
+        length += sprintf(expression + length, "%c%u)", operators[benchRandom(seed) % 3], benchRandom(seed) % 10 + 1);
+    }
+}
+
+// 负载：(x+a)^n=0，n按2的幂取1到默认配置的maxPowerCount-1
+void generateEquation(unsigned int *seed, char *expression) {
+    int maxExponent = 0;
+    while ((2 << maxExponent) < calcDefaultConfig.maxPowerCount) {
+        maxExponent++;
+    }
+    int power = 1 << (benchRandom(seed) % (maxExponent + 1));
+    if (power >= calcDefaultConfig.maxPowerCount) {
+        power = calcDefaultConfig.maxPowerCount - 1;
+    }
+    sprintf(expression, "(x+%u)^%d=0", benchRandom(seed) % 9 + 1, power);
+}
+
+// 负载：次幂很高的稀疏多项式 x^k-c=0，k从256起按2的幂取到默认配置的maxSparsePowerCount-1
+void generateSparse(unsigned int *seed, char *expression) {
+    int power = 256 << (benchRandom(seed) % 5);
+    if (power >= calcDefaultConfig.maxSparsePowerCount) {
+        power = calcDefaultConfig.maxSparsePowerCount - 1;
+    }
+    sprintf(expression, "x^%d-%u=0", power, benchRandom(seed) % 9 + 2);
+}
+
+typedef struct {
+    const char *name;
+    void (*generate)(unsigned int *seed, char *expression);
+} Workload;
+
+Workload workloads[] = {
+    {"arithmetic", generateArithmetic},
+    {"nested", generateNested},
+    {"equation", generateEquation},
+    {"sparse", generateSparse},
+};
+#define NUM_WORKLOADS ((int) (sizeof(workloads) / sizeof(workloads[0])))
+
+// 回归检查：已知结果的表达式(精度, 表达式, 期望的结果)，结果末尾的换行符不参与比较
+typedef struct {
+    Precision precision;
+    const char *expression;
+    const char *expected;
+} BenchCheck;
+
+BenchCheck checks[] = {
+    // 高重数的根(long double下展开式在重根附近的值与0无法区分)
+    {PRECISION_LONG_DOUBLE, "(x-2)^10=0", "Roots:\t2.000000 "},
+    {PRECISION_LONG_DOUBLE, "(x-1)^20=0", "Roots:\t1.000000 "},
+    {PRECISION_LONG_DOUBLE, "(x-1)^6=0", "Roots:\t1.000000 "},
+    {PRECISION_DOUBLE, "(x-2)^10=0", "Roots:\t2.000000 "},
+    {PRECISION_EXACT, "(x-1)^20=0", "Roots:\t1.000000 "},
+    // 精确模式的常数按原文转为有理数，不经过long double
+    {PRECISION_EXACT, "123456789012345678901234567890*10", "Result:\t1234567890123456789012345678900"},
+    {PRECISION_EXACT, "1.0000000000000000001-1", "Result:\t1/10000000000000000000"},
+    {PRECISION_EXACT, "1e30", "Result:\t1000000000000000000000000000000"},
+};
+#define NUM_CHECKS ((int) (sizeof(checks) / sizeof(checks[0])))
+
+// 缓存键的回归检查：先计算first放入缓存，再计算second，second的结果必须与不用缓存时相同，
+// 且只有两者含义相同(shared)时才命中first的缓存条目
+typedef struct {
+    const char *first;
+    const char *second;
+    int shared;
+} BenchCachePair;
+
+BenchCachePair cachePairs[] = {
+    // 去掉空格后会与前面的数字连成一个数字的，不能共用
+    {"2 e-1+1", "2e-1+1", 0},
+    {"1e3", "1 e3", 0},
+    {"0x1p3", "0 x1p3", 0},
+    {"0x1p3", "0x1 p3", 0},
+    {"1e-3", "1e -3", 0},
+    {"1e-3", "1e- 3", 0},
+    {"1 2", "12", 0},
+    // 只是空格不同的仍然共用
+    {"1 + 2 * x = 0", "1+2*x=0", 1},
+    {"2e-1 + 1", "2e-1+1", 1},
+};
+#define NUM_CACHE_PAIRS ((int) (sizeof(cachePairs) / sizeof(cachePairs[0])))
+
+// 逐个计算回归检查的表达式并与期望的结果比较，输出不一致的项，返回不一致的个数
+int runChecks() {
+    char result_msg[CALC_RESULT_LENGTH];
+    int failures = 0;
+    for (int i = 0; i < NUM_CHECKS; i++) {
+        CalcConfig config = calcDefaultConfig;
+        config.precision = checks[i].precision;
+        CalcContext context;
+        calcContextInit(&context, &config);
+        calculate_expression_r(&context, checks[i].expression, result_msg, sizeof(result_msg));
+        calcContextDestroy(&context);
+        result_msg[strcspn(result_msg, "\n")] = '\0';
+        if (strcmp(result_msg, checks[i].expected) != 0) {
+            fprintf(stderr, "check failed: %s (precision %d): expected \"%s\", got \"%s\"\n", checks[i].expression,
+                    checks[i].precision, checks[i].expected, result_msg);
+            failures++;
+        }
+    }
+    char expected[CALC_RESULT_LENGTH];
+    for (int i = 0; i < NUM_CACHE_PAIRS; i++) {
+        CalcContext context;
+        calcContextInit(&context, NULL);
+        ExpressionCache *cache = expressionCacheNew(EXPRESSION_CACHE_DEFAULT_BYTES);
+        calculate_expression_cached(cache, &context, cachePairs[i].first, NULL, result_msg, sizeof(result_msg));
+        calculate_expression_cached(cache, &context, cachePairs[i].second, NULL, result_msg, sizeof(result_msg));
+        calculate_expression_r(&context, cachePairs[i].second, expected, sizeof(expected));
+        int shared = cache->hits == 1;
+        freeExpressionCache(cache);
+        calcContextDestroy(&context);
+        result_msg[strcspn(result_msg, "\n")] = '\0';
+        expected[strcspn(expected, "\n")] = '\0';
+        if (strcmp(result_msg, expected) != 0 || shared != cachePairs[i].shared) {
+            fprintf(stderr, "check failed: \"%s\" after \"%s\" in cache: expected \"%s\"%s, got \"%s\"%s\n",
+                    cachePairs[i].second, cachePairs[i].first, expected, cachePairs[i].shared ? " (hit)" : "",
+                    result_msg, shared ? " (hit)" : "");
+            failures++;
+        }
+    }
+    printf("checks: %d passed, %d failed\n", NUM_CHECKS + NUM_CACHE_PAIRS - failures, failures);
+    return failures;
+}
+
+// 一项测试的结果
+typedef struct {
+    const char *workload;
+    const char *mode; // direct或e2e
+    unsigned long ops;
+    unsigned long errors;
+    double seconds;
+    const LatencyHistogram *latency;
+    double allocationsPerOp; // 每次请求的堆分配次数，小于0表示不统计
+    double calcAllocationsPerOp; // 每次请求的calcMalloc调用次数(内存池分配)，小于0表示不统计
+} BenchResult;
+
+// 输出结果：json为1时每项一行JSON，否则为对齐的文本
+void printResult(const BenchResult *result, int json) {
+    const LatencyHistogram *latency = result->latency;
+    double opsPerSecond = result->seconds > 0 ? result->ops / result->seconds : 0;
+    double mean = latency->count > 0 ? latency->sum / 1000.0 / latency->count : 0;
+    if (json) {
+        printf("{\"workload\":\"%s\",\"mode\":\"%s\",\"ops\":%lu,\"errors\":%lu,\"seconds\":%.6f,"
+               "\"ops_per_sec\":%.1f,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f",
+               result->workload, result->mode, result->ops, result->errors, result->seconds, opsPerSecond, mean,
+               histogramPercentile(latency, 50) / 1000.0, histogramPercentile(latency, 99) / 1000.0,
+               histogramPercentile(latency, 99.9) / 1000.0, latency->max / 1000.0);
+        if (result->allocationsPerOp >= 0) {
+            printf(",\"allocs_per_op\":%.2f,\"calc_allocs_per_op\":%.2f", result->allocationsPerOp,
+                   result->calcAllocationsPerOp);
+        }
+        printf("}\n");
+    } else {
+        printf("%-10s %-6s %9lu %7lu %12.1f %9.2f %9.2f %9.2f %9.2f %10.2f", result->workload, result->mode,
+               result->ops, result->errors, opsPerSecond, mean, histogramPercentile(latency, 50) / 1000.0,
+               histogramPercentile(latency, 99) / 1000.0, histogramPercentile(latency, 99.9) / 1000.0,
+               latency->max / 1000.0);
+        if (result->allocationsPerOp >= 0) {
+            printf(" %8.2f %8.2f", result->allocationsPerOp, result->calcAllocationsPerOp);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+// 直接调用calculate_expression_r(按默认配置新建的上下文)，最多maxOps次或maxSeconds秒
+void benchDirect(const Workload *workload, unsigned int seed, unsigned long maxOps, double maxSeconds, int json) {
+    static LatencyHistogram latency;
+    char expression[BENCH_EXPRESSION_LENGTH];
+    char result_msg[64 * 1024]; // 高次方程的根可能很多
+    CalculationStats stats;
+    CalcContext context;
+
+    memset(&latency, 0, sizeof(latency));
+    calcContextInit(&context, NULL);
+    // 预热(内存池扩容、缓存)，使用不同的种子
+    unsigned int warmupSeed = seed ^ 0x5a5a5a5au;
+    for (int i = 0; i < BENCH_WARMUP_OPS; i++) {
+        workload->generate(&warmupSeed, expression);
+        calculate_expression_r(&context, expression, result_msg, sizeof(result_msg));
+    }
+    BenchResult result = {workload->name, "direct", 0, 0, 0, &latency, 0, 0};
+    unsigned long mallocs = 0;
+    long calcAllocations = 0;
+    long long deadline = monotonicNanoseconds() + (long long) (maxSeconds * 1e9);
+    long long start = monotonicNanoseconds();
+    while (result.ops < maxOps && (result.ops % 64 != 0 || monotonicNanoseconds() < deadline)) {
+        workload->generate(&seed, expression);
+        unsigned long mallocsBefore = benchMallocCount;
+        long long opStart = monotonicNanoseconds();
+        calculationStatsBegin(&stats);
+        int ok = calculate_expression_r(&context, expression, result_msg, sizeof(result_msg));
+        calculationStatsEnd();
+        histogramRecord(&latency, monotonicNanoseconds() - opStart);
+        mallocs += benchMallocCount - mallocsBefore;
+        calcAllocations += stats.numAllocations;
+        result.ops++;
+        if (!ok) {
+            result.errors++;
+        }
+    }
+    result.seconds = (monotonicNanoseconds() - start) / 1e9;
+    calcContextDestroy(&context);
+    result.allocationsPerOp = result.ops > 0 ? (double) mallocs / result.ops : 0;
+    result.calcAllocationsPerOp = result.ops > 0 ? (double) calcAllocations / result.ops : 0;
+    printResult(&result, json);
+}
+
+// 端到端：通过消息队列把请求发给正在运行的服务端，保持最多window个请求在途
+int benchTrySend(struct msgform *msg, int length) {
+    return msgTrySendLength(msg, length);
+}
+
+int benchSend(struct msgform *msg, int length) {
+    return msgSendLength(msg, length);
+}
+
+int benchReceive(struct msgform *msg) {
+    return msgReceive(msg, getpid());
+}
+
+int benchEndToEnd(const Workload *workload, unsigned int seed, unsigned long maxOps, double maxSeconds, int window,
+                  int json) {
+    AsyncTransport transport = {benchTrySend, benchSend, benchReceive};
+    AsyncClient *client = asyncClientNew(transport, getpid(), window, NULL, NULL);
+    char expression[BENCH_EXPRESSION_LENGTH];
+    long long deadline = asyncNow() + (long long) (maxSeconds * 1e9);
+    int ok = 1;
+
+    while (client->sent < maxOps && (client->sent % 64 != 0 || asyncNow() < deadline)) {
+        workload->generate(&seed, expression);
+        if (asyncClientSubmit(client, expression) < 0) {
+            ok = 0;
+            break;
+        }
+    }
+    if (ok && asyncClientDrain(client) < 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        perror("msg");
+        freeAsyncClient(client);
+        return 0;
+    }
+    BenchResult result = {workload->name, "e2e", client->completed, client->errors,
+                          (asyncNow() - client->startTime) / 1e9, &client->latency, -1, -1};
+    printResult(&result, json);
+    freeAsyncClient(client);
+    return 1;
+}
+
+void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-w workload] [-n max_ops] [-T seconds] [-s seed] [-e window] [-P long|double|exact] [-j] [-c]\n",
+            name);
+    fprintf(stderr, "  -w  arithmetic, nested, equation, sparse or all (default)\n");
+    fprintf(stderr, "  -n  max operations per workload (default 100000)\n");
+    fprintf(stderr, "  -T  max seconds per workload (default 1)\n");
+    fprintf(stderr, "  -s  random seed, the same seed generates the same expressions (default 1)\n");
+    fprintf(stderr, "  -e  also run end to end against a running server over the message queue, window in-flight\n");
+    fprintf(stderr, "  -P  precision used by the direct runs\n");
+    fprintf(stderr, "  -j  print one JSON object per line\n");
+    fprintf(stderr, "  -c  only run the regression checks (expressions with known results), exit 1 on any failure\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *workloadName = "all";
+    unsigned long maxOps = 100000;
+    double maxSeconds = 1.0;
+    unsigned int seed = 1;
+    int window = 0;
+    int json = 0;
+    int check = 0;
+    int opt;
+
+    // 解析命令行参数
+    while ((opt = getopt(argc, argv, "w:n:T:s:e:P:jch")) != -1) {
+        switch (opt) {
+            case 'w':
+                workloadName = optarg;
+                break;
+            case 'n':
+                maxOps = strtoul(optarg, NULL, 10);
+                break;
+            case 'T':
+                maxSeconds = atof(optarg);
+                break;
+            case 's':
+                seed = (unsigned int) strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                window = atoi(optarg);
+                if (window <= 0 || window > ASYNC_MAX_WINDOW) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'P':
+                if (strcmp(optarg, "long") == 0) {
+                    calcDefaultConfig.precision = PRECISION_LONG_DOUBLE;
+                } else if (strcmp(optarg, "double") == 0) {
+                    calcDefaultConfig.precision = PRECISION_DOUBLE;
+                } else if (strcmp(optarg, "exact") == 0) {
+                    calcDefaultConfig.precision = PRECISION_EXACT;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'j':
+                json = 1;
+                break;
+            case 'c':
+                check = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (check) {
+        return runChecks() > 0 ? 1 : 0;
+    }
+    int selected = 0;
+    for (int i = 0; i < NUM_WORKLOADS; i++) {
+        selected += strcmp(workloadName, "all") == 0 || strcmp(workloadName, workloads[i].name) == 0;
+    }
+    if (selected == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (window > 0) {
+        msgqid = msgget(MSGKEY, 0777); // 获取服务端创建的消息队列
+        if (msgqid < 0) {
+            perror("msgget (is the server running?)");
+            return 1;
+        }
+    }
+
+    if (!json) {
+        printf("%-10s %-6s %9s %7s %12s %9s %9s %9s %9s %10s %8s %8s\n", "workload", "mode", "ops", "errors",
+               "ops/s", "mean_us", "p50_us", "p99_us", "p999_us", "max_us", "allocs", "calc");
+    }
+    for (int i = 0; i < NUM_WORKLOADS; i++) {
+        if (strcmp(workloadName, "all") != 0 && strcmp(workloadName, workloads[i].name) != 0) {
+            continue;
+        }
+        benchDirect(&workloads[i], seed, maxOps, maxSeconds, json);
+        if (window > 0 && !benchEndToEnd(&workloads[i], seed, maxOps, maxSeconds, window, json)) {
+            return 1;
+        }
+    }
+    return 0;
+}
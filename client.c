@@ -1,38 +1,490 @@
 // 客户端程序
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include <string.h>
+#include <time.h>
 #include "msg_mycs.h" // 包含消息结构体的头文件
+#include "shm_mycs.h" // 包含共享内存传输的头文件
+#include "my_async_client.h" // 包含异步客户端的头文件
 
-int main() {
+// 传输方式：SysV消息队列或共享内存环形队列，需与服务端一致
+typedef enum {
+    TRANSPORT_MSG,
+    TRANSPORT_SHM
+} Transport;
+
+Transport transport = TRANSPORT_MSG;
+ShmControl *shmControl = NULL;
+int shmSlot = -1; // 共享内存传输时占用的槽位
+int budgetMs = 0; // 每个请求的时间预算(毫秒)，0表示不限
+unsigned int streamSeq = 0; // 流式请求的序号，用于丢弃之前的请求遗留的回复块
+
+// 发送消息(只发送消息头和msg_string的前length字节)，同时记下发送时间(服务端据此统计排队时间、计算期限)和时间预算
+int clientSend(struct msgform *msg, int length) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    msg->send_time = (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+    msg->budget_ms = budgetMs;
+    if (transport == TRANSPORT_SHM) {
+        return shmClientSend(shmControl, shmSlot, msg, length);
+    }
+    return msgSendLength(msg, length);
+}
+
+// 不阻塞地发送消息，队列已满返回0，发送成功返回1，出错返回-1
+int clientTrySend(struct msgform *msg, int length) {
+    if (transport == TRANSPORT_SHM) {
+        return shmClientTrySend(shmControl, shmSlot, msg, length);
+    }
+    return msgTrySendLength(msg, length);
+}
+
+// 接收发给本进程(mtype=pid)的回复，返回msg_string的长度，出错返回-1
+int clientReceive(struct msgform *msg, int pid) {
+    if (transport == TRANSPORT_SHM) {
+        return shmClientReceive(shmControl, shmSlot, msg);
+    }
+    return msgReceive(msg, pid);
+}
+
+// 发送一个批量请求并接收全部结果，按 "表达式<TAB>结果" 的格式逐行输出
+void sendBatch(struct msgform *request, int requestUsed, int pid, FILE *out) {
+    struct msgform reply;
+    int requestOffset = 0;
+    int numExpressions = request->msg_count;
+    const char *string;
+    int length;
+
+    request->mtype = msgRequestType(request); // 含有方程的批量请求为重量请求
+    clientSend(request, requestUsed); // 发送批量请求给服务器，只发送已打包的部分
+    // 服务器可能把结果拆成多条回复，直到收齐与请求相同的条数为止
+    int numResults = 0;
+    while (numResults < numExpressions) {
+        if (clientReceive(&reply, pid) < 0) {
+            perror("receive");
+            exit(1);
+        }
+        int replyOffset = 0;
+        for (int i = 0; i < reply.msg_count; i++) {
+            if (!msgBatchNext(request, &requestOffset, &string, &length)) {
+                break;
+            }
+            fprintf(out, "%.*s\t", length, string);
+            if (!msgBatchNext(&reply, &replyOffset, &string, &length)) {
+                break;
+            }
+            // 结果末尾自带的换行符去掉，统一由这里输出
+            while (length > 0 && string[length - 1] == '\n') {
+                length--;
+            }
+            fprintf(out, "%.*s\n", length, string);
+            numResults++;
+        }
+    }
+}
+
+// 批量模式：从输入中逐行读取表达式，每batchSize条(或消息装满)打包为一个请求发送
+void runBatch(FILE *in, int batchSize, int pid) {
+    struct msgform request;
+    int used;
+    char line[MAX_MSG_STRING_LENGTH];
+
+    request.source_pid = pid;
+    msgBatchInit(&request, &used);
+    while (fgets(line, MAX_MSG_STRING_LENGTH, in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        int length = (int) strlen(line);
+        if (length == 0) {
+            continue; // 跳过空行
+        }
+        if ((batchSize > 0 && request.msg_count == batchSize) || !msgBatchAppend(&request, &used, line, length)) {
+            // 第一条表达式自身就放不下时，当前请求还是空的，不发送
+            if (request.msg_count > 0) {
+                sendBatch(&request, used, pid, stdout);
+            }
+            msgBatchInit(&request, &used);
+            if (!msgBatchAppend(&request, &used, line, length)) {
+                fprintf(stderr, "expression too long, skipped: %s\n", line);
+            }
+        }
+    }
+    if (request.msg_count > 0) {
+        sendBatch(&request, used, pid, stdout);
+    }
+}
+
+// 接收序号为seq的流式请求的下一个回复块，序号不同或格式不对的回复丢弃，出错时退出
+void receiveStreamChunk(struct msgform *reply, int pid, unsigned int seq, MsgStreamHeader *header,
+                        const char **data) {
+    for (;;) {
+        int length = clientReceive(reply, pid);
+        if (length < 0) {
+            perror("receive");
+            exit(1);
+        }
+        if (reply->seq == seq && msgStreamParse(reply, length, header, data)) {
+            return;
+        }
+    }
+}
+
+// 输出流式回复中的一个根，格式与服务端的文本结果相同(数值过大时改用科学计数法)
+void printStreamRoot(long double root) {
+    char text[32];
+    if (snprintf(text, sizeof(text), "%Lf ", root) >= (int) sizeof(text)) {
+        snprintf(text, sizeof(text), "%Le ", root);
+    }
+    fputs(text, stdout);
+}
+
+// 输出流式回复中计算式的结果、错误或文本(服务端不做格式化，格式与服务端的文本结果相同)
+void printStreamResult(const MsgStreamHeader *header, const char *data) {
+    char text[MAX_MSG_STRING_LENGTH];
+    if (header->kind == MSG_STREAM_VALUE) {
+        // 服务端的文本结果末尾还有换行符，放不下时改用科学计数法
+        long double value = msgStreamValue(data, 0);
+        if (snprintf(text, sizeof(text), "Result:\t%Lf", value) >= (int) sizeof(text) - 1) {
+            snprintf(text, sizeof(text), "Result:\t%Le", value);
+        }
+        printf("%s\n", text);
+    } else if (header->kind == MSG_STREAM_ERROR) {
+        msgErrorFormat(header->first, data, text, sizeof(text));
+        printf("Error: \t%s\n", text);
+    } else {
+        printf("%.*s\n", (int) strcspn(data, "\n"), data);
+    }
+}
+
+// 流式模式：从输入中逐行读取表达式，每个表达式发送一个流式请求，方程的根收到一块就输出一块(不受回复长度的限制)，
+// 输出格式与批量模式相同("表达式<TAB>结果")
+void runStream(FILE *in, int pid) {
+    struct msgform request;
+    struct msgform reply;
+    MsgStreamHeader header;
+    const char *data;
+
+    request.source_pid = pid;
+    while (fgets(request.msg_string, MAX_MSG_STRING_LENGTH, in) != NULL) {
+        request.msg_string[strcspn(request.msg_string, "\n")] = '\0';
+        if (request.msg_string[0] == '\0') {
+            continue; // 跳过空行
+        }
+        request.msg_count = MSG_STREAM_COUNT;
+        request.seq = ++streamSeq;
+        request.mtype = msgRequestType(&request);
+        clientSend(&request, (int) strlen(request.msg_string) + 1);
+        printf("%s\t", request.msg_string);
+        int numRoots = 0;
+        do {
+            receiveStreamChunk(&reply, pid, request.seq, &header, &data);
+            if (header.kind != MSG_STREAM_ROOTS) {
+                // 已输出部分根之后出错(如超时)时，错误信息另起一行
+                if (numRoots > 0) {
+                    printf("\n%s\t", request.msg_string);
+                }
+                printStreamResult(&header, data);
+            } else {
+                for (int i = 0; i < header.count; i++) {
+                    if (numRoots++ == 0) {
+                        printf("Roots:\t");
+                    }
+                    printStreamRoot(msgStreamValue(data, i));
+                }
+                if (header.last) {
+                    printf(numRoots == 0 ? "Roots:\tNo roots\n" : "\n");
+                }
+            }
+            fflush(stdout);
+        } while (!header.last);
+    }
+}
+
+// 求值表模式：从输入中逐行读取表达式，每个表达式发送一个求值表请求，按 "x<TAB>f(x)" 的格式逐行输出
+// stream为1时使用流式请求，函数值以二进制形式返回，由这里转换为文本
+void runTable(FILE *in, const MsgTableRange *range, int pid, int stream) {
+    struct msgform request;
+    struct msgform reply;
+    char line[MAX_MSG_STRING_LENGTH];
+
+    request.mtype = MSG_TYPE_HEAVY; // 求值表为重量请求
+    request.source_pid = pid;
+    while (fgets(line, MAX_MSG_STRING_LENGTH, in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0') {
+            continue; // 跳过空行
+        }
+        int length = msgTableInit(&request, range, line);
+        if (length < 0) {
+            fprintf(stderr, "expression too long, skipped: %s\n", line);
+            continue;
+        }
+        printf("%s\n", line);
+        if (stream) {
+            request.msg_count = MSG_TABLE_STREAM_COUNT;
+            request.seq = ++streamSeq;
+            clientSend(&request, length);
+            MsgStreamHeader header;
+            const char *data;
+            do {
+                receiveStreamChunk(&reply, pid, request.seq, &header, &data);
+                if (header.kind != MSG_STREAM_TABLE) {
+                    printStreamResult(&header, data);
+                    continue;
+                }
+                for (int i = 0; i < header.count; i++) {
+                    printf("%Lf\t%Lf\n", (long double) msgTablePoint(range, header.first + i),
+                           msgStreamValue(data, i));
+                }
+            } while (!header.last);
+            continue;
+        }
+        clientSend(&request, length);
+        // 服务器可能把结果拆成多条回复，直到收齐全部点为止；单条消息的回复为错误信息
+        int numResults = 0;
+        while (numResults < range->numPoints) {
+            if (clientReceive(&reply, pid) < 0) {
+                perror("receive");
+                exit(1);
+            }
+            if (reply.msg_count == 0) {
+                printf("%s", reply.msg_string);
+                if (strchr(reply.msg_string, '\n') == NULL) {
+                    printf("\n");
+                }
+                break;
+            }
+            int offset = 0;
+            const char *string;
+            int stringLength;
+            for (int i = 0; i < reply.msg_count && msgBatchNext(&reply, &offset, &string, &stringLength); i++) {
+                printf("%.*s\n", stringLength, string);
+                numResults++;
+            }
+        }
+    }
+}
+
+// 异步模式使用的接收函数
+int asyncReceive(struct msgform *msg) {
+    return clientReceive(msg, getpid());
+}
+
+// 异步模式下按 "表达式<TAB>结果" 的格式输出结果(按回复到达的顺序)
+void printAsyncResult(void *context, const char *expression, const char *result) {
+    fprintf((FILE *) context, "%s\t%s\n", expression, result);
+}
+
+// 异步模式：从输入中逐行读取表达式，保持最多window个未完成的请求，结束时向stderr输出吞吐量和延迟
+void runAsync(FILE *in, int window, int pid, int quiet) {
+    AsyncTransport asyncTransport = {clientTrySend, clientSend, asyncReceive};
+    AsyncClient *client = asyncClientNew(asyncTransport, pid, window, quiet ? NULL : printAsyncResult, stdout);
+    client->budgetMs = budgetMs;
+    char line[MAX_MSG_STRING_LENGTH];
+
+    while (fgets(line, MAX_MSG_STRING_LENGTH, in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0') {
+            continue; // 跳过空行
+        }
+        int submitted = asyncClientSubmit(client, line);
+        if (submitted == 0) {
+            fprintf(stderr, "expression too long, skipped: %s\n", line);
+        } else if (submitted < 0) {
+            perror("send");
+            break;
+        }
+    }
+    if (asyncClientDrain(client) < 0) {
+        perror("receive");
+    }
+    asyncClientReport(client, stderr);
+    freeAsyncClient(client);
+}
+
+// 统计模式：发送一个统计请求，输出服务端返回的统计文本
+void runStats(int pid) {
+    struct msgform msg;
+
+    msg.mtype = MSG_TYPE_LIGHT;
+    msg.source_pid = pid;
+    msg.msg_count = MSG_STATS_COUNT;
+    clientSend(&msg, 0);
+    if (clientReceive(&msg, pid) < 0) {
+        perror("receive");
+        exit(1);
+    }
+    printf("%s", msg.msg_string);
+}
+
+void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-b batch_size] [-a window [-q]] [-x from:to:points] [-r] [-f file] [-t msg|shm] [-B budget_ms] [-S]\n", name);
+    fprintf(stderr, "  -b  batch mode, pack up to batch_size expressions per message (0 = as many as fit)\n");
+    fprintf(stderr, "  -a  async mode, keep up to window requests in flight and report throughput and latency\n");
+    fprintf(stderr, "  -q  async mode without printing results\n");
+    fprintf(stderr, "  -x  table mode, evaluate each expression (in x) at points evenly spaced on [from, to]\n");
+    fprintf(stderr, "  -r  stream mode, results come back in binary and are formatted here, the roots of each equation"
+                    " are printed as the server finds them (with -x, the table values are binary too)\n");
+    fprintf(stderr, "  -f  read expressions from file instead of stdin (implies batch mode unless -a, -x or -r is given)\n");
+    fprintf(stderr, "  -t  transport, SysV message queue (default) or shared memory rings\n");
+    fprintf(stderr, "  -B  time budget of each request in milliseconds, the server gives up and replies with an error"
+                    " when it runs out (default 0, no limit)\n");
+    fprintf(stderr, "  -S  print the server metrics and exit\n");
+}
+
+int main(int argc, char *argv[]) {
     struct msgform msg;
     int pid;
+    int batchMode = 0;
+    int batchSize = 0;
+    int tableMode = 0;
+    int streamMode = 0;
+    int statsMode = 0;
+    int asyncWindow = 0;
+    int quiet = 0;
+    MsgTableRange tableRange;
+    const char *inputFile = NULL;
+    int opt;
+
+    // 解析命令行参数
+    while ((opt = getopt(argc, argv, "b:a:qx:rf:t:B:Sh")) != -1) {
+        switch (opt) {
+            case 'x':
+                tableMode = 1;
+                if (sscanf(optarg, "%lf:%lf:%d", &tableRange.from, &tableRange.to, &tableRange.numPoints) != 3 ||
+                    tableRange.numPoints <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'r':
+                streamMode = 1;
+                break;
+            case 'S':
+                statsMode = 1;
+                break;
+            case 'B':
+                budgetMs = atoi(optarg);
+                if (budgetMs < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'a':
+                asyncWindow = atoi(optarg);
+                if (asyncWindow <= 0 || asyncWindow > ASYNC_MAX_WINDOW) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'b':
+                batchMode = 1;
+                batchSize = atoi(optarg);
+                break;
+            case 'f':
+                batchMode = 1;
+                inputFile = optarg;
+                break;
+            case 't':
+                if (strcmp(optarg, "msg") == 0) {
+                    transport = TRANSPORT_MSG;
+                } else if (strcmp(optarg, "shm") == 0) {
+                    transport = TRANSPORT_SHM;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
 
-    msgqid = msgget(MSGKEY, 0777); // 获取消息队列
+    if (transport == TRANSPORT_SHM) {
+        shmControl = shmClientAttach(&shmSlot); // 连接共享内存并占用一个槽位
+        if (shmControl == NULL) {
+            perror("shm");
+            return 1;
+        }
+    } else {
+        msgqid = msgget(MSGKEY, 0777); // 获取消息队列
+        if (msgqid < 0) {
+            perror("msgget");
+            return 1;
+        }
+    }
 
     pid = getpid(); // 获取当前进程的ID
+
+    // 统计模式
+    if (statsMode) {
+        runStats(pid);
+        if (shmControl != NULL) {
+            shmClientDetach(shmControl, shmSlot);
+        }
+        return 0;
+    }
+
+    // 批量模式、异步模式、求值表模式或流式模式
+    if (batchMode || asyncWindow > 0 || tableMode || streamMode) {
+        FILE *in = stdin;
+        if (inputFile != NULL && (in = fopen(inputFile, "r")) == NULL) {
+            perror(inputFile);
+            return 1;
+        }
+        if (tableMode) {
+            runTable(in, &tableRange, pid, streamMode);
+        } else if (asyncWindow > 0) {
+            runAsync(in, asyncWindow, pid, quiet);
+        } else if (streamMode) {
+            runStream(in, pid);
+        } else {
+            runBatch(in, batchSize, pid);
+        }
+        if (in != stdin) {
+            fclose(in);
+        }
+        if (shmControl != NULL) {
+            shmClientDetach(shmControl, shmSlot);
+        }
+        return 0;
+    }
+
     // 循环等待用户输入操作符和操作数
     for (;;) {
-        memset(msg.msg_string, 0, MAX_MSG_STRING_LENGTH);
         printf("Enter expression (q to quit):\t");
-        fgets(msg.msg_string, MAX_MSG_STRING_LENGTH, stdin);
+        if (fgets(msg.msg_string, MAX_MSG_STRING_LENGTH, stdin) == NULL)
+            break;
         msg.msg_string[strcspn(msg.msg_string, "\n")] = '\0';
 
         if (strcmp(msg.msg_string, "q") == 0)
             break;
 
         msg.source_pid = pid; // 设置消息的来源进程ID
-        msg.mtype = 1; // 设置消息类型为 1
+        msg.msg_count = 0; // 单条消息
+        msg.mtype = msgRequestType(&msg); // 设置消息类型：方程为重量请求，其余为轻量请求
 
         // 显示接收到消息的服务器进程ID
         printf("client(pid=%d) => msg_qry(mtype=%ld):\t%s\n", pid, msg.mtype, msg.msg_string);
-        msgsnd(msgqid, &msg, msgsize, 0); // 发送请求给服务器
-        msgrcv(msgqid, &msg, msgsize, pid, 0); // 接收服务器的响应
+        clientSend(&msg, (int) strlen(msg.msg_string) + 1); // 发送请求给服务器(只发送字符串实际使用的部分)
+        if (clientReceive(&msg, pid) < 0) { // 接收服务器的响应
+            perror("receive");
+            break;
+        }
 
         // 显示计算结果或错误消息
         printf("client(pid=%d) <= server(pid=%d):\t%s\n",
                pid, msg.source_pid, msg.msg_string); // 显示接收到服务器的消息
     }
+    if (shmControl != NULL) {
+        shmClientDetach(shmControl, shmSlot);
+    }
+    return 0;
 }
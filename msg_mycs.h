@@ -1,12 +1,428 @@
-#define MSGKEY 1183 // 定义消息队列的键值
-#define MAX_MSG_STRING_LENGTH 1024 // 设置最大消息长度
-
-// 定义消息的结构体
-struct msgform {
-    long mtype;           // 消息类型
-    int source_pid;       // 消息来源的进程ID
-    char msg_string[MAX_MSG_STRING_LENGTH]; // 存储传输消息的数组
-};
-
-int msgsize = sizeof(struct msgform) - sizeof(long); // 计算消息结构体的大小
-int msgqid;  // 消息队列ID
+// 消息结构体和消息格式；计算表达式的头文件也包含它(使用其中的错误码)，因此只展开一次
+#ifndef MSG_MYCS_H
+#define MSG_MYCS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/msg.h>
+
+#define MSGKEY 1183 // 定义消息队列的键值
+#define MAX_MSG_STRING_LENGTH 1024 // 设置最大消息长度
+#define MSG_STOP_PID 0 // 服务端主进程通知工作者退出时使用的source_pid(不会是任何客户端的pid)
+
+// 定义消息的结构体
+struct msgform {
+    long mtype;           // 消息类型
+    int source_pid;       // 消息来源的进程ID
+    int msg_count;        // 批量消息中的条数，0表示msg_string为单条以'\0'结尾的字符串
+    unsigned int seq;     // 请求的序号，由客户端设置，服务端在该请求的所有回复中原样带回(异步客户端据此匹配乱序的回复)
+    long long send_time;  // 客户端发送请求的时间(CLOCK_MONOTONIC，纳秒)，服务端据此统计排队时间，0表示未设置
+    int budget_ms;        // 请求的时间预算(毫秒)，从send_time起算(未设置时从服务端取到请求时起算)，0表示不限
+    char msg_string[MAX_MSG_STRING_LENGTH]; // 存储传输消息的数组
+};
+
+// 请求的消息类型即优先级：工作者按mtype从小到大取请求，轻量的请求(计算式、统计)先于重量的请求(方程、求值表)
+// 回复的mtype为客户端的pid，不会与这两个值冲突(pid 1、2为系统进程)
+#define MSG_TYPE_LIGHT 1
+#define MSG_TYPE_HEAVY 2
+
+const int msgsize = sizeof(struct msgform) - sizeof(long); // 计算消息结构体的大小(接收时的最大长度)
+int msgqid;  // 消息队列ID，启动时设置一次，之后各线程只读
+
+
+// 下面为变长消息的收发函数
+// 发送时只拷贝消息头和msg_string中实际使用的部分，而不是整个msg_string
+#define MSG_HEADER_SIZE ((int) (offsetof(struct msgform, msg_string) - sizeof(long)))
+
+// 发送消息，只发送消息头和msg_string的前length字节
+int msgSendLength(const struct msgform *msg, int length) {
+    return msgsnd(msgqid, msg, MSG_HEADER_SIZE + length, 0);
+}
+
+// 不阻塞地发送消息，队列已满返回0，发送成功返回1，出错返回-1
+int msgTrySendLength(const struct msgform *msg, int length) {
+    if (msgsnd(msgqid, msg, MSG_HEADER_SIZE + length, IPC_NOWAIT) == 0) {
+        return 1;
+    }
+    return errno == EAGAIN ? 0 : -1;
+}
+
+// 发送单条字符串消息，发送到字符串结尾的'\0'为止
+int msgSendString(const struct msgform *msg) {
+    return msgSendLength(msg, (int) strnlen(msg->msg_string, MAX_MSG_STRING_LENGTH - 1) + 1);
+}
+
+// 按msgrcv的flags接收消息，返回msg_string中实际收到的字节数(出错返回-1，errno由msgrcv设置)
+// 单条字符串消息保证以'\0'结尾，因此接收前无需清空整个msg_string
+int msgReceiveFlags(struct msgform *msg, long type, int flags) {
+    ssize_t received = msgrcv(msgqid, msg, msgsize, type, flags);
+    if (received < 0) {
+        return -1;
+    }
+    int length = (int) received - MSG_HEADER_SIZE;
+    if (length < 0) {
+        // 消息比消息头还短，视为空的单条消息
+        msg->msg_count = 0;
+        length = 0;
+    }
+    if (msg->msg_count == 0) {
+        msg->msg_string[length < MAX_MSG_STRING_LENGTH ? length : MAX_MSG_STRING_LENGTH - 1] = '\0';
+    }
+    return length;
+}
+
+// 接收消息，没有该类型的消息时阻塞等待
+int msgReceive(struct msgform *msg, long type) {
+    return msgReceiveFlags(msg, type, 0);
+}
+
+// 不阻塞地接收消息，没有该类型的消息时返回-1且errno为ENOMSG
+int msgTryReceive(struct msgform *msg, long type) {
+    return msgReceiveFlags(msg, type, IPC_NOWAIT);
+}
+
+
+// 下面为批量消息的打包/解包函数
+// 批量消息的msg_string中依次存放msg_count条记录，每条记录为 [2字节长度][内容(不含'\0')]
+// 请求中每条记录为一个表达式，回复中每条记录为对应表达式的计算结果，顺序与请求一致
+#define MSG_BATCH_HEADER_LENGTH ((int) sizeof(unsigned short))
+
+// 将消息初始化为空的批量消息
+void msgBatchInit(struct msgform *msg, int *used) {
+    msg->msg_count = 0;
+    *used = 0;
+}
+
+// 向批量消息追加一条记录，空间不足时返回0(消息不变)，成功返回1
+int msgBatchAppend(struct msgform *msg, int *used, const char *string, int length) {
+    if (*used + MSG_BATCH_HEADER_LENGTH + length > MAX_MSG_STRING_LENGTH) {
+        return 0;
+    }
+    unsigned short header = (unsigned short) length;
+    memcpy(msg->msg_string + *used, &header, MSG_BATCH_HEADER_LENGTH);
+    memcpy(msg->msg_string + *used + MSG_BATCH_HEADER_LENGTH, string, length);
+    *used += MSG_BATCH_HEADER_LENGTH + length;
+    msg->msg_count++;
+    return 1;
+}
+
+// 从批量消息的offset处读取一条记录(不复制，string指向消息内部)，越界时返回0，成功返回1并移动offset
+int msgBatchNext(const struct msgform *msg, int *offset, const char **string, int *length) {
+    if (*offset + MSG_BATCH_HEADER_LENGTH > MAX_MSG_STRING_LENGTH) {
+        return 0;
+    }
+    unsigned short header;
+    memcpy(&header, msg->msg_string + *offset, MSG_BATCH_HEADER_LENGTH);
+    if (*offset + MSG_BATCH_HEADER_LENGTH + header > MAX_MSG_STRING_LENGTH) {
+        return 0;
+    }
+    *string = msg->msg_string + *offset + MSG_BATCH_HEADER_LENGTH;
+    *length = header;
+    *offset += MSG_BATCH_HEADER_LENGTH + header;
+    return 1;
+}
+
+
+// 下面为求值表请求的打包/解包函数
+// msg_count为MSG_TABLE_COUNT时表示求值表请求，msg_string中依次存放求值范围(MsgTableRange)和以'\0'结尾的表达式
+// 回复为批量消息，每条记录为 "x<TAB>f(x)"，点数较多时拆成多条回复，直到收齐numPoints条为止
+// 出错时只回复一条单条字符串消息(msg_count为0)，内容为错误信息
+#define MSG_TABLE_COUNT (-1)
+
+// 求值范围：在[from, to]上等距取numPoints个点
+typedef struct {
+    double from;
+    double to;
+    int numPoints;
+} MsgTableRange;
+
+// 打包求值表请求，返回msg_string中使用的长度，表达式过长时返回-1
+int msgTableInit(struct msgform *msg, const MsgTableRange *range, const char *expression) {
+    int length = (int) strlen(expression);
+    if ((int) sizeof(MsgTableRange) + length + 1 > MAX_MSG_STRING_LENGTH) {
+        return -1;
+    }
+    msg->msg_count = MSG_TABLE_COUNT;
+    memcpy(msg->msg_string, range, sizeof(MsgTableRange));
+    memcpy(msg->msg_string + sizeof(MsgTableRange), expression, length + 1);
+    return (int) sizeof(MsgTableRange) + length + 1;
+}
+
+// 解包求值表请求(不复制，expression指向消息内部)，length为收到的msg_string长度，格式不对时返回0
+int msgTableParse(const struct msgform *msg, int length, MsgTableRange *range, const char **expression) {
+    if (length < (int) sizeof(MsgTableRange) + 1 || length > MAX_MSG_STRING_LENGTH) {
+        return 0;
+    }
+    if (memchr(msg->msg_string + sizeof(MsgTableRange), '\0', length - sizeof(MsgTableRange)) == NULL) {
+        return 0;
+    }
+    memcpy(range, msg->msg_string, sizeof(MsgTableRange));
+    *expression = msg->msg_string + sizeof(MsgTableRange);
+    return 1;
+}
+
+// 求值表第index个点的x值，与服务端求值时取的点相同
+double msgTablePoint(const MsgTableRange *range, int index) {
+    if (range->numPoints == 1) {
+        return range->from;
+    }
+    long double from = range->from;
+    long double to = range->to;
+    return (double) (from + (to - from) * index / (range->numPoints - 1));
+}
+
+
+// 统计请求：msg_count为MSG_STATS_COUNT，没有内容；回复为一条单条字符串消息，内容为服务端各项统计的文本
+#define MSG_STATS_COUNT (-2)
+
+
+// 下面为流式回复的打包/解包函数
+// msg_count为MSG_STREAM_COUNT的请求与单条字符串消息相同，但方程的根不等全部求出，求出一部分就先回复一部分；
+// msg_count为MSG_TABLE_STREAM_COUNT的请求与求值表请求相同，但函数值以long double的二进制形式回复，不转换为文本
+// 流式回复的msg_count均为MSG_STREAM_COUNT，msg_string开头为MsgStreamHeader，之后为count个long double(根、函数值或
+// 计算式的结果)，或者以'\0'结尾的文本(错误码的参数、文本结果)；同一请求的回复块按chunk依次发送，last为1的是最后一块
+// 数值都以二进制形式传输，只在客户端显示时才格式化为文本
+#define MSG_STREAM_COUNT (-3)
+#define MSG_TABLE_STREAM_COUNT (-4)
+
+// 流式回复块的内容
+typedef enum {
+    MSG_STREAM_ROOTS, // 方程的根，按从小到大的顺序
+    MSG_STREAM_TABLE, // 求值表的函数值，first为第一个值所在点的序号
+    MSG_STREAM_TEXT,  // 文本(精确模式的有理数结果，以及无法识别的错误信息)
+    MSG_STREAM_VALUE, // 计算式的结果，一个值
+    MSG_STREAM_ERROR  // 错误，first为错误码(MsgErrorCode)，之后为错误码的参数(文本，没有参数时为空字符串)
+} MsgStreamKind;
+
+typedef struct {
+    int chunk; // 回复块的编号，从0开始
+    int last; // 是否为最后一块
+    int kind; // MsgStreamKind
+    int first;
+    int count; // 值的个数，文本和错误时为0
+} MsgStreamHeader;
+
+// long double中实际存放数值的字节数(x87扩展精度为10字节，其余为填充；其他平台上与sizeof相同)
+#if defined(__x86_64__) || defined(__i386__)
+#define LONG_DOUBLE_VALUE_BYTES (sizeof(long double) < 10 ? sizeof(long double) : 10)
+#else
+#define LONG_DOUBLE_VALUE_BYTES sizeof(long double)
+#endif
+
+// 一个回复块中最多的值的个数
+#define MSG_STREAM_MAX_VALUES ((int) ((MAX_MSG_STRING_LENGTH - sizeof(MsgStreamHeader)) / sizeof(long double)))
+
+// 将消息初始化为空的流式回复块
+void msgStreamInit(struct msgform *msg, int chunk, MsgStreamKind kind, int first) {
+    MsgStreamHeader header = {chunk, 0, kind, first, 0};
+    msg->msg_count = MSG_STREAM_COUNT;
+    memcpy(msg->msg_string, &header, sizeof(MsgStreamHeader));
+}
+
+// 向流式回复块追加一个值，块已满时返回0(消息不变)，成功返回1
+int msgStreamAppend(struct msgform *msg, long double value) {
+    MsgStreamHeader header;
+    memcpy(&header, msg->msg_string, sizeof(MsgStreamHeader));
+    if (header.count >= MSG_STREAM_MAX_VALUES) {
+        return 0;
+    }
+    // long double只有前10字节有效，先清零整个槽位，避免把未初始化的填充字节发给客户端
+    char *slot = msg->msg_string + sizeof(MsgStreamHeader) + header.count * sizeof(long double);
+    memset(slot, 0, sizeof(long double));
+    memcpy(slot, &value, LONG_DOUBLE_VALUE_BYTES);
+    header.count++;
+    memcpy(msg->msg_string, &header, sizeof(MsgStreamHeader));
+    return 1;
+}
+
+// 把流式回复块的内容改为文本，text最多读取size字节(过长时截断)
+void msgStreamSetTextSized(struct msgform *msg, const char *text, size_t size) {
+    MsgStreamHeader header;
+    memcpy(&header, msg->msg_string, sizeof(MsgStreamHeader));
+    header.kind = MSG_STREAM_TEXT;
+    header.count = 0;
+    memcpy(msg->msg_string, &header, sizeof(MsgStreamHeader));
+    if (size > MAX_MSG_STRING_LENGTH - sizeof(MsgStreamHeader) - 1) {
+        size = MAX_MSG_STRING_LENGTH - sizeof(MsgStreamHeader) - 1;
+    }
+    int length = (int) strnlen(text, size);
+    memcpy(msg->msg_string + sizeof(MsgStreamHeader), text, length);
+    msg->msg_string[sizeof(MsgStreamHeader) + length] = '\0';
+}
+
+// 把流式回复块的内容改为文本(过长时截断)
+void msgStreamSetText(struct msgform *msg, const char *text) {
+    msgStreamSetTextSized(msg, text, MAX_MSG_STRING_LENGTH);
+}
+
+// 把流式回复块的内容改为计算式的结果
+void msgStreamSetValue(struct msgform *msg, long double value) {
+    MsgStreamHeader header;
+    memcpy(&header, msg->msg_string, sizeof(MsgStreamHeader));
+    header.kind = MSG_STREAM_VALUE;
+    header.count = 1;
+    memcpy(msg->msg_string, &header, sizeof(MsgStreamHeader));
+    char *slot = msg->msg_string + sizeof(MsgStreamHeader);
+    memset(slot, 0, sizeof(long double));
+    memcpy(slot, &value, LONG_DOUBLE_VALUE_BYTES);
+}
+
+// 把流式回复块的内容改为错误码及其参数，argument为大小为size的缓冲区(过长时截断)
+void msgStreamSetError(struct msgform *msg, int code, const char *argument, size_t size) {
+    msgStreamSetTextSized(msg, argument, size);
+    MsgStreamHeader header;
+    memcpy(&header, msg->msg_string, sizeof(MsgStreamHeader));
+    header.kind = MSG_STREAM_ERROR;
+    header.first = code;
+    memcpy(msg->msg_string, &header, sizeof(MsgStreamHeader));
+}
+
+// 标记为最后一块
+void msgStreamSetLast(struct msgform *msg) {
+    MsgStreamHeader header;
+    memcpy(&header, msg->msg_string, sizeof(MsgStreamHeader));
+    header.last = 1;
+    memcpy(msg->msg_string, &header, sizeof(MsgStreamHeader));
+}
+
+// 流式回复块在msg_string中使用的长度
+int msgStreamLength(const struct msgform *msg) {
+    MsgStreamHeader header;
+    memcpy(&header, msg->msg_string, sizeof(MsgStreamHeader));
+    if (header.kind == MSG_STREAM_TEXT || header.kind == MSG_STREAM_ERROR) {
+        return (int) sizeof(MsgStreamHeader) +
+               (int) strnlen(msg->msg_string + sizeof(MsgStreamHeader),
+                             MAX_MSG_STRING_LENGTH - sizeof(MsgStreamHeader) - 1) + 1;
+    }
+    return (int) (sizeof(MsgStreamHeader) + header.count * sizeof(long double));
+}
+
+// 解包流式回复块(不复制，data指向消息内部，值用msgStreamValue读取)，length为收到的msg_string长度，格式不对时返回0
+int msgStreamParse(const struct msgform *msg, int length, MsgStreamHeader *header, const char **data) {
+    if (msg->msg_count != MSG_STREAM_COUNT || length < (int) sizeof(MsgStreamHeader) ||
+        length > MAX_MSG_STRING_LENGTH) {
+        return 0;
+    }
+    memcpy(header, msg->msg_string, sizeof(MsgStreamHeader));
+    *data = msg->msg_string + sizeof(MsgStreamHeader);
+    if (header->kind == MSG_STREAM_TEXT || header->kind == MSG_STREAM_ERROR) {
+        return memchr(*data, '\0', length - sizeof(MsgStreamHeader)) != NULL;
+    }
+    return header->count >= 0 && header->count <= MSG_STREAM_MAX_VALUES &&
+           length >= (int) (sizeof(MsgStreamHeader) + header->count * sizeof(long double));
+}
+
+// 读取流式回复块中的第index个值
+long double msgStreamValue(const char *data, int index) {
+    long double value;
+    memcpy(&value, data + index * sizeof(long double), sizeof(long double));
+    return value;
+}
+
+
+// 下面为错误码相关的函数
+// 计算函数出错时给出错误码和参数(如未定义的符号、次幂上限)，二进制回复中只传错误码和参数，错误信息的文本都按错误码由下表给出
+typedef enum {
+    MSG_ERROR_UNKNOWN_SYMBOL, // 参数为未定义的符号
+    MSG_ERROR_MISSING_EXPRESSION,
+    MSG_ERROR_VARIABLE_IN_CALCULATION,
+    MSG_ERROR_UNMATCHED_RIGHT_BRACKET,
+    MSG_ERROR_UNMATCHED_LEFT_BRACKET,
+    MSG_ERROR_EMPTY_BRACKETS,
+    MSG_ERROR_ADJACENT_BRACKETS,
+    MSG_ERROR_CONTINUOUS_OPERATORS,
+    MSG_ERROR_VALUE_BEFORE_BRACKET,
+    MSG_ERROR_VALUE_AFTER_BRACKET,
+    MSG_ERROR_CONTINUOUS_VALUES,
+    MSG_ERROR_OPERATOR_AT_BEGINNING,
+    MSG_ERROR_OPERATOR_AT_END,
+    MSG_ERROR_DIVISOR_NOT_CONSTANT,
+    MSG_ERROR_DIVIDE_BY_ZERO,
+    MSG_ERROR_MODULUS_NOT_CONSTANT,
+    MSG_ERROR_MODULO_BY_ZERO,
+    MSG_ERROR_DIVIDEND_NOT_CONSTANT,
+    MSG_ERROR_EXPONENT_NOT_CONSTANT,
+    MSG_ERROR_EXPONENT_NOT_POSITIVE,
+    MSG_ERROR_EXPONENT_NOT_INTEGER,
+    MSG_ERROR_STACK_EMPTY,
+    MSG_ERROR_STACK_COUNT,
+    MSG_ERROR_UNKNOWN_OPERATOR,
+    MSG_ERROR_UNKNOWN_ELEMENT,
+    MSG_ERROR_POWER_TOO_LARGE, // 参数为次幂上限
+    MSG_ERROR_TABLE_POINTS, // 参数为点数上限
+    MSG_ERROR_EQUATION_TABLE,
+    MSG_ERROR_TIMEOUT,
+    MSG_ERROR_REJECTED,
+    NUM_MSG_ERRORS
+} MsgErrorCode;
+
+// 各错误码的错误信息(%s处为参数)
+const char *msgErrorMessages[NUM_MSG_ERRORS] = {
+        "symbol %s was not define",
+        "missing expression",
+        "Only variables can appear in equations, not in calculations",
+        "unmatched right bracket",
+        "unmatched left bracket",
+        "left bracket followed by right bracket",
+        "right bracket followed by left bracket, please use '*'",
+        "continuous operators",
+        "number or variable followed by left bracket, please use '*'",
+        "right bracket followed by number or variable, please use '*'",
+        "continuous numbers or variables",
+        "operator at the beginning",
+        "operator at the end",
+        "divisor must be a constant",
+        "divide by zero",
+        "modulus must be a constant",
+        "modulo by zero",
+        "dividend must be a constant",
+        "exponent must be a constant",
+        "exponent must be a positive number",
+        "exponent must be an integer",
+        "expression stack is empty",
+        "expression stack count is wrong",
+        "unknown operator",
+        "unknown element type",
+        "power count is too large(>=%s)",
+        "number of table points must be between 1 and %s",
+        "equations can not be tabulated",
+        "time budget exceeded",
+        "server busy, request rejected"
+};
+
+// 按错误码和参数给出错误信息，写入buffer(最多size-1个字符)
+void msgErrorFormat(int code, const char *argument, char *buffer, size_t size) {
+    if (code < 0 || code >= NUM_MSG_ERRORS) {
+        snprintf(buffer, size, "unknown error %d", code);
+    } else {
+        snprintf(buffer, size, msgErrorMessages[code], argument);
+    }
+}
+
+
+// 下面为请求分类的函数
+// 按内容判断请求的消息类型：方程(含有等号)、求值表以及含有方程的批量请求为重量请求，其余为轻量请求
+long msgRequestType(const struct msgform *msg) {
+    if (msg->msg_count == MSG_TABLE_COUNT || msg->msg_count == MSG_TABLE_STREAM_COUNT) {
+        return MSG_TYPE_HEAVY;
+    }
+    if (msg->msg_count == 0 || msg->msg_count == MSG_STREAM_COUNT) {
+        return memchr(msg->msg_string, '=', strnlen(msg->msg_string, MAX_MSG_STRING_LENGTH)) != NULL
+               ? MSG_TYPE_HEAVY : MSG_TYPE_LIGHT;
+    }
+    int offset = 0;
+    const char *string;
+    int length;
+    for (int i = 0; i < msg->msg_count && msgBatchNext(msg, &offset, &string, &length); i++) {
+        if (memchr(string, '=', length) != NULL) {
+            return MSG_TYPE_HEAVY;
+        }
+    }
+    return MSG_TYPE_LIGHT;
+}
+
+#endif // MSG_MYCS_H
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "my_histogram.h"
+
+// 异步客户端：同时保持最多window个未完成的请求(每个请求一个表达式)，按回复中的seq匹配乱序返回的结果
+// 发送不阻塞：请求队列已满时先接收回复，避免与等待回复队列空位的工作者互相等待
+// 请求的序号 = (代数 << ASYNC_SLOT_BITS) | 槽位，槽位在收到回复后回收，代数保证同一槽位先后的请求序号不同
+
+#define ASYNC_SLOT_BITS 16
+// 最大的窗口大小
+#define ASYNC_MAX_WINDOW (1 << ASYNC_SLOT_BITS)
+
+// 传输接口
+typedef struct {
+    int (*trySend)(struct msgform *msg, int length); // 不阻塞地发送，队列已满返回0，成功返回1，出错返回-1
+    int (*send)(struct msgform *msg, int length); // 阻塞发送，出错返回-1
+    int (*receive)(struct msgform *msg); // 阻塞接收发给本客户端的回复，返回msg_string的长度，出错返回-1
+} AsyncTransport;
+
+// 收到结果时的回调(result末尾的换行符已去掉)
+typedef void (*AsyncResultCallback)(void *context, const char *expression, const char *result);
+
+// 一个未完成的请求
+typedef struct {
+    unsigned int seq;
+    long long sendTime;
+    char *expression;
+} AsyncPending;
+
+typedef struct {
+    AsyncTransport transport;
+    int pid;
+    int window;
+    int inFlight;
+    unsigned int generation;
+    AsyncPending *pending; // window个槽位
+    int *freeSlots; // 空闲槽位的栈
+    int numFreeSlots;
+    AsyncResultCallback onResult;
+    void *context;
+    int budgetMs; // 每个请求的时间预算(毫秒)，0表示不限(新建后由调用者设置)
+    // 统计
+    LatencyHistogram latency;
+    unsigned long sent;
+    unsigned long completed;
+    unsigned long errors; // 结果为错误信息的请求数
+    unsigned long stale; // 序号对不上的回复数(如上一个占用共享内存槽位的客户端遗留的回复)
+    long long startTime;
+} AsyncClient;
+
+// 单调时钟的当前时间(纳秒)
+long long asyncNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// 新建异步客户端，window超出范围时取最近的合法值
+AsyncClient *asyncClientNew(AsyncTransport transport, int pid, int window, AsyncResultCallback onResult,
+                            void *context) {
+    if (window < 1) {
+        window = 1;
+    } else if (window > ASYNC_MAX_WINDOW) {
+        window = ASYNC_MAX_WINDOW;
+    }
+    AsyncClient *client = (AsyncClient *) calloc(1, sizeof(AsyncClient));
+    client->transport = transport;
+    client->pid = pid;
+    client->window = window;
+    client->pending = (AsyncPending *) calloc(window, sizeof(AsyncPending));
+    client->freeSlots = (int *) malloc(window * sizeof(int));
+    for (int i = 0; i < window; i++) {
+        client->freeSlots[i] = window - 1 - i;
+    }
+    client->numFreeSlots = window;
+    client->onResult = onResult;
+    client->context = context;
+    client->startTime = asyncNow();
+    return client;
+}
+
+void freeAsyncClient(AsyncClient *client) {
+    for (int i = 0; i < client->window; i++) {
+        free(client->pending[i].expression);
+    }
+    free(client->pending);
+    free(client->freeSlots);
+    free(client);
+}
+
+// 阻塞接收一条回复并与未完成的请求匹配，出错返回-1
+int asyncClientReceiveOne(AsyncClient *client) {
+    struct msgform reply;
+    if (client->transport.receive(&reply) < 0) {
+        return -1;
+    }
+    int slot = (int) (reply.seq & (ASYNC_MAX_WINDOW - 1));
+    AsyncPending *pending = slot < client->window ? &client->pending[slot] : NULL;
+    if (pending == NULL || pending->expression == NULL || pending->seq != reply.seq || reply.msg_count != 0) {
+        client->stale++;
+        return 1;
+    }
+    histogramRecord(&client->latency, asyncNow() - pending->sendTime);
+    client->completed++;
+    if (strncmp(reply.msg_string, "Error", 5) == 0) {
+        client->errors++;
+    }
+    if (client->onResult != NULL) {
+        reply.msg_string[strcspn(reply.msg_string, "\n")] = '\0';
+        client->onResult(client->context, pending->expression, reply.msg_string);
+    }
+    free(pending->expression);
+    pending->expression = NULL;
+    client->freeSlots[client->numFreeSlots++] = slot;
+    client->inFlight--;
+    return 1;
+}
+
+// 提交一个表达式：窗口已满或请求队列已满时先接收回复；表达式过长返回0，出错返回-1，成功返回1
+int asyncClientSubmit(AsyncClient *client, const char *expression) {
+    int length = (int) strlen(expression);
+    if (length >= MAX_MSG_STRING_LENGTH) {
+        return 0;
+    }
+    while (client->numFreeSlots == 0) {
+        if (asyncClientReceiveOne(client) < 0) {
+            return -1;
+        }
+    }
+    int slot = client->freeSlots[--client->numFreeSlots];
+    struct msgform msg;
+    msg.source_pid = client->pid;
+    msg.msg_count = 0;
+    msg.seq = (client->generation++ << ASYNC_SLOT_BITS) | (unsigned int) slot;
+    memcpy(msg.msg_string, expression, length + 1);
+    msg.mtype = msgRequestType(&msg);
+    long long sendTime = asyncNow();
+    msg.send_time = sendTime;
+    msg.budget_ms = client->budgetMs;
+    for (;;) {
+        int sent = client->transport.trySend(&msg, length + 1);
+        if (sent == 1) {
+            break;
+        }
+        if (sent < 0) {
+            client->freeSlots[client->numFreeSlots++] = slot;
+            return -1;
+        }
+        // 队列已满：有未完成的请求时先取走回复腾出空间，否则队列被其他客户端占满，只能阻塞等待
+        if (client->inFlight > 0) {
+            if (asyncClientReceiveOne(client) < 0) {
+                client->freeSlots[client->numFreeSlots++] = slot;
+                return -1;
+            }
+        } else if (client->transport.send(&msg, length + 1) < 0) {
+            client->freeSlots[client->numFreeSlots++] = slot;
+            return -1;
+        } else {
+            break;
+        }
+    }
+    AsyncPending *pending = &client->pending[slot];
+    pending->seq = msg.seq;
+    pending->sendTime = sendTime;
+    pending->expression = strdup(expression);
+    client->inFlight++;
+    client->sent++;
+    return 1;
+}
+
+// 等待所有未完成的请求返回，出错返回-1
+int asyncClientDrain(AsyncClient *client) {
+    while (client->inFlight > 0) {
+        if (asyncClientReceiveOne(client) < 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+// 输出吞吐量和延迟的统计(延迟从发送到收到回复，单位微秒)
+void asyncClientReport(const AsyncClient *client, FILE *out) {
+    double elapsed = (asyncNow() - client->startTime) / 1e9;
+    const LatencyHistogram *latency = &client->latency;
+    fprintf(out, "requests=%lu completed=%lu errors=%lu window=%d elapsed=%.3fs throughput=%.1f req/s\n",
+            client->sent, client->completed, client->errors, client->window, elapsed,
+            elapsed > 0 ? client->completed / elapsed : 0.0);
+    fprintf(out, "latency_us mean=%.1f p50=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+            latency->count > 0 ? latency->sum / 1000.0 / latency->count : 0.0,
+            histogramPercentile(latency, 50) / 1000.0, histogramPercentile(latency, 99) / 1000.0,
+            histogramPercentile(latency, 99.9) / 1000.0, latency->max / 1000.0);
+    if (client->stale > 0) {
+        fprintf(out, "stale replies=%lu\n", client->stale);
+    }
+}
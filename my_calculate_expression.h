@@ -1,1048 +1,4823 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-// 参数设置
-// 最大支持的次幂数
-const int MAX_POWER_COUNT = 255;
-// 二分法求根的二分最小阈值
-const long double BINARY_SEARCH_ROOT_THRESHOLD = 1e-6;
-// 二分法求根的左右最大最小端点值
-const long double BINARY_SEARCH_ROOT_MIN = -1e9;
-const long double BINARY_SEARCH_ROOT_MAX = 1e9;
-// 是否输出调试信息
-int debug = 0;
-
-// long double的绝对值函数
-long double lfabs(long double x) {
-    if (x < 0) {
-        return -x;
-    }
-    return x;
-}
-
-
-// 下面为元素相关的结构体和函数(元素代表字符串解析后的每个值，可以是常量/变量/操作符/等号)
-// 定义元素类型枚举
-typedef enum {
-    NUMBER,     // 数字
-    OPERATOR,   // 操作符
-    VARIABLE,   // 未知数x
-    EQUALS     // 等号
-} ElementType;
-
-// 定义元素结构体(元素代表字符串解析后的每个值，可以是常量/变量/操作符/等号)
-typedef struct {
-    ElementType type;
-    long double value;
-} Element;
-
-// 释放元素数组内存
-void freeElements(Element *elements) {
-    free(elements);
-}
-
-// 输出元素用于debug的工具函数
-void elementPrint(const Element *element) {
-    switch (element->type) {
-        case NUMBER:
-            printf("%Lf ", element->value);
-            break;
-        case OPERATOR:
-        case VARIABLE:
-        case EQUALS:
-            printf("%c ", (char) element->value);
-            break;
-    }
-}
-
-// 判断字符是否为数字
-int isNumeric(const char ch) {
-    return (ch >= '0' && ch <= '9') || ch == '.';
-}
-
-// 解析字符串并返回对应的元素数组(忽略空格，处理整数或小数并记录为NUMBER类型元素，变量x记为VARIABLE元素，操作符和等号分别也记录为对应元素)
-Element *parseString(const char *input, int *numElements, char *errorElement) {
-    int len = (int) strlen(input);
-    Element *elements = (Element *) malloc(len * sizeof(Element));
-    *numElements = 0;
-
-    int i = 0;
-    while (i < len) {
-        if (input[i] == ' ') {
-            i++; // 忽略空格
-            continue;
-        }
-
-        // 处理数字
-        if (isNumeric(input[i])) {
-            int start = i;
-            int pointOccurred = 0;
-            while (isNumeric(input[i])) {
-                i++;
-                if (input[i] == '.') {
-                    pointOccurred++;
-                }
-            }
-            int length = i - start;
-            char number[length + 1];
-            strncpy(number, &input[start], length);
-            number[length] = '\0';
-            if (pointOccurred > 1) {
-                strcpy(errorElement, number);
-                return NULL;
-            }
-            elements[*numElements].type = NUMBER;
-            elements[*numElements].value = atof(number);
-            (*numElements)++;
-            continue;
-        }
-
-        // 处理操作符和其他特殊字符
-        elements[*numElements].value = (long double) input[i];
-
-        switch (input[i]) {
-            case '+':
-            case '-':
-            case '*':
-            case '/':
-            case '%':
-            case '^':
-            case '(':
-            case ')':
-                elements[*numElements].type = OPERATOR;
-                break;
-            case 'x':
-                elements[*numElements].type = VARIABLE;
-                break;
-            case '=':
-                elements[*numElements].type = EQUALS;
-                break;
-            default:
-                strcpy(errorElement, " ");
-                errorElement[0] = (char) elements[*numElements].value;
-                return NULL;
-//                elements[*numElements].type = UNKNOWN;
-//                break;
-        }
-
-        (*numElements)++;
-        i++;
-    }
-
-    return elements;
-}
-
-// 判断元素数组的正确性(判断是否括号不匹配，判断是否有连续的操作符，判断是否有连续的数字或变量，首尾不能为操作符，判断是否漏写乘号等)
-int checkElements(const Element *elements, const int numElements, char *error) {
-    // 括号匹配
-    int numUnmatchedLeftBrackets = 0;
-    for (int i = 0; i < numElements; i++) {
-        if (elements[i].type == OPERATOR && elements[i].value == '(') {
-            numUnmatchedLeftBrackets++;
-        } else if (elements[i].type == OPERATOR && elements[i].value == ')') {
-            numUnmatchedLeftBrackets--;
-        }
-        if (numUnmatchedLeftBrackets < 0) {
-            strcpy(error, "unmatched right bracket");
-            return 0;
-        }
-    }
-    if (numUnmatchedLeftBrackets > 0) {
-        strcpy(error, "unmatched left bracket");
-        return 0;
-    }
-
-    // 左右括号不能连续
-    for (int i = 0; i < numElements - 1; i++) {
-        if (elements[i].type == OPERATOR && elements[i].value == '(' &&
-            elements[i + 1].type == OPERATOR && elements[i + 1].value == ')') {
-            strcpy(error, "left bracket followed by right bracket");
-            return 0;
-        }
-        if (elements[i].type == OPERATOR && elements[i].value == ')' &&
-            elements[i + 1].type == OPERATOR && elements[i + 1].value == '(') {
-            strcpy(error, "right bracket followed by left bracket, please use '*'");
-            return 0;
-        }
-    }
-
-    // 连续操作符(左括号可以左连操作符，右括号可以右连)
-    for (int i = 0; i < numElements - 1; i++) {
-        if (elements[i].type == OPERATOR && elements[i + 1].type == OPERATOR) {
-            if (elements[i + 1].value != '(' && elements[i].value != ')') {
-                strcpy(error, "continuous operators");
-                return 0;
-            }
-        }
-    }
-
-    // 数字或变量不能右边是左括号，不能左边是右括号
-    for (int i = 0; i < numElements - 1; i++) {
-        if ((elements[i].type == NUMBER || elements[i].type == VARIABLE) &&
-            elements[i + 1].type == OPERATOR && elements[i + 1].value == '(') {
-            strcpy(error, "number or variable followed by left bracket, please use '*'");
-            return 0;
-        }
-        if (elements[i].type == OPERATOR && elements[i].value == ')' &&
-            (elements[i + 1].type == NUMBER || elements[i + 1].type == VARIABLE)) {
-            strcpy(error, "right bracket followed by number or variable, please use '*'");
-            return 0;
-        }
-    }
-
-    // 连续两个元素都是数字或变量
-    for (int i = 0; i < numElements - 1; i++) {
-        if ((elements[i].type == NUMBER || elements[i].type == VARIABLE) &&
-            (elements[i + 1].type == NUMBER || elements[i + 1].type == VARIABLE)) {
-            strcpy(error, "continuous numbers or variables");
-            return 0;
-        }
-    }
-
-    // 首尾不能为操作符
-    if (elements[0].type == OPERATOR && elements[0].value != '(') {
-        strcpy(error, "operator at the beginning");
-        return 0;
-    }
-    if (elements[numElements - 1].type == OPERATOR && elements[numElements - 1].value != ')') {
-        strcpy(error, "operator at the end");
-        return 0;
-    }
-
-    return 1;
-}
-
-// 找到等号的位置
-int findEquals(const Element *elements, const int numElements) {
-    for (int i = 0; i < numElements; i++) {
-        if (elements[i].type == EQUALS) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-// 等式转换，将等式转换为表达式的元素列表( E1=E2 -> E1-(E2)=0 )
-Element *transformEquals(const Element *elements, const int numElements, int *numElementsTransformed) {
-    int equalsIndex = findEquals(elements, numElements);
-    if (equalsIndex == -1) {
-        return NULL;
-    }
-    Element *elementsTransformed = (Element *) malloc((numElements + 3 - 1) * sizeof(Element));
-    *numElementsTransformed = 0;
-    for (int i = 0; i < equalsIndex; i++) {
-        elementsTransformed[*numElementsTransformed] = elements[i];
-        (*numElementsTransformed)++;
-    }
-    elementsTransformed[*numElementsTransformed].type = OPERATOR;
-    elementsTransformed[*numElementsTransformed].value = '-';
-    (*numElementsTransformed)++;
-    elementsTransformed[*numElementsTransformed].type = OPERATOR;
-    elementsTransformed[*numElementsTransformed].value = '(';
-    (*numElementsTransformed)++;
-    for (int i = equalsIndex + 1; i < numElements; i++) {
-        elementsTransformed[*numElementsTransformed] = elements[i];
-        (*numElementsTransformed)++;
-    }
-    elementsTransformed[*numElementsTransformed].type = OPERATOR;
-    elementsTransformed[*numElementsTransformed].value = ')';
-    (*numElementsTransformed)++;
-    return elementsTransformed;
-}
-
-
-// 下面为表达式相关的结构体和函数(表达式代表每个形如an*x^n+...a1*x+a0的多项式，作为计算时的最小单元)
-// 定义表达式结构体(表达式代表每个形如an*x^n+...a1*x+a0的多项式，作为计算时的最小单元)
-typedef struct {
-    int powerCount; // 表达式最高的阶次，即n
-    long double *factorValue; // 各个未知数次幂的系数，次幂数从小到大，即a0,a1,...,an
-} Expression;
-
-// 释放表达式内存
-void freeExpression(Expression *expression) {
-    free(expression->factorValue);
-    free(expression);
-}
-
-// 根据次幂数新建空表达式(n -> an*x^n+...+a1*n+a0, an~a0未定义)
-Expression *expressionNew(const int powerCount) {
-    Expression *expression = (Expression *) malloc(sizeof(Expression));
-    expression->powerCount = powerCount;
-    expression->factorValue = (long double *) malloc((powerCount + 1) * sizeof(long double));
-    return expression;
-}
-
-// 根据次幂数新建全0的空表达式(n -> an*x^n+...+a1*n+a0, an~a0均为0)
-Expression *expressionNew0(const int powerCount) {
-    Expression *expression = expressionNew(powerCount);
-    for (int i = 0; i <= powerCount; i++) {
-        expression->factorValue[i] = 0;
-    }
-    return expression;
-}
-
-// 复制表达式
-Expression *expressionCopy(const Expression *expression) {
-    Expression *expressionCopy = expressionNew(expression->powerCount);
-    for (int i = 0; i <= expression->powerCount; i++) {
-        expressionCopy->factorValue[i] = expression->factorValue[i];
-    }
-    return expressionCopy;
-}
-
-// 输出表达式用于debug的工具函数
-void expressionPrint(const Expression *expression) {
-    int printed = 0;
-    for (int i = expression->powerCount; i >= 0; i--) {
-        if (expression->factorValue[i] != 0) {
-            if (printed) {
-                printf(" + ");
-            }
-            if (i == 0) {
-                printf("%.2Lf", expression->factorValue[i]);
-            } else if (i == 1) {
-                printf("%.2Lfx", expression->factorValue[i]);
-            } else {
-                printf("%.2Lfx^%d", expression->factorValue[i], i);
-            }
-            printed = 1;
-        }
-    }
-    if (!printed) {
-        printf("0");
-    }
-}
-
-// 简化表达式(除去高次幂的0项)(自动释放原表达式内存)
-Expression *expressionSimplify(Expression *expression) {
-    // 求出最大非零项的阶次
-    int maxPower = 0;
-    for (int i = expression->powerCount; i >= 0; i--) {
-        if (expression->factorValue[i] != 0) {
-            maxPower = i;
-            break;
-        }
-    }
-    Expression *simplifiedExpression = expressionNew(maxPower);
-    for (int i = 0; i <= maxPower; i++) {
-        simplifiedExpression->factorValue[i] = expression->factorValue[i];
-    }
-    freeExpression(expression);
-    return simplifiedExpression;
-}
-
-// 元素转表达式(需确定元素为值类型而非符号)(不自动释放元素内存)
-Expression *elementToExpression(const Element *element) {
-    Expression *expression;
-    if (element->type == NUMBER) {
-        expression = expressionNew(0);
-        expression->factorValue[0] = element->value;
-    } else if (element->type == VARIABLE) {
-        expression = expressionNew(1);
-        expression->factorValue[0] = 0;
-        expression->factorValue[1] = 1;
-    } else {
-        return NULL;
-    }
-    return expression;
-}
-
-// 表达式加法(结果取次幂数最大的为新的次幂数，然后将对应次幂的系数相加即可)
-Expression *expressionAdd(const Expression *expression1, const Expression *expression2, char *error) {
-    // 加法
-    // 取次幂数最高值为结果次幂，然后逐项循环求值
-    int powerCount =
-            expression1->powerCount > expression2->powerCount ?
-            expression1->powerCount : expression2->powerCount;
-    Expression *expression = expressionNew0(powerCount);
-    for (int i = 0; i <= expression1->powerCount; i++) {
-        expression->factorValue[i] += expression1->factorValue[i];
-    }
-    for (int i = 0; i <= expression2->powerCount; i++) {
-        expression->factorValue[i] += expression2->factorValue[i];
-    }
-    // 简化结果
-    expression = expressionSimplify(expression);
-    return expression;
-}
-
-// 表达式减法(结果取次幂数最大的为新的次幂数，然后将对应次幂的系数相减即可)
-Expression *expressionSubtract(const Expression *expression1, const Expression *expression2, char *error) {
-    // 减法
-    // 取次幂数最高值为结果次幂，然后逐项循环求值
-    int powerCount =
-            expression1->powerCount > expression2->powerCount ?
-            expression1->powerCount : expression2->powerCount;
-    Expression *expression = expressionNew0(powerCount);
-    for (int i = 0; i <= expression1->powerCount; i++) {
-        expression->factorValue[i] += expression1->factorValue[i];
-    }
-    for (int i = 0; i <= expression2->powerCount; i++) {
-        expression->factorValue[i] -= expression2->factorValue[i];
-    }
-    // 简化结果
-    expression = expressionSimplify(expression);
-    return expression;
-}
-
-// 表达式乘法(结果取次幂数之和的为新的次幂数，然后循环并累积各个次幂数的值)(基于整式乘法)
-Expression *expressionMultiply(const Expression *expression1, const Expression *expression2, char *error) {
-    // 整式乘法
-    // 取次幂数之和为结果次幂，然后逐项循环求值
-    int powerCount = expression1->powerCount + expression2->powerCount;
-    Expression *expression = expressionNew0(powerCount);
-    for (int i = 0; i <= expression1->powerCount; i++) {
-        for (int j = 0; j <= expression2->powerCount; j++) {
-            expression->factorValue[i + j] += expression1->factorValue[i] * expression2->factorValue[j];
-        }
-    }
-    // 简化结果
-    expression = expressionSimplify(expression);
-    return expression;
-}
-
-// 表达式除法(仅支持除以一个常数，除以0报错，结果取被除数的次幂数，循环将每个系数均除以除数即可)
-Expression *expressionDivide(const Expression *expression1, const Expression *expression2, char *error) {
-    // 除数必须为常数(次幂数为0)
-    if (expression2->powerCount != 0) {
-        strcpy(error, "divisor must be a constant");
-        return NULL;
-    }
-    // 除数不能为0
-    if (expression2->factorValue[0] == 0) {
-        strcpy(error, "divide by zero");
-        return NULL;
-    }
-    // 除法
-    // 新建表达式，直接循环求值
-    int powerCount = expression1->powerCount;
-    Expression *expression = expressionNew(powerCount);
-    for (int i = 0; i <= expression1->powerCount; i++) {
-        expression->factorValue[i] = expression1->factorValue[i] / expression2->factorValue[0];
-    }
-    // 简化结果
-    expression = expressionSimplify(expression);
-    return expression;
-}
-
-// 表达式求余(仅支持常数求模一个常数，求模0报错，均为常数故直接计算即可)
-Expression *expressionMod(const Expression *expression1, const Expression *expression2, char *error) {
-    //  模数必须为常数(次幂数为0)
-    if (expression2->powerCount != 0) {
-        strcpy(error, "modulus must be a constant");
-        return NULL;
-    }
-    // 模数不能为0
-    if (expression2->factorValue[0] == 0) {
-        strcpy(error, "modulo by zero");
-        return NULL;
-    }
-    // 被除数必须为常数(次幂数为0)
-    if (expression1->powerCount != 0) {
-        strcpy(error, "dividend must be a constant");
-        return NULL;
-    }
-    // 求余
-    // 新建表达式，直接循环求值
-    int powerCount = expression1->powerCount;
-    Expression *expression = expressionNew(powerCount);
-    for (int i = 0; i <= expression->powerCount; i++) {
-        expression->factorValue[i] =
-                expression1->factorValue[i] -
-                (int) (expression1->factorValue[i] / expression2->factorValue[0]) * expression2->factorValue[0];
-    }
-    // 简化结果
-    expression = expressionSimplify(expression);
-    return expression;
-}
-
-// 表达式求幂的底层函数，基于表达式乘法实现递归二分的快速幂(需保证幂次为整数)
-Expression *expressionPowerQuick(const Expression *expression1, const int powerCount, char *error) {
-    // 快速幂
-    // 如果幂次为0，返回1
-    if (powerCount == 0) {
-        Expression *expression = expressionNew(0);
-        expression->factorValue[0] = 1;
-        return expression;
-    }
-    // 如果幂次为1，返回原表达式
-    if (powerCount == 1) {
-        return expressionCopy(expression1);
-    }
-    // 新建表达式，二分递归求值
-    // 求出一半的幂次
-    Expression *expressionHalf = expressionPowerQuick(expression1, powerCount / 2, error);
-    // 求出模2的幂次
-    Expression *expressionMod2 = expressionPowerQuick(expression1, powerCount % 2, error);
-    // 两者相乘
-    Expression *expression = expressionMultiply(expressionHalf, expressionHalf, error);
-    expression = expressionMultiply(expression, expressionMod2, error);
-    // 简化结果
-    expression = expressionSimplify(expression);
-    // 释放内存
-    freeExpression(expressionHalf);
-    freeExpression(expressionMod2);
-
-    return expression;
-}
-
-// 表达式求幂(结果幂次为两个参数的幂次之积，内部使用上面的快速幂函数计算)
-Expression *expressionPower(const Expression *expression1, const Expression *expression2, char *error) {
-    // 次幂数必须为常数(次幂数为0)
-    if (expression2->powerCount != 0) {
-        strcpy(error, "exponent must be a constant");
-        return NULL;
-    }
-    // 次幂数不能为负数
-    if (expression2->factorValue[0] < 0) {
-        strcpy(error, "exponent must be a positive number");
-        return NULL;
-    }
-    // 次幂数必须为整数
-    if (expression2->factorValue[0] != (int) expression2->factorValue[0]) {
-        strcpy(error, "exponent must be an integer");
-        return NULL;
-    }
-    // 求幂
-    // 新建表达式，使用快速幂函数计算
-    int powerNum = (int) expression2->factorValue[0];
-    Expression *expression = expressionPowerQuick(expression1, powerNum, error);
-    // 简化结果
-    expression = expressionSimplify(expression);
-    return expression;
-}
-
-
-// 下面为计算表达式的相关函数
-// 操作符结构体
-typedef struct {
-    char symbol; // 符号
-    int priority; // 优先级(实际优先级，遇到左括号会增加优先级，遇到右括号会减少优先级)
-} Operator;
-
-// 输出操作符和优先级用于debug的工具函数
-void operatorPrint(const Operator *operator) {
-    printf("OPERATOR(%c, %d)", operator->symbol, operator->priority);
-}
-
-// 输出操作符优先级，+-为1、*/%为2、^为3，每遇到一个左括号则接下来的运算符优先级全部加4，每一个右括号则取消加4
-int operatorPriority(const char symbol) {
-    switch (symbol) {
-        case '+':
-        case '-':
-            return 1;
-        case '*':
-        case '/':
-        case '%':
-            return 2;
-        case '^':
-            return 3;
-        default:
-            return 0 / 0;
-    }
-}
-
-// 表达式计算(括号优先级改变，操作符和变量常量入栈计算)
-/*
- 循环遍历元素列表，将变量和常量转为表达式记入表达式栈，操作符和优先级记入操作符栈(单调栈)
- 括号会改变接下来操作符的优先级，操作符入栈时弹出优先级更大的操作符再入栈
- 每次弹出操作符时同时弹出两个表达式一起计算，结果表达式再存入表达式栈
- 反复运算直到结束
-*/
-Expression *expressionCalculate(const Element *elements, const int numElements, char *error) {
-    // 操作符优先级：^:3, */%:2, +-:1, ()全体加4
-    // 操作符栈：存储操作符，遇到左括号则接下来的优先级加4，遇到右括号则接下来的优先级减4，遇到操作符则弹出两个表达式进行计算，然后将计算结果入栈
-    int numOperators = 0;
-    Operator *operatorStack = (Operator *) malloc(numElements * sizeof(Operator));
-    // 操作数栈：存储表达式，遇到数字或未知数则转换为表达式入栈，遇到操作符则弹出两个表达式进行计算，然后将计算结果入栈
-    int numExpressions = 0;
-    Expression *expressionStack = (Expression *) malloc(numElements * sizeof(Expression));
-    // 从左到右遍历元素数组，遇到数字或未知数则转换为表达式，遇到操作符则根据操作符计算
-    int currentPlusPriority = 0; // 当前的额外优先级
-    for (int i = 0; i < numElements; i++) {
-        switch (elements[i].type) {
-            case NUMBER:
-            case VARIABLE:
-                // 转换为表达式入栈
-                expressionStack[numExpressions] = *elementToExpression(&elements[i]);
-                numExpressions++;
-                // log：输出表达式
-                if (debug == 1) {
-                    printf("Stack an expression:");
-                    expressionPrint(&expressionStack[numExpressions - 1]);
-                    printf("\n");
-                }
-                break;
-            case OPERATOR:
-                // 如果是左括号，接下来的算符的优先级加4
-                if (elements[i].value == '(') {
-                    currentPlusPriority += 4;
-                    break;
-                }
-                // 如果是右括号，接下来的算符的优先级减4
-                if (elements[i].value == ')') {
-                    currentPlusPriority -= 4;
-                    break;
-                }
-                // 如果是其他操作符，与操作符栈中的优先级比较，如果比栈顶的优先级高，则入栈，否则一直弹出栈顶运算符并计算直到栈顶优先级低于当前运算符
-                // 如果栈顶优先级低于当前运算符，则入栈
-                int currentPriority = operatorPriority((char) elements[i].value);
-                if (numOperators == 0 ||
-                    operatorStack[numOperators - 1].priority < currentPriority + currentPlusPriority) {
-                    operatorStack[numOperators].symbol = (char) elements[i].value;
-                    operatorStack[numOperators].priority = currentPriority + currentPlusPriority;
-                    numOperators++;
-                    // log：输出操作符
-                    if (debug == 1) {
-                        printf("Stack an operator:");
-                        operatorPrint(&operatorStack[numOperators - 1]);
-                        printf("\n");
-                    }
-                    break;
-                }
-                // 如果栈顶优先级高于当前运算符，则弹出栈顶运算符并计算直到栈顶优先级低于当前运算符
-                while (numOperators > 0 &&
-                       operatorStack[numOperators - 1].priority >= currentPriority + currentPlusPriority) {
-                    // 弹出栈顶运算符
-                    Operator operator = operatorStack[numOperators - 1];
-                    numOperators--;
-                    // log：输出操作符
-                    if (debug == 1) {
-                        printf("Pop an operator:");
-                        operatorPrint(&operator);
-                        printf("\n");
-                    }
-                    // 弹出两个表达式
-                    if (numExpressions < 2) {
-                        strcpy(error, "expression stack is empty");
-                        return NULL;
-                    }
-                    Expression expression2 = expressionStack[numExpressions - 1];
-                    numExpressions--;
-                    Expression expression1 = expressionStack[numExpressions - 1];
-                    numExpressions--;
-                    // log：输出表达式
-                    if (debug == 1) {
-                        printf("Pop two expressions:");
-                        expressionPrint(&expression1);
-                        printf("\t");
-                        expressionPrint(&expression2);
-                        printf("\n");
-                    }
-                    // 根据运算符计算
-                    Expression *expressionResult = NULL;
-                    switch (operator.symbol) {
-                        case '+':
-                            expressionResult = expressionAdd(&expression1, &expression2, error);
-                            break;
-                        case '-':
-                            expressionResult = expressionSubtract(&expression1, &expression2, error);
-                            break;
-                        case '*':
-                            expressionResult = expressionMultiply(&expression1, &expression2, error);
-                            break;
-                        case '/':
-                            expressionResult = expressionDivide(&expression1, &expression2, error);
-                            break;
-                        case '%':
-                            expressionResult = expressionMod(&expression1, &expression2, error);
-                            break;
-                        case '^':
-                            expressionResult = expressionPower(&expression1, &expression2, error);
-                            break;
-                        default:
-                            strcpy(error, "unknown operator");
-                            break;
-                    }
-                    free(expression1.factorValue);
-                    free(expression2.factorValue);
-                    // 如果计算出错，则返回NULL
-                    if (expressionResult == NULL) {
-                        return NULL;
-                    }
-                    // 计算结果入栈
-                    expressionStack[numExpressions] = *expressionCopy(expressionResult);
-                    numExpressions++;
-                    // log：输出表达式
-                    if (debug == 1) {
-                        printf("Stack an expression:");
-                        expressionPrint(&expressionStack[numExpressions - 1]);
-                        printf("\n");
-                    }
-                    freeExpression(expressionResult); // FIXME
-                }
-                // 然后操作符入栈
-                operatorStack[numOperators].symbol = (char) elements[i].value;
-                operatorStack[numOperators].priority = currentPriority + currentPlusPriority;
-                numOperators++;
-                // log：输出操作符
-                if (debug == 1) {
-                    printf("Stack an operator:");
-                    operatorPrint(&operatorStack[numOperators - 1]);
-                    printf("\n");
-                }
-                break;
-            default:
-                // 不可能到达此分支，报错
-                strcpy(error, "unknown element type");
-                return NULL;
-        }
-    }
-    // 遍历完元素数组后，如果操作符栈不为空，则弹出栈顶运算符并计算直到栈为空
-    while (numOperators > 0) {
-        // 弹出栈顶运算符
-        Operator operator = operatorStack[numOperators - 1];
-        numOperators--;
-        // log：输出操作符
-        if (debug == 1) {
-            printf("Pop an operator:");
-            operatorPrint(&operator);
-            printf("\n");
-        }
-        // 弹出两个表达式
-        if (numExpressions < 2) {
-            strcpy(error, "expression stack is empty");
-            return NULL;
-        }
-        Expression expression2 = expressionStack[numExpressions - 1];
-        numExpressions--;
-        Expression expression1 = expressionStack[numExpressions - 1];
-        numExpressions--;
-        // log：输出表达式
-        if (debug == 1) {
-            printf("Pop two expressions:");
-            expressionPrint(&expression1);
-            printf("\t");
-            expressionPrint(&expression2);
-            printf("\n");
-        }
-        // 根据运算符计算
-        Expression *expressionResult = NULL;
-        switch (operator.symbol) {
-            case '+':
-                expressionResult = expressionAdd(&expression1, &expression2, error);
-                break;
-            case '-':
-                expressionResult = expressionSubtract(&expression1, &expression2, error);
-                break;
-            case '*':
-                expressionResult = expressionMultiply(&expression1, &expression2, error);
-                break;
-            case '/':
-                expressionResult = expressionDivide(&expression1, &expression2, error);
-                break;
-            case '%':
-                expressionResult = expressionMod(&expression1, &expression2, error);
-                break;
-            case '^':
-                expressionResult = expressionPower(&expression1, &expression2, error);
-                break;
-            default:
-                strcpy(error, "unknown operator");
-                break;
-        }
-        free(expression1.factorValue);
-        free(expression2.factorValue);
-        // 如果计算出错，则返回NULL
-        if (expressionResult == NULL) {
-            return NULL;
-        }
-        // 计算结果入栈
-        expressionStack[numExpressions] = *expressionCopy(expressionResult);
-        numExpressions++;
-        // log：输出表达式
-        if (debug == 1) {
-            printf("Stack an expression:");
-            expressionPrint(&expressionStack[numExpressions - 1]);
-            printf("\n");
-        }
-        freeExpression(expressionResult); // FIXME
-    }
-    // 如果操作数栈不为空，则返回栈顶表达式
-    if (numExpressions == 1) {
-        Expression *expressionResult = expressionCopy(&expressionStack[numExpressions - 1]);
-        // 简化结果
-        expressionResult = expressionSimplify(expressionResult);
-//        // 循环释放内存
-//        for (int i = 0; i < numExpressions; i++) {
-//            freeExpression(&expressionStack[i]);
-//        }
-        free(expressionStack);
-        free(operatorStack);
-        return expressionResult;
-    }
-    // 如果操作数栈为空，则返回NULL
-    strcpy(error, "expression stack count is wrong");
-    return NULL;
-}
-
-// 表达式求值，表达式未知数代入后的值(令x=x_0)
-long double expressionEvaluate(const Expression *expression, const long double variableValue) {
-    long double result = 0;
-    long double variableValuePower = 1; // 记录未知数的幂次值
-    for (int i = 0; i <= expression->powerCount; i++) {
-        result += expression->factorValue[i] * variableValuePower;
-        variableValuePower *= variableValue;
-    }
-    return result;
-}
-
-// 表达式求导，a_(n-1)'=a_n*n
-Expression *expressionDerivative(const Expression *expression) {
-    // 求导
-    // 新建表达式，逐项求导
-    Expression *expressionDerivative = expressionNew(expression->powerCount - 1);
-    for (int i = 0; i <= expressionDerivative->powerCount; i++) {
-        expressionDerivative->factorValue[i] = expression->factorValue[i + 1] * (i + 1);
-    }
-    // 简化结果
-    expressionDerivative = expressionSimplify(expressionDerivative);
-    return expressionDerivative;
-}
-
-// 二分求根：根据左右端点和表达式进行二分求根，需确保左右端点代入表达式后的值异号
-/*
-数值 二分求根(表达式, 左端点, 右端点){
-    if(左端点和右端点的差值小于阈值){
-        return (左端点+右端点)/2
-    }
-    中点 = (左端点+右端点)/2
-    if(表达式在中点的值为0){
-        return 中点
-    }
-    if(表达式在中点的值和左端点的值异号){
-        return 二分求根函数(表达式, 左端点, 中点)
-    }
-    if(表达式在中点的值和右端点的值异号){
-        return 二分求根函数(表达式, 中点, 右端点)
-    }
-    return 错误
-}
-*/
-long double expressionBinarySearchRoot(const Expression *expression, const long double left, const long double right) {
-    // 二分求根
-    // 如果左右端点的表达式值相等，则返回0/0
-    if (expressionEvaluate(expression, left) == expressionEvaluate(expression, right)) {
-        return 0 / 0;
-    }
-    // 如果左右端点的表达式值同号，则返回0/0
-    if (expressionEvaluate(expression, left) * expressionEvaluate(expression, right) > 0) {
-        return 0 / 0;
-    }
-    // 如果左右端点的差值小于阈值，则返回中点
-    if (lfabs(right - left) < BINARY_SEARCH_ROOT_THRESHOLD) {
-        return (left + right) / 2;
-    }
-    // 计算中点
-    long double middle = (left + right) / 2;
-    // 如果表达式在中点的值为0，则返回中点
-    if (lfabs(expressionEvaluate(expression, middle)) < BINARY_SEARCH_ROOT_THRESHOLD) {
-        return middle;
-    }
-    // 如果表达式在中点的值和左端点的值异号，则返回二分求根函数(表达式, 左端点, 中点)
-    if (expressionEvaluate(expression, middle) * expressionEvaluate(expression, left) < 0) {
-        return expressionBinarySearchRoot(expression, left, middle);
-    }
-    // 如果表达式在中点的值和右端点的值异号，则返回二分求根函数(表达式, 中点, 右端点)
-    if (expressionEvaluate(expression, middle) * expressionEvaluate(expression, right) < 0) {
-        return expressionBinarySearchRoot(expression, middle, right);
-    }
-    // 不可能到达此分支，返回0/0
-    return 0 / 0;
-}
-
-// 表达式求根：先求导数，然后求极值点，方程的根一定在 x最小值∪极值点∪x最大值 这个列表的相邻点之间，逐段二分即可得到所有根
-/*
-数值列表 表达式求根(表达式){
-    if(表达式.阶数==1){
-        return 新列表(-表达式.常数项/表达式.一次项)
-    }
-    导数表达式 = 表达式求导(表达式)
-    导数零点列表 = 表达式求根(导数表达式)
-    新建 结果列表(导数表达式的根的列表的长度)
-    for i in (x最小值∪导数零点列表∪x最大值).index {
-        if(表达式求值(表达式, 导数零点列表[i]) == 0){
-            结果列表.push(导数零点列表[i])
-            continue
-        }
-        if(i-1>=0 && 表达式求值(导数表达式, 导数零点列表[i])*表达式求值(导数表达式, 导数零点列表[i-1])<0){
-            结果列表.push(二分求根函数(表达式, 导数零点列表[i], 导数零点列表[i-1]))
-        }
-    }
-    return 结果列表
-}
-*/
-long double *expressionFindRoot(const Expression *expression, int *numRoots) {
-    // 求根
-    // 如果表达式阶数为0，则返回空列表
-    if (expression->powerCount == 0) {
-        *numRoots = 0;
-        return NULL;
-    }
-    // 如果表达式阶数为1，则返回列表(-表达式.常数项/表达式.一次项)
-    if (expression->powerCount == 1) {
-        *numRoots = 1;
-        long double *roots = (long double *) malloc(sizeof(long double));
-        roots[0] = -expression->factorValue[0] / expression->factorValue[1];
-        return roots;
-    }
-    // 求导数表达式
-    Expression *derivativeExpression = expressionDerivative(expression);
-    // 求导数表达式的根
-    long double *derivativeRoots = expressionFindRoot(derivativeExpression, numRoots);
-    // 新建结果列表
-    long double *roots = (long double *) malloc((*numRoots + 1) * sizeof(long double));
-    int numRootsNew = 0;
-    // 二分最值的左端点和右端点也应该判断
-    // 二分最值的左端点和第一个导数根判断
-    if (expressionEvaluate(expression, BINARY_SEARCH_ROOT_MIN) * expressionEvaluate(expression, derivativeRoots[0]) <
-        0) {
-        roots[numRootsNew] = expressionBinarySearchRoot(expression, BINARY_SEARCH_ROOT_MIN, derivativeRoots[0]);
-        numRootsNew++;
-    }
-    // 遍历导数表达式的根
-    for (int i = 0; i < *numRoots; i++) {
-        // 如果表达式在导数表达式的根的值为0，则将导数表达式的根加入结果列表
-        if (lfabs(expressionEvaluate(expression, derivativeRoots[i])) < BINARY_SEARCH_ROOT_THRESHOLD) {
-            roots[numRootsNew] = derivativeRoots[i];
-            numRootsNew++;
-            continue;
-        }
-        // 如果表达式在导数表达式的根和导数表达式的根的前一个值异号，则将二分求根函数(表达式, 导数表达式的根, 导数表达式的根的前一个值)加入结果列表
-        if (i - 1 >= 0 &&
-            expressionEvaluate(expression, derivativeRoots[i]) *
-            expressionEvaluate(expression, derivativeRoots[i - 1]) < BINARY_SEARCH_ROOT_THRESHOLD) {
-            roots[numRootsNew] = expressionBinarySearchRoot(expression, derivativeRoots[i], derivativeRoots[i - 1]);
-            numRootsNew++;
-        }
-    }
-    // 二分最值的右端点和最后一个导数根判断
-    if (expressionEvaluate(expression, BINARY_SEARCH_ROOT_MAX) *
-        expressionEvaluate(expression, derivativeRoots[*numRoots - 1]) < 0) {
-        roots[numRootsNew] = expressionBinarySearchRoot(expression, derivativeRoots[*numRoots - 1],
-                                                        BINARY_SEARCH_ROOT_MAX);
-        numRootsNew++;
-    }
-    // 合并相同的根(差值小于阈值的根合并)
-    int deletedRootNum = 0; // 记录删除的根的个数，也是下次判断的跨度
-    for (int i = 0; i < numRootsNew - deletedRootNum; i++) {
-        roots[i] = roots[i + deletedRootNum];
-        while (i + 1 + deletedRootNum < numRootsNew &&
-               lfabs(roots[i] - roots[i + 1 + deletedRootNum]) < BINARY_SEARCH_ROOT_THRESHOLD) {
-            deletedRootNum++;
-        }
-    }
-    numRootsNew -= deletedRootNum;
-    for (int i = 0; i < numRootsNew; i++) {
-        if (lfabs(roots[i]) < BINARY_SEARCH_ROOT_THRESHOLD) roots[i] = 0;
-    }
-    // log：输出根
-    if (debug == 1) {
-        printf("Roots:");
-        for (int i = 0; i < numRootsNew; i++) {
-            printf("%Lf  ", roots[i]);
-        }
-    }
-    // 释放导数表达式的根内存
-    free(derivativeRoots);
-    // 返回结果列表
-    *numRoots = numRootsNew;
-    return roots;
-}
-
-// 最终的计算表达式的函数(字符串->元素列表->最终表达式->求根/求值)
-int calculate_expression(const char *expression, char *result_msg) {
-    // 解析字符串->元素(符号/字母/数字)
-    char *error = (char *) malloc(strlen(expression) * sizeof(char));
-    int numElements;
-    Element *elements = parseString(expression, &numElements, error);
-    // 判断元素数组的正确性
-    if (elements == NULL) {
-        sprintf(result_msg, "Error:\tsymbol %s was not define", error);
-        return 0;
-    }
-    if (numElements == 0) {
-        sprintf(result_msg, "Error:\tmissing expression");
-        return 0;
-    }
-    // 判断元素数组的正确性
-    if (!checkElements(elements, numElements, error)) {
-        sprintf(result_msg, "Error: \t%s\n", error);
-        return 0;
-    }
-
-    // 判断元素列表为计算式还是未知数方程并处理
-    int isEquation = (findEquals(elements, numElements) != -1);
-    if (isEquation) {
-        // 为等式，进行转换，将等式转换为表达式的元素列表
-        int numElementsTransformed;
-        Element *elementsTransformed = transformEquals(elements, numElements, &numElementsTransformed);
-        freeElements(elements);
-        elements = elementsTransformed;
-        numElements = numElementsTransformed;
-    } else {
-        // 为计算式，检查所有元素中不能出现未知数
-        for (int i = 0; i < numElements; i++) {
-            if (elements[i].type == VARIABLE) { // 报错，只有等式中才能出现未知数，计算式不行
-                sprintf(result_msg, "Error:\tOnly variables can appear in equations, not in calculations");
-                return 0;
-            }
-        }
-    }
-    if (debug) {
-        // 输出看看结果
-        printf("Parsed Elements:\t");
-        for (int i = 0; i < numElements; i++) {
-            elementPrint(&elements[i]);
-        }
-        printf("\n");
-    }
-
-    // 正式开始计算表达式(使用expressionCalculate函数，将元素列表转为整个多项式)
-    Expression *expressionResult = expressionCalculate(elements, numElements, error);
-    if (expressionResult == NULL) {
-        sprintf(result_msg, "Error: \t%s\n", error);
-        return 0;
-    }
-    if (debug) {
-        // 输出结果
-        printf("Final expression:\t");
-        expressionPrint(expressionResult);
-        printf("\n");
-    }
-    // 特判：如果超过255次幂，报错
-    if (expressionResult->powerCount >= MAX_POWER_COUNT) {
-        sprintf(result_msg, "Error:\tpower count is too large(>=%d)\n", MAX_POWER_COUNT);
-        return 0;
-    }
-
-    // 求值/求根，然后输出
-    if (!isEquation) {
-        // 求值，已经求完，直接输出结果
-        sprintf(result_msg, "Result:\t%Lf\n", expressionResult->factorValue[0]);
-    } else {
-        // 求根，递归的值二分法进行计算
-        int numRoots;
-        long double *roots = expressionFindRoot(expressionResult, &numRoots);
-        // 输出结果
-        if (numRoots == 0) { // 无解
-            sprintf(result_msg, "Roots:\tNo roots\n");
-        } else { // 循环输出解
-            sprintf(result_msg, "Roots:\t");
-            int result_len = (int) strlen(result_msg);
-            char result_tmp[32];
-            for (int i = 0; i < numRoots; i++) {
-                sprintf(result_tmp, "%Lf ", roots[i]);
-                strcpy(result_msg + result_len, result_tmp);
-                result_len += (int) strlen(result_tmp);
-            }
-            sprintf(result_msg + result_len, "\n");
-        }
-    }
-    // 释放内存
-    freeExpression(expressionResult);
-    freeElements(elements);
-
-    return 1;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <time.h>
+#include "msg_mycs.h" // 错误码(MsgErrorCode)和错误信息
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+// 参数设置
+// 次幂数不小于该值、且非零项不超过(次幂数+1)/SPARSE_DENSITY_RATIO的多项式使用稀疏表示
+const int SPARSE_MIN_POWER_COUNT = 64;
+const int SPARSE_DENSITY_RATIO = 4;
+// 求根的阈值：极值点处的值小于该值时视为根，差值小于该值的根合并，绝对值小于该值的根视为0
+const long double ROOT_THRESHOLD = 1e-6;
+// 安全牛顿法求根的最大迭代次数和收敛的相对误差
+const int ROOT_REFINE_MAX_ITERATIONS = 200;
+const long double ROOT_REFINE_TOLERANCE = 1e-15;
+// 求根界时最多的倍增次数(long double的最大指数)
+const int ROOT_BOUND_MAX_DOUBLINGS = 16384;
+// 求根区间的最大范围，根界超过它时只在 [-ROOT_BOUND_MAX, ROOT_BOUND_MAX] 内求根(同时保证每个根的输出长度有限)
+const long double ROOT_BOUND_MAX = 1e9;
+// 多项式乘法使用Karatsuba算法的最小项数(较短的多项式项数达到该值时使用，否则使用逐项相乘)
+const int KARATSUBA_THRESHOLD = 32;
+// 多项式乘法使用Karatsuba算法时，两个多项式非零系数绝对值的最大/最小比值的上限(超过时中间项相减会损失过多精度)
+const long double KARATSUBA_MAX_DYNAMIC_RANGE = 1e4;
+// 错误码参数的最大长度(出错的符号过长时截断)
+#define MAX_ERROR_LENGTH 128
+// 不带结果长度参数的函数(calculate_expression等)假定的结果缓冲区大小，与消息的最大长度相同
+#define CALC_RESULT_LENGTH 1024
+// 求值表请求最多的点数
+#define MAX_TABLE_POINTS 65536
+// 纯数值计算(不含未知数的计算式)使用的栈上数值栈和操作符栈的大小，括号嵌套过深超出时退回多项式计算
+#define SCALAR_STACK_SIZE 64
+// 调试输出的编译开关：定义NDEBUG或CALC_DEBUG_TRACE为0时去掉全部调试输出的代码(配置中的debug不再起作用)
+#ifndef CALC_DEBUG_TRACE
+#ifdef NDEBUG
+#define CALC_DEBUG_TRACE 0
+#else
+#define CALC_DEBUG_TRACE 1
+#endif
+#endif
+// 计算精度：long double(默认)、double、精确的有理数(计算式输出整数或分数，等式精确展开并去掉重根后再求根)
+typedef enum {
+    PRECISION_LONG_DOUBLE,
+    PRECISION_DOUBLE,
+    PRECISION_EXACT
+} Precision;
+
+// 计算的配置，每个计算上下文(CalcContext)各有一份
+typedef struct {
+    Precision precision; // 计算精度
+    int maxPowerCount; // 最大支持的次幂数(稠密表示的多项式)
+    int maxSparsePowerCount; // 最大支持的次幂数(稀疏表示的多项式，如x^1000-1)
+    int debug; // 是否输出调试信息
+    int useArena; // 是否使用内存池进行每次请求的内存分配
+} CalcConfig;
+
+// 默认配置：新建的计算上下文和不带上下文的函数(calculate_expression等)使用，可由服务端的-p/-s/-P参数修改
+// 只应在开始计算之前(如启动工作者之前)修改
+CalcConfig calcDefaultConfig = {PRECISION_LONG_DOUBLE, 255, 4096, 0, 1};
+// 当前线程正在进行的计算使用的配置，由calculate_expression_r等入口函数设置
+_Thread_local const CalcConfig *currentConfig = NULL;
+
+// 当前线程的计算配置(不在计算中时为默认配置)
+const CalcConfig *calcConfig() {
+    return currentConfig != NULL ? currentConfig : &calcDefaultConfig;
+}
+
+#define debugTrace() (CALC_DEBUG_TRACE && calcConfig()->debug)
+
+// 下面为计算各阶段计时相关的结构体和函数
+// 调用者为当前线程设置计时记录(calculationStatsBegin)后，计算过程会把各阶段的耗时累加到其中；没有设置时不计时
+typedef enum {
+    CALCULATION_STAGE_PARSE, // 解析和检查
+    CALCULATION_STAGE_CALCULATE, // 求值或展开多项式
+    CALCULATION_STAGE_FIND_ROOT, // 求根
+    CALCULATION_STAGE_FORMAT, // 输出结果
+    NUM_CALCULATION_STAGES
+} CalculationStage;
+
+// 一次计算的计时记录
+typedef struct {
+    long long stageNanoseconds[NUM_CALCULATION_STAGES]; // 各阶段的耗时
+    int powerCount; // 最终多项式的次幂数，没有展开多项式(纯数值计算或出错)时为-1
+    long numAllocations; // calcMalloc的调用次数
+    long long lastMark; // 上一次标记的时间
+} CalculationStats;
+
+// 当前线程的计时记录
+_Thread_local CalculationStats *currentCalculationStats = NULL;
+
+// 单调时钟的当前时间(纳秒)
+long long monotonicNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// 开始计时，之后当前线程的计算都记入stats
+void calculationStatsBegin(CalculationStats *stats) {
+    memset(stats, 0, sizeof(CalculationStats));
+    stats->powerCount = -1;
+    stats->lastMark = monotonicNanoseconds();
+    currentCalculationStats = stats;
+}
+
+// 结束计时
+void calculationStatsEnd() {
+    currentCalculationStats = NULL;
+}
+
+// 标记一个阶段结束：从上一次标记到现在的耗时记入该阶段
+void calculationStageMark(const CalculationStage stage) {
+    CalculationStats *stats = currentCalculationStats;
+    if (stats == NULL) {
+        return;
+    }
+    long long now = monotonicNanoseconds();
+    stats->stageNanoseconds[stage] += now - stats->lastMark;
+    stats->lastMark = now;
+}
+
+// 记录最终多项式的次幂数
+void calculationStatsSetPowerCount(const int powerCount) {
+    if (currentCalculationStats != NULL) {
+        currentCalculationStats->powerCount = powerCount;
+    }
+}
+
+
+// 下面为错误相关的结构体和函数
+// 计算出错时只记录错误码(msg_mycs.h中的MsgErrorCode)和参数，错误信息的文本在输出时按错误码给出，
+// 调用者(如服务端的二进制回复)可以直接使用错误码，不必从文本中识别
+typedef struct {
+    MsgErrorCode code;
+    char argument[MAX_ERROR_LENGTH]; // 错误码的参数(未定义的符号、次幂上限等，过长时截断)，没有参数时为空字符串
+} CalcError;
+
+// 记录错误码和参数，argument为NULL表示没有参数
+void calcErrorSet(CalcError *error, const MsgErrorCode code, const char *argument) {
+    error->code = code;
+    snprintf(error->argument, MAX_ERROR_LENGTH, "%s", argument != NULL ? argument : "");
+}
+
+// 记录错误码和整数参数(次幂上限、点数上限)
+void calcErrorSetNumber(CalcError *error, const MsgErrorCode code, const int argument) {
+    error->code = code;
+    snprintf(error->argument, MAX_ERROR_LENGTH, "%d", argument);
+}
+
+// 输出错误信息：format中的%s替换为按错误码给出的错误信息(各处沿用原来的格式，如 "Error: \t%s\n")，写入result_msg
+void formatError(const char *format, const CalcError *error, char *result_msg, const size_t resultSize) {
+    char message[2 * MAX_ERROR_LENGTH];
+    msgErrorFormat(error->code, error->argument, message, sizeof(message));
+    snprintf(result_msg, resultSize, format, message);
+}
+
+
+// 下面为计算期限相关的变量和函数
+// 计算上下文设置了期限时，展开多项式的每一步和求根的每个区间之前检查是否已超过期限，超过则放弃计算并报告超时
+// 当前线程正在进行的计算的期限(单调时钟，纳秒)，0表示不限
+_Thread_local long long currentDeadline = 0;
+// 当前计算是否已超过期限(一旦超过，之后的检查不再读时钟)
+_Thread_local int currentDeadlineExceeded = 0;
+
+// 当前计算是否已超过期限
+int calcDeadlineExceeded() {
+    if (currentDeadlineExceeded) {
+        return 1;
+    }
+    if (currentDeadline != 0 && monotonicNanoseconds() >= currentDeadline) {
+        currentDeadlineExceeded = 1;
+    }
+    return currentDeadlineExceeded;
+}
+
+
+// 下面为结果流相关的结构体和变量
+// 设置了结果流时，求根过程中每确定一个根(与最终合并后的结果相同，按从小到大的顺序)就立即交给回调，不必等所有根求完；
+// 计算式的数值结果直接放入结果流。结果已交给结果流时不再格式化为文本
+typedef struct {
+    void (*onRoot)(void *arg, long double root); // 输出一个根
+    void *arg;
+    int numRoots; // 已输出的根数，-1表示这次计算没有求根(计算式或求根前出错)
+    int hasValue; // 是否求出了计算式的数值结果(精确模式的有理数结果仍为文本)
+    long double value; // 计算式的数值结果
+} CalcResultStream;
+
+// 当前线程正在进行的计算的结果流，NULL表示不使用
+_Thread_local CalcResultStream *currentResultStream = NULL;
+
+
+// 下面为内存池(arena)相关的结构体和函数
+// 一次计算请求中的元素数组、表达式和根列表都从当前线程的内存池中顺序分配，释放函数不做任何事，请求结束后整体重置
+// 没有设置内存池时(currentArena为NULL)退回到malloc/free
+// 大小随输入变化的数组(元素、各种执行栈)一律从这里分配，不用变长数组：表达式长度和括号嵌套没有上限，线程栈装不下
+// 内存池块的对齐字节数(满足long double的对齐要求)
+#define ARENA_ALIGNMENT 16
+// 内存池第一个块的默认大小
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+// 内存池块，数据区紧跟在结构体后面
+typedef struct ArenaChunk {
+    struct ArenaChunk *next; // 上一个(更早分配的)块
+    size_t size; // 数据区大小
+    size_t used; // 数据区已使用的大小
+    _Alignas(ARENA_ALIGNMENT) unsigned char data[];
+} ArenaChunk;
+
+// 内存池
+typedef struct {
+    ArenaChunk *chunks; // 当前块(链表头)
+    size_t totalSize; // 所有块的数据区大小之和
+    size_t numAllocations; // 自上次重置以来的分配次数
+} Arena;
+
+// 当前线程正在使用的内存池
+_Thread_local Arena *currentArena = NULL;
+
+// 新建一个内存池块
+ArenaChunk *arenaChunkNew(size_t size, ArenaChunk *next) {
+    ArenaChunk *chunk = (ArenaChunk *) malloc(sizeof(ArenaChunk) + size);
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+// 从内存池中分配内存，当前块不够时新建一个至少为总大小两倍的块
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    ArenaChunk *chunk = arena->chunks;
+    if (chunk == NULL || chunk->used + size > chunk->size) {
+        size_t chunkSize = arena->totalSize * 2 > ARENA_DEFAULT_CHUNK_SIZE ? arena->totalSize * 2 : ARENA_DEFAULT_CHUNK_SIZE;
+        if (chunkSize < size) {
+            chunkSize = size;
+        }
+        chunk = arenaChunkNew(chunkSize, arena->chunks);
+        arena->chunks = chunk;
+        arena->totalSize += chunkSize;
+    }
+    void *pointer = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->numAllocations++;
+    return pointer;
+}
+
+// 释放内存池的所有块
+void arenaDestroy(Arena *arena) {
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->totalSize = 0;
+    arena->numAllocations = 0;
+}
+
+// 重置内存池，一次性释放所有分配；如果这次用了多个块，则合并为一个足够大的块，下次请求无需再扩容
+void arenaReset(Arena *arena) {
+    if (arena->chunks != NULL && arena->chunks->next != NULL) {
+        size_t totalSize = arena->totalSize;
+        arenaDestroy(arena);
+        arena->chunks = arenaChunkNew(totalSize, NULL);
+        arena->totalSize = totalSize;
+    }
+    if (arena->chunks != NULL) {
+        arena->chunks->used = 0;
+    }
+    arena->numAllocations = 0;
+}
+
+// 计算过程使用的分配函数：有内存池时从内存池分配，否则使用malloc
+void *calcMalloc(size_t size) {
+    if (currentCalculationStats != NULL) {
+        currentCalculationStats->numAllocations++;
+    }
+    if (currentArena != NULL) {
+        return arenaAlloc(currentArena, size);
+    }
+    return malloc(size);
+}
+
+// 计算过程使用的释放函数：有内存池时不做任何事(请求结束后整体重置)，否则使用free
+void calcFree(void *pointer) {
+    if (currentArena == NULL) {
+        free(pointer);
+    }
+}
+
+// 下面为计算上下文相关的结构体和函数
+// 计算上下文：配置、内存池和上一次计算的错误码；各线程使用各自的上下文即可并发计算，互不共享可变状态
+typedef struct {
+    CalcConfig config;
+    Arena arena;
+    CalcError error; // 上一次计算出错时的错误码和参数
+    long long deadline; // 下一次计算的期限(单调时钟，纳秒)，0表示不限，由调用者在每次计算前设置
+    int timedOut; // 上一次计算是否因超过期限而中止
+    struct CalcPrepared *prepared; // calculate_estimate_r预先解析、编译的请求(一整块malloc的内存)，NULL表示没有
+} CalcContext;
+
+// 进入计算前当前线程的配置和内存池，离开时恢复
+typedef struct {
+    const CalcConfig *config;
+    Arena *arena;
+    long long deadline;
+    int deadlineExceeded;
+} CalcContextSaved;
+
+// 初始化计算上下文，config为NULL时使用默认配置
+void calcContextInit(CalcContext *context, const CalcConfig *config) {
+    memset(context, 0, sizeof(CalcContext));
+    context->config = config != NULL ? *config : calcDefaultConfig;
+}
+
+// 释放计算上下文的内存池和预先解析的请求
+void calcContextDestroy(CalcContext *context) {
+    arenaDestroy(&context->arena);
+    free(context->prepared);
+    context->prepared = NULL;
+}
+
+// 开始用该上下文计算：当前线程的配置和内存池指向该上下文
+void calcContextEnter(CalcContext *context, CalcContextSaved *saved) {
+    saved->config = currentConfig;
+    saved->arena = currentArena;
+    saved->deadline = currentDeadline;
+    saved->deadlineExceeded = currentDeadlineExceeded;
+    currentConfig = &context->config;
+    currentArena = context->config.useArena ? &context->arena : NULL;
+    currentDeadline = context->deadline;
+    currentDeadlineExceeded = 0;
+}
+
+// 结束计算：记录是否超时，一次性重置内存池，恢复之前的配置、内存池和期限
+void calcContextLeave(CalcContext *context, const CalcContextSaved *saved) {
+    context->timedOut = currentDeadlineExceeded;
+    if (context->config.useArena) {
+        arenaReset(&context->arena);
+    }
+    currentConfig = saved->config;
+    currentArena = saved->arena;
+    currentDeadline = saved->deadline;
+    currentDeadlineExceeded = saved->deadlineExceeded;
+}
+
+// long double的绝对值函数
+long double lfabs(long double x) {
+    if (x < 0) {
+        return -x;
+    }
+    return x;
+}
+
+// long double的非负整数次幂(快速幂)
+long double lpowi(long double x, int n) {
+    long double result = 1;
+    while (n > 0) {
+        if (n & 1) {
+            result *= x;
+        }
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+// 按计算精度舍入：双精度模式下每一步的结果都舍入到double
+long double precisionRound(const long double value, const Precision precision) {
+    return precision == PRECISION_DOUBLE ? (long double) (double) value : value;
+}
+
+
+// 下面为元素相关的结构体和函数(元素代表字符串解析后的每个值，可以是常量/变量/操作符/等号)
+// 定义元素类型枚举
+typedef enum {
+    NUMBER,     // 数字
+    OPERATOR,   // 操作符
+    VARIABLE,   // 未知数x
+    EQUALS     // 等号
+} ElementType;
+
+// 定义元素结构体(元素代表字符串解析后的每个值，可以是常量/变量/操作符/等号)
+typedef struct {
+    ElementType type;
+    long double value;
+    const char *text; // 数字在输入中的原文(精确模式由原文得到精确的有理数)，其他元素不使用
+    int length; // 原文的长度
+} Element;
+
+// 释放元素数组内存
+void freeElements(Element *elements) {
+    calcFree(elements);
+}
+
+// 输出元素用于debug的工具函数
+void elementPrint(const Element *element) {
+    switch (element->type) {
+        case NUMBER:
+            printf("%Lf ", element->value);
+            break;
+        case OPERATOR:
+        case VARIABLE:
+        case EQUALS:
+            printf("%c ", (char) element->value);
+            break;
+    }
+}
+
+// 判断字符是否为数字
+int isNumeric(const char ch) {
+    return (ch >= '0' && ch <= '9') || ch == '.';
+}
+
+
+// 下面为数字解析相关的结构体和函数
+// 数字直接在输入上扫描，不复制；结果按目标精度(双精度模式为double，其余为long double)正确舍入(就近，一样近时取偶数)
+// 十进制数字：有效数字不超过目标精度且10的幂次可以精确表示时，一次乘除即为正确舍入的结果(Clinger的快速路径)；
+// 否则先用long double求出近似值，再用大整数精确比较数字与相邻两个可表示值的中点，逐步调整到正确舍入的结果
+// 十六进制浮点数(如0x1.8p3)本身就是二进制，直接按位舍入
+#define NUMBER_MAX_DIGITS 19 // 近似值使用的有效数字位数(不超过unsigned long long的范围)
+#define NUMBER_MAX_EXPONENT 100000 // 指数部分的绝对值的上限(超过时结果一定为0或无穷大)
+
+// 目标浮点格式：可表示的值为 m*2^e，m为不超过digits位的非负整数，minExponent <= e <= maxExponent
+typedef struct {
+    int digits; // 有效位数
+    int minExponent; // 最低位的最小指数(非规格化数)
+    int maxExponent; // 最低位的最大指数
+    int maxExactPower; // 能精确表示的10的最高次幂(5^k < 2^digits)
+} NumberFormat;
+
+const NumberFormat numberFormatDouble = {DBL_MANT_DIG, DBL_MIN_EXP - DBL_MANT_DIG, DBL_MAX_EXP - DBL_MANT_DIG, 22};
+const NumberFormat numberFormatLongDouble = {LDBL_MANT_DIG, LDBL_MIN_EXP - LDBL_MANT_DIG, LDBL_MAX_EXP - LDBL_MANT_DIG,
+                                             27};
+
+// 能精确表示的10的幂次
+const long double numberExactPowers[] = {1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L};
+// 10^(2^k)，用于求10的任意次幂的近似值
+const long double numberBinaryPowers[] = {1e1L, 1e2L, 1e4L, 1e8L, 1e16L, 1e32L, 1e64L, 1e128L, 1e256L, 1e512L, 1e1024L, 1e2048L, 1e4096L};
+
+// 大整数(只用于精确比较)：从低到高每段32位
+typedef struct {
+    unsigned int *limbs;
+    int size; // 使用的段数，最高段不为0(0的size为0)
+} BigNumber;
+
+void bigNumberSet(BigNumber *number, unsigned __int128 value) {
+    number->size = 0;
+    while (value > 0) {
+        number->limbs[number->size++] = (unsigned int) value;
+        value >>= 32;
+    }
+}
+
+void bigNumberCopy(BigNumber *number, const BigNumber *source) {
+    memcpy(number->limbs, source->limbs, source->size * sizeof(unsigned int));
+    number->size = source->size;
+}
+
+// number = number * factor + addend
+void bigNumberMultiplyAdd(BigNumber *number, const unsigned int factor, const unsigned int addend) {
+    unsigned long long carry = addend;
+    for (int i = 0; i < number->size; i++) {
+        carry += (unsigned long long) number->limbs[i] * factor;
+        number->limbs[i] = (unsigned int) carry;
+        carry >>= 32;
+    }
+    if (carry > 0) {
+        number->limbs[number->size++] = (unsigned int) carry;
+    }
+}
+
+// number *= 5^power
+void bigNumberMultiplyPowerOfFive(BigNumber *number, int power) {
+    // 5^13为32位能放下的最高次幂
+    for (; power >= 13; power -= 13) {
+        bigNumberMultiplyAdd(number, 1220703125u, 0);
+    }
+    unsigned int factor = 1;
+    for (; power > 0; power--) {
+        factor *= 5;
+    }
+    bigNumberMultiplyAdd(number, factor, 0);
+}
+
+// result = number * value(value至多3段)，result不能与number相同
+void bigNumberMultiply(BigNumber *result, const BigNumber *number, unsigned __int128 value) {
+    unsigned int factor[4];
+    int numFactors = 0;
+    for (; value > 0; value >>= 32) {
+        factor[numFactors++] = (unsigned int) value;
+    }
+    result->size = number->size + numFactors;
+    memset(result->limbs, 0, result->size * sizeof(unsigned int));
+    for (int j = 0; j < numFactors; j++) {
+        unsigned long long carry = 0;
+        for (int i = 0; i < number->size; i++) {
+            carry += (unsigned long long) number->limbs[i] * factor[j] + result->limbs[i + j];
+            result->limbs[i + j] = (unsigned int) carry;
+            carry >>= 32;
+        }
+        result->limbs[number->size + j] = (unsigned int) carry;
+    }
+    while (result->size > 0 && result->limbs[result->size - 1] == 0) {
+        result->size--;
+    }
+}
+
+// number <<= bits
+void bigNumberShiftLeft(BigNumber *number, const int bits) {
+    if (number->size == 0) {
+        return;
+    }
+    int limbShift = bits / 32;
+    int bitShift = bits % 32;
+    number->limbs[number->size + limbShift] = 0;
+    for (int i = number->size - 1; i >= 0; i--) {
+        unsigned long long shifted = (unsigned long long) number->limbs[i] << bitShift;
+        number->limbs[i + limbShift + 1] |= (unsigned int) (shifted >> 32);
+        number->limbs[i + limbShift] = (unsigned int) shifted;
+    }
+    memset(number->limbs, 0, limbShift * sizeof(unsigned int));
+    number->size += limbShift + 1;
+    while (number->limbs[number->size - 1] == 0) {
+        number->size--;
+    }
+}
+
+int bigNumberCompare(const BigNumber *a, const BigNumber *b) {
+    if (a->size != b->size) {
+        return a->size < b->size ? -1 : 1;
+    }
+    for (int i = a->size - 1; i >= 0; i--) {
+        if (a->limbs[i] != b->limbs[i]) {
+            return a->limbs[i] < b->limbs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// 10^power的近似值(0 <= power < 8192)，按二进制分解相乘，误差为几个最低位
+long double numberPowerOfTen(int power) {
+    long double result = 1;
+    for (int k = 0; power > 0; k++, power >>= 1) {
+        if (power & 1) {
+            result *= numberBinaryPowers[k];
+        }
+    }
+    return result;
+}
+
+// m*2^exponent(可以精确表示)：乘以2的幂次是精确的，中间结果都不小于最终结果，因此非规格化数也不会丢失精度
+long double numberScale(const unsigned __int128 m, int exponent) {
+    long double result = (long double) m;
+    for (; exponent >= 64; exponent -= 64) {
+        result *= 0x1p64L;
+    }
+    for (; exponent <= -64; exponent += 64) {
+        result *= 0x1p-64L;
+    }
+    return exponent >= 0 ? result * (long double) (1ULL << exponent) : result / (long double) (1ULL << -exponent);
+}
+
+// 无穷大(不依赖math.h)
+long double numberInfinity() {
+    return LDBL_MAX * 2;
+}
+
+// 把m*2^exponent的整数部分按format舍入：sticky表示m之后还有不为0的位，返回舍入后的值(溢出时为无穷大)
+long double numberRound(const unsigned __int128 m, const int sticky, const int exponent, const NumberFormat *format) {
+    if (m == 0) {
+        return 0;
+    }
+    int bits = 0;
+    for (unsigned __int128 rest = m; rest > 0; rest >>= 1) {
+        bits++;
+    }
+    // 结果最低位的指数：规格化时保留digits位，太小时为非规格化数，最低位的指数固定为minExponent
+    int resultExponent = exponent + bits - format->digits;
+    if (resultExponent < format->minExponent) {
+        resultExponent = format->minExponent;
+    }
+    int shift = resultExponent - exponent;
+    unsigned __int128 result;
+    if (shift <= 0) {
+        result = m << -shift;
+    } else if (shift > 128) {
+        result = 0; // 不到最低位的一半
+    } else {
+        // 舍去的部分与最低位的一半比较
+        unsigned __int128 half = (unsigned __int128) 1 << (shift - 1);
+        unsigned __int128 rest = shift == 128 ? m : m & ((half << 1) - 1);
+        result = shift == 128 ? 0 : m >> shift;
+        if (rest > half || (rest == half && (sticky || (result & 1)))) {
+            result++;
+        }
+    }
+    if (result == (unsigned __int128) 1 << format->digits) {
+        result >>= 1;
+        resultExponent++;
+    }
+    if (resultExponent > format->maxExponent) {
+        return numberInfinity();
+    }
+    return numberScale(result, resultExponent);
+}
+
+// 精确比较 D*10^power 与 h*2^exponent，返回-1、0、1：scaledDigits为D*5^power(power >= 0时)或D(power < 0时)，
+// powerOfFive为5^-power(power < 0时)或1；left、right为足够大的暂存区
+int numberCompare(const BigNumber *scaledDigits, const BigNumber *powerOfFive, const int power,
+                  const unsigned __int128 h, const int exponent, BigNumber *left, BigNumber *right) {
+    bigNumberCopy(left, scaledDigits);
+    bigNumberMultiply(right, powerOfFive, h);
+    if (power > exponent) {
+        bigNumberShiftLeft(left, power - exponent);
+    } else {
+        bigNumberShiftLeft(right, exponent - power);
+    }
+    return bigNumberCompare(left, right);
+}
+
+// 十进制数字的慢速路径：digits[0..length)为数字和至多一个小数点，数值为 D*10^power(D为全部数字组成的整数)，
+// approximation为近似值
+long double numberFromDecimalExact(const char *digits, const int length, const int power,
+                                   const long double approximation, const NumberFormat *format) {
+    const unsigned __int128 minMantissa = (unsigned __int128) 1 << (format->digits - 1);
+    const unsigned __int128 maxMantissa = ((unsigned __int128) 1 << format->digits) - 1;
+    // 近似值写成 m*2^e
+    unsigned __int128 m;
+    int e;
+    if (approximation > LDBL_MAX) {
+        m = maxMantissa;
+        e = format->maxExponent;
+    } else if (approximation == 0) {
+        m = 0;
+        e = format->minExponent;
+    } else {
+        long double normalized = approximation;
+        e = 0;
+        for (; normalized >= 0x1p64L; e += 64) {
+            normalized *= 0x1p-64L;
+        }
+        for (; normalized < 1; e -= 64) {
+            normalized *= 0x1p64L;
+        }
+        for (; normalized >= 2; e++) {
+            normalized /= 2;
+        }
+        // normalized在[1, 2)中，取前digits位
+        m = (unsigned __int128) (normalized * 0x1p63L) >> (64 - format->digits);
+        e -= format->digits - 1;
+        if (e < format->minExponent) {
+            m = format->minExponent - e >= 128 ? 0 : m >> (format->minExponent - e);
+            e = format->minExponent;
+        } else if (e > format->maxExponent) {
+            m = maxMantissa;
+            e = format->maxExponent;
+        }
+    }
+    // 暂存区的大小：D的位数 + 5的幂次的位数 + 两边指数之差 + h的位数
+    int absolutePower = power < 0 ? -power : power;
+    int maxLimbs = (length * 4 + absolutePower * 3 + absolutePower + (format->maxExponent - format->minExponent) +
+                    format->digits + 8) / 32 + 4;
+    unsigned int *buffer = (unsigned int *) calcMalloc(4 * maxLimbs * sizeof(unsigned int));
+    BigNumber scaledDigits = {buffer, 0};
+    BigNumber powerOfFive = {buffer + maxLimbs, 0};
+    BigNumber left = {buffer + 2 * maxLimbs, 0};
+    BigNumber right = {buffer + 3 * maxLimbs, 0};
+    for (int i = 0; i < length; i++) {
+        if (digits[i] != '.') {
+            bigNumberMultiplyAdd(&scaledDigits, 10, digits[i] - '0');
+        }
+    }
+    bigNumberSet(&powerOfFive, 1);
+    bigNumberMultiplyPowerOfFive(power >= 0 ? &scaledDigits : &powerOfFive, absolutePower);
+    // 与上方的中点 (2m+1)*2^(e-1) 和下方的中点比较，超出时向上或向下移动一个最低位，直到落在两个中点之间
+    for (;;) {
+        int above = numberCompare(&scaledDigits, &powerOfFive, power, 2 * m + 1, e - 1, &left, &right);
+        if (above > 0 || (above == 0 && (m & 1))) {
+            if (++m > maxMantissa) {
+                m = minMantissa;
+                e++;
+                if (e > format->maxExponent) {
+                    calcFree(buffer);
+                    return numberInfinity();
+                }
+            }
+            if (above == 0) {
+                break;
+            }
+            continue;
+        }
+        if (m == 0) {
+            break;
+        }
+        // 规格化数的最小尾数之下，相邻值的间隔减半
+        int below = m == minMantissa && e > format->minExponent
+                    ? numberCompare(&scaledDigits, &powerOfFive, power, 4 * m - 1, e - 2, &left, &right)
+                    : numberCompare(&scaledDigits, &powerOfFive, power, 2 * m - 1, e - 1, &left, &right);
+        if (below < 0 || (below == 0 && (m & 1))) {
+            if (--m < minMantissa && e > format->minExponent) {
+                m = maxMantissa;
+                e--;
+            }
+            if (below == 0) {
+                break;
+            }
+            continue;
+        }
+        break;
+    }
+    calcFree(buffer);
+    return numberScale(m, e);
+}
+
+// 十进制数字：digits[0..length)为数字和至多一个小数点，exponent为指数部分的值
+long double numberFromDecimal(const char *digits, const int length, const int exponent, const NumberFormat *format) {
+    // 前NUMBER_MAX_DIGITS位有效数字
+    unsigned long long mantissa = 0;
+    int numSignificant = 0;
+    int numDropped = 0; // 有效数字中没有计入mantissa的位数
+    int numFraction = 0; // 小数点后的位数
+    int pointOccurred = 0;
+    for (int i = 0; i < length; i++) {
+        if (digits[i] == '.') {
+            pointOccurred = 1;
+            continue;
+        }
+        numFraction += pointOccurred;
+        if (numSignificant == 0 && digits[i] == '0') {
+            continue;
+        }
+        if (++numSignificant <= NUMBER_MAX_DIGITS) {
+            mantissa = mantissa * 10 + (digits[i] - '0');
+        } else {
+            numDropped++;
+        }
+    }
+    if (mantissa == 0) {
+        return 0;
+    }
+    int power = exponent - numFraction;
+    // 快速路径：mantissa和10的幂次都能精确表示时，一次乘除的舍入即为正确舍入(双精度模式在double上计算)
+    if (numDropped == 0 && (format->digits >= 64 || mantissa < 1ULL << format->digits) &&
+        power >= -format->maxExactPower && power <= format->maxExactPower) {
+        if (format->digits == DBL_MANT_DIG) {
+            double value = (double) mantissa;
+            double scale = (double) numberExactPowers[power < 0 ? -power : power];
+            return power < 0 ? value / scale : value * scale;
+        }
+        long double scale = numberExactPowers[power < 0 ? -power : power];
+        return power < 0 ? (long double) mantissa / scale : (long double) mantissa * scale;
+    }
+    // 数值在[10^(magnitude-1), 10^magnitude)中，远超出范围时直接为无穷大或0
+    int magnitude = numSignificant + power;
+    if (magnitude > (format->maxExponent + format->digits) * 30103 / 100000 + 2) {
+        return numberInfinity();
+    }
+    if (magnitude < format->minExponent * 30103 / 100000 - 2) {
+        return 0;
+    }
+    // 近似值：mantissa*10^(power+numDropped)，分段乘除避免中间结果溢出
+    long double approximation = (long double) mantissa;
+    for (int rest = power + numDropped; rest != 0;) {
+        int step = rest > 4000 ? 4000 : rest < -4000 ? -4000 : rest;
+        approximation = step > 0 ? approximation * numberPowerOfTen(step) : approximation / numberPowerOfTen(-step);
+        rest -= step;
+    }
+    return numberFromDecimalExact(digits, length, power, approximation, format);
+}
+
+// 十六进制数字的值：返回'0'~'9'、'a'~'f'、'A'~'F'对应的值，不是十六进制数字时返回-1
+int hexDigitValue(const char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+// 指数部分：input指向'e'或'p'之后，为可带正负号的十进制整数时返回其长度(包括正负号)和值(绝对值过大时截断)，否则返回0
+int parseNumberExponent(const char *input, int *exponent) {
+    int i = input[0] == '+' || input[0] == '-' ? 1 : 0;
+    if (input[i] < '0' || input[i] > '9') {
+        return 0;
+    }
+    int value = 0;
+    for (; input[i] >= '0' && input[i] <= '9'; i++) {
+        if (value < NUMBER_MAX_EXPONENT) {
+            value = value * 10 + (input[i] - '0');
+        }
+    }
+    *exponent = input[0] == '-' ? -value : value;
+    return i;
+}
+
+// 十六进制浮点数：input指向"0x"之后的十六进制数字(可带一个小数点和以p开头的二进制指数)，返回长度
+int parseHexNumber(const char *input, const NumberFormat *format, long double *value) {
+    unsigned __int128 mantissa = 0;
+    int sticky = 0;
+    int exponent = 0;
+    int pointOccurred = 0;
+    int i = 0;
+    for (;; i++) {
+        if (input[i] == '.' && !pointOccurred) {
+            pointOccurred = 1;
+            continue;
+        }
+        int digit = hexDigitValue(input[i]);
+        if (digit < 0) {
+            break;
+        }
+        // 保留前120位，之后的数字只记录是否不为0
+        if (mantissa >> 116 == 0) {
+            mantissa = mantissa << 4 | digit;
+            exponent -= pointOccurred ? 4 : 0;
+        } else {
+            sticky |= digit != 0;
+            exponent += pointOccurred ? 0 : 4;
+        }
+    }
+    int binaryExponent = 0;
+    if (input[i] == 'p' || input[i] == 'P') {
+        int exponentLength = parseNumberExponent(&input[i + 1], &binaryExponent);
+        if (exponentLength > 0) {
+            i += 1 + exponentLength;
+        }
+    }
+    *value = numberRound(mantissa, sticky, exponent + binaryExponent, format);
+    return i;
+}
+
+// 解析从input开始的数字：前runLength个字符为数字和至多一个小数点，之后可以有指数部分(如1.5e-9)；
+// 为"0"且之后为x和十六进制数字时为十六进制浮点数(如0x1.8p3)。返回数字的总长度，value为按format正确舍入的值
+int parseNumber(const char *input, const int runLength, const NumberFormat *format, long double *value) {
+    if (runLength == 1 && input[0] == '0' && (input[1] == 'x' || input[1] == 'X') &&
+        (hexDigitValue(input[2]) >= 0 || (input[2] == '.' && hexDigitValue(input[3]) >= 0))) {
+        return 2 + parseHexNumber(&input[2], format, value);
+    }
+    int length = runLength;
+    int exponent = 0;
+    if ((input[length] == 'e' || input[length] == 'E') && (runLength > 1 || input[0] != '.')) {
+        int exponentLength = parseNumberExponent(&input[length + 1], &exponent);
+        if (exponentLength > 0) {
+            length += 1 + exponentLength;
+        }
+    }
+    *value = numberFromDecimal(input, runLength, exponent, format);
+    return length;
+}
+
+// 词法分析和检查的结果
+typedef enum {
+    PARSE_OK,
+    PARSE_UNKNOWN_SYMBOL, // 无法识别的符号(或有多个小数点的数字)，error的参数为该符号
+    PARSE_EMPTY, // 没有任何元素
+    PARSE_INVALID, // 元素序列不合法(括号不匹配、连续的操作符等)，error为对应的错误码
+    PARSE_VARIABLE_IN_CALCULATION // 计算式(没有等号)中出现了未知数
+} ParseStatus;
+
+// 检查时元素的类别(括号与其他操作符的规则不同，因此分开)
+typedef enum {
+    TOKEN_NONE, // 还没有元素
+    TOKEN_VALUE, // 数字或未知数
+    TOKEN_OPERATOR, // 除括号外的操作符
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
+    TOKEN_EQUALS
+} TokenKind;
+
+// 检查规则，按优先级排列：多条规则都不满足时报告排在最前的规则，同一规则报告最先出现的位置
+typedef enum {
+    CHECK_BRACKET_MATCH, // 括号匹配
+    CHECK_BRACKET_ADJACENT, // 左右括号不能连续
+    CHECK_CONTINUOUS_OPERATORS, // 连续操作符(左括号可以左连操作符，右括号可以右连)
+    CHECK_VALUE_BRACKET, // 数字或变量不能右边是左括号，不能左边是右括号
+    CHECK_CONTINUOUS_VALUES, // 连续两个元素都是数字或变量
+    CHECK_BEGINNING, // 首尾不能为操作符
+    CHECK_END,
+    NUM_CHECKS
+} CheckRule;
+
+// 是否为操作符(包括括号)
+int isOperatorToken(const TokenKind kind) {
+    return kind == TOKEN_OPERATOR || kind == TOKEN_LEFT_BRACKET || kind == TOKEN_RIGHT_BRACKET;
+}
+
+// 记录某条规则第一次出现的错误
+void checkFail(MsgErrorCode *checkErrors, const CheckRule rule, const MsgErrorCode error) {
+    if (checkErrors[rule] == NUM_MSG_ERRORS) {
+        checkErrors[rule] = error;
+    }
+}
+
+// 单遍词法分析和检查：逐个字符识别元素(忽略空格，数字(整数、小数、科学计数法或十六进制浮点数)记为NUMBER，变量x记为VARIABLE，操作符和等号分别记为对应元素)，
+// 同时根据相邻两个元素检查括号匹配、连续操作符、漏写乘号等规则，整个输入只扫描一遍
+// 等式直接按 E1=E2 -> E1-(E2) 生成元素：第一个等号输出为'-'和'('，结尾补')'，不再复制整个元素数组
+// 出错时返回NULL，status为错误类型，error为错误码(及出错的符号)；成功时isEquation表示是否为等式
+// 计算式中出现未知数时status为PARSE_VARIABLE_IN_CALCULATION，但仍返回元素数组(需由调用者释放)
+Element *parseExpression(const char *input, int *numElements, int *isEquation, ParseStatus *status, CalcError *error) {
+    int len = (int) strlen(input);
+    // 等式转换最多多出两个元素
+    Element *elements = (Element *) calcMalloc((len + 2) * sizeof(Element));
+    MsgErrorCode checkErrors[NUM_CHECKS]; // 各规则第一次出现的错误，NUM_MSG_ERRORS表示没有
+    for (int rule = 0; rule < NUM_CHECKS; rule++) {
+        checkErrors[rule] = NUM_MSG_ERRORS;
+    }
+    int numUnmatchedLeftBrackets = 0;
+    int hasVariable = 0;
+    TokenKind previous = TOKEN_NONE;
+    *numElements = 0;
+    *isEquation = 0;
+
+    int i = 0;
+    while (i < len) {
+        if (input[i] == ' ') {
+            i++; // 忽略空格
+            continue;
+        }
+
+        TokenKind kind;
+        if (isNumeric(input[i])) {
+            // 处理数字：直接在输入上解析，不复制
+            int start = i;
+            int pointOccurred = 0;
+            for (; isNumeric(input[i]); i++) {
+                pointOccurred += input[i] == '.';
+            }
+            int runLength = i - start;
+            if (pointOccurred > 1) {
+                snprintf(error->argument, MAX_ERROR_LENGTH, "%.*s", runLength, &input[start]);
+                error->code = MSG_ERROR_UNKNOWN_SYMBOL;
+                *status = PARSE_UNKNOWN_SYMBOL;
+                freeElements(elements);
+                return NULL;
+            }
+            const NumberFormat *format =
+                    calcConfig()->precision == PRECISION_DOUBLE ? &numberFormatDouble : &numberFormatLongDouble;
+            elements[*numElements].type = NUMBER;
+            elements[*numElements].text = &input[start];
+            elements[*numElements].length = parseNumber(&input[start], runLength, format, &elements[*numElements].value);
+            i = start + elements[*numElements].length;
+            (*numElements)++;
+            kind = TOKEN_VALUE;
+        } else {
+            // 处理操作符和其他特殊字符
+            switch (input[i]) {
+                case '+':
+                case '-':
+                case '*':
+                case '/':
+                case '%':
+                case '^':
+                    kind = TOKEN_OPERATOR;
+                    break;
+                case '(':
+                    kind = TOKEN_LEFT_BRACKET;
+                    break;
+                case ')':
+                    kind = TOKEN_RIGHT_BRACKET;
+                    break;
+                case 'x':
+                    kind = TOKEN_VALUE;
+                    hasVariable = 1;
+                    break;
+                case '=':
+                    kind = TOKEN_EQUALS;
+                    break;
+                default:
+                    calcErrorSet(error, MSG_ERROR_UNKNOWN_SYMBOL, " ");
+                    error->argument[0] = input[i];
+                    *status = PARSE_UNKNOWN_SYMBOL;
+                    freeElements(elements);
+                    return NULL;
+            }
+            if (kind == TOKEN_EQUALS && !*isEquation) {
+                // 第一个等号：E1=E2 -> E1-(E2)
+                *isEquation = 1;
+                elements[*numElements].type = OPERATOR;
+                elements[*numElements].value = '-';
+                (*numElements)++;
+                elements[*numElements].type = OPERATOR;
+                elements[*numElements].value = '(';
+                (*numElements)++;
+            } else {
+                elements[*numElements].type =
+                        kind == TOKEN_VALUE ? VARIABLE : kind == TOKEN_EQUALS ? EQUALS : OPERATOR;
+                elements[*numElements].value = (long double) input[i];
+                (*numElements)++;
+            }
+            i++;
+        }
+
+        // 检查当前元素及其与前一个元素的组合(基于原始输入的元素，等号不参与这些规则)
+        if (kind == TOKEN_LEFT_BRACKET) {
+            numUnmatchedLeftBrackets++;
+        } else if (kind == TOKEN_RIGHT_BRACKET && --numUnmatchedLeftBrackets < 0) {
+            checkFail(checkErrors, CHECK_BRACKET_MATCH, MSG_ERROR_UNMATCHED_RIGHT_BRACKET);
+        }
+        if (previous == TOKEN_LEFT_BRACKET && kind == TOKEN_RIGHT_BRACKET) {
+            checkFail(checkErrors, CHECK_BRACKET_ADJACENT, MSG_ERROR_EMPTY_BRACKETS);
+        }
+        if (previous == TOKEN_RIGHT_BRACKET && kind == TOKEN_LEFT_BRACKET) {
+            checkFail(checkErrors, CHECK_BRACKET_ADJACENT, MSG_ERROR_ADJACENT_BRACKETS);
+        }
+        if (isOperatorToken(previous) && isOperatorToken(kind) &&
+            kind != TOKEN_LEFT_BRACKET && previous != TOKEN_RIGHT_BRACKET) {
+            checkFail(checkErrors, CHECK_CONTINUOUS_OPERATORS, MSG_ERROR_CONTINUOUS_OPERATORS);
+        }
+        if (previous == TOKEN_VALUE && kind == TOKEN_LEFT_BRACKET) {
+            checkFail(checkErrors, CHECK_VALUE_BRACKET, MSG_ERROR_VALUE_BEFORE_BRACKET);
+        }
+        if (previous == TOKEN_RIGHT_BRACKET && kind == TOKEN_VALUE) {
+            checkFail(checkErrors, CHECK_VALUE_BRACKET, MSG_ERROR_VALUE_AFTER_BRACKET);
+        }
+        if (previous == TOKEN_VALUE && kind == TOKEN_VALUE) {
+            checkFail(checkErrors, CHECK_CONTINUOUS_VALUES, MSG_ERROR_CONTINUOUS_VALUES);
+        }
+        if (previous == TOKEN_NONE && isOperatorToken(kind) && kind != TOKEN_LEFT_BRACKET) {
+            checkFail(checkErrors, CHECK_BEGINNING, MSG_ERROR_OPERATOR_AT_BEGINNING);
+        }
+        previous = kind;
+    }
+
+    if (previous == TOKEN_NONE) {
+        *status = PARSE_EMPTY;
+        freeElements(elements);
+        return NULL;
+    }
+    if (isOperatorToken(previous) && previous != TOKEN_RIGHT_BRACKET) {
+        checkFail(checkErrors, CHECK_END, MSG_ERROR_OPERATOR_AT_END);
+    }
+    if (numUnmatchedLeftBrackets > 0) {
+        checkFail(checkErrors, CHECK_BRACKET_MATCH, MSG_ERROR_UNMATCHED_LEFT_BRACKET);
+    }
+    for (int rule = 0; rule < NUM_CHECKS; rule++) {
+        if (checkErrors[rule] != NUM_MSG_ERRORS) {
+            calcErrorSet(error, checkErrors[rule], NULL);
+            *status = PARSE_INVALID;
+            freeElements(elements);
+            return NULL;
+        }
+    }
+    // 只有等式中才能出现未知数，计算式不行(仍返回元素数组，求值表等允许未知数的调用者可以继续使用)
+    if (!*isEquation && hasVariable) {
+        *status = PARSE_VARIABLE_IN_CALCULATION;
+        return elements;
+    }
+    if (*isEquation) {
+        elements[*numElements].type = OPERATOR;
+        elements[*numElements].value = ')';
+        (*numElements)++;
+    }
+    *status = PARSE_OK;
+    return elements;
+}
+
+
+// 下面为表达式相关的结构体和函数(表达式代表每个形如an*x^n+...a1*x+a0的多项式，作为计算时的最小单元)
+// 定义表达式结构体(表达式代表每个形如an*x^n+...a1*x+a0的多项式，作为计算时的最小单元)
+// 表达式有稠密和稀疏两种表示：
+// 稠密表示(powers为NULL)：factorValue保存a0,a1,...,an全部系数
+// 稀疏表示(powers不为NULL)：只保存numTerms个非零项，powers[k]和factorValue[k]为第k项的次幂和系数，次幂从小到大
+// 次幂很高但非零项很少时(如x^1000-1)使用稀疏表示，见expressionAdjustForm，稀疏表示的次幂数一定不小于SPARSE_MIN_POWER_COUNT
+typedef struct {
+    int powerCount; // 表达式最高的阶次，即n
+    long double *factorValue; // 各个未知数次幂的系数，次幂数从小到大，即a0,a1,...,an(稀疏表示时只有非零项)
+    int capacity; // factorValue数组最多能容纳的阶次(>=powerCount)，原地运算时据此判断是否需要扩容(稀疏表示时为最多能容纳的项数)
+    int numTerms; // 稀疏表示的非零项数
+    int *powers; // 稀疏表示时各项的次幂，稠密表示时为NULL
+} Expression;
+
+// 释放表达式的系数数组(不释放结构体本身)
+void expressionFreeTerms(Expression *expression) {
+    calcFree(expression->factorValue);
+    if (expression->powers != NULL) {
+        calcFree(expression->powers);
+    }
+}
+
+// 释放表达式内存
+void freeExpression(Expression *expression) {
+    expressionFreeTerms(expression);
+    calcFree(expression);
+}
+
+// 根据次幂数新建空表达式(n -> an*x^n+...+a1*n+a0, an~a0未定义)
+Expression *expressionNew(const int powerCount) {
+    Expression *expression = (Expression *) calcMalloc(sizeof(Expression));
+    expression->powerCount = powerCount;
+    expression->capacity = powerCount;
+    expression->factorValue = (long double *) calcMalloc((powerCount + 1) * sizeof(long double));
+    expression->numTerms = 0;
+    expression->powers = NULL;
+    return expression;
+}
+
+// 根据次幂数新建全0的空表达式(n -> an*x^n+...+a1*n+a0, an~a0均为0)
+Expression *expressionNew0(const int powerCount) {
+    Expression *expression = expressionNew(powerCount);
+    for (int i = 0; i <= powerCount; i++) {
+        expression->factorValue[i] = 0;
+    }
+    return expression;
+}
+
+
+// 下面为稀疏表示相关的函数
+// 新建稀疏表示的空表达式(没有任何项，即为0)，最多容纳capacity项
+Expression *expressionNewSparse(const int capacity) {
+    Expression *expression = (Expression *) calcMalloc(sizeof(Expression));
+    expression->powerCount = 0;
+    expression->capacity = capacity;
+    expression->factorValue = (long double *) calcMalloc((capacity > 0 ? capacity : 1) * sizeof(long double));
+    expression->numTerms = 0;
+    expression->powers = (int *) calcMalloc((capacity > 0 ? capacity : 1) * sizeof(int));
+    return expression;
+}
+
+// 是否为稀疏表示
+int expressionIsSparse(const Expression *expression) {
+    return expression->powers != NULL;
+}
+
+// 表达式的项数(稠密表示时包括系数为0的项)，与expressionTermPower配合可以统一遍历两种表示
+int expressionNumTerms(const Expression *expression) {
+    return expressionIsSparse(expression) ? expression->numTerms : expression->powerCount + 1;
+}
+
+// 第k项的次幂
+int expressionTermPower(const Expression *expression, const int k) {
+    return expressionIsSparse(expression) ? expression->powers[k] : k;
+}
+
+// 向稀疏表示的表达式末尾追加一项(次幂需大于已有的各项)，系数为0时忽略
+void expressionSparseAppend(Expression *expression, const int power, const long double value) {
+    if (value == 0) {
+        return;
+    }
+    expression->powers[expression->numTerms] = power;
+    expression->factorValue[expression->numTerms] = value;
+    expression->numTerms++;
+    expression->powerCount = power;
+}
+
+// 非零项的个数
+int expressionCountNonZero(const Expression *expression) {
+    if (expressionIsSparse(expression)) {
+        return expression->numTerms;
+    }
+    int count = 0;
+    for (int i = 0; i <= expression->powerCount; i++) {
+        if (expression->factorValue[i] != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// 次幂数为powerCount、有numNonZero个非零项的多项式是否应使用稀疏表示
+int expressionShouldBeSparse(const long long powerCount, const long long numNonZero) {
+    return powerCount >= SPARSE_MIN_POWER_COUNT && numNonZero * SPARSE_DENSITY_RATIO <= powerCount + 1;
+}
+
+// 转为稠密表示(新建表达式，不释放原表达式)
+Expression *expressionToDense(const Expression *expression) {
+    Expression *expressionDense = expressionNew0(expression->powerCount);
+    for (int k = 0; k < expressionNumTerms(expression); k++) {
+        expressionDense->factorValue[expressionTermPower(expression, k)] = expression->factorValue[k];
+    }
+    return expressionDense;
+}
+
+// 转为稀疏表示(新建表达式，不释放原表达式)
+Expression *expressionToSparse(const Expression *expression) {
+    Expression *expressionSparse = expressionNewSparse(expressionCountNonZero(expression));
+    for (int k = 0; k < expressionNumTerms(expression); k++) {
+        expressionSparseAppend(expressionSparse, expressionTermPower(expression, k), expression->factorValue[k]);
+    }
+    return expressionSparse;
+}
+
+// 根据非零项的多少原地选择表示方式(需要时转换并替换系数数组)，要求表达式已经简化
+void expressionAdjustForm(Expression *expression) {
+    int sparse = expressionIsSparse(expression);
+    if (!sparse && expression->powerCount < SPARSE_MIN_POWER_COUNT) {
+        return;
+    }
+    int shouldBeSparse = expressionShouldBeSparse(expression->powerCount, expressionCountNonZero(expression));
+    if (shouldBeSparse == sparse) {
+        return;
+    }
+    Expression *expressionConverted = shouldBeSparse ? expressionToSparse(expression) : expressionToDense(expression);
+    expressionFreeTerms(expression);
+    *expression = *expressionConverted;
+    calcFree(expressionConverted);
+}
+
+
+// 复制表达式
+Expression *expressionCopy(const Expression *expression) {
+    if (expressionIsSparse(expression)) {
+        Expression *expressionCopy = expressionNewSparse(expression->numTerms);
+        memcpy(expressionCopy->powers, expression->powers, expression->numTerms * sizeof(int));
+        memcpy(expressionCopy->factorValue, expression->factorValue, expression->numTerms * sizeof(long double));
+        expressionCopy->numTerms = expression->numTerms;
+        expressionCopy->powerCount = expression->powerCount;
+        return expressionCopy;
+    }
+    Expression *expressionCopy = expressionNew(expression->powerCount);
+    for (int i = 0; i <= expression->powerCount; i++) {
+        expressionCopy->factorValue[i] = expression->factorValue[i];
+    }
+    return expressionCopy;
+}
+
+// 输出表达式用于debug的工具函数
+void expressionPrint(const Expression *expression) {
+    int printed = 0;
+    for (int k = expressionNumTerms(expression) - 1; k >= 0; k--) {
+        int i = expressionTermPower(expression, k);
+        if (expression->factorValue[k] != 0) {
+            if (printed) {
+                printf(" + ");
+            }
+            if (i == 0) {
+                printf("%.2Lf", expression->factorValue[k]);
+            } else if (i == 1) {
+                printf("%.2Lfx", expression->factorValue[k]);
+            } else {
+                printf("%.2Lfx^%d", expression->factorValue[k], i);
+            }
+            printed = 1;
+        }
+    }
+    if (!printed) {
+        printf("0");
+    }
+}
+
+// 简化表达式(除去高次幂的0项)(原地降低阶次，不重新分配也不复制系数，返回原表达式)
+// 稀疏表示时去掉所有系数为0的项，化简后不再适合稀疏表示时转为稠密表示
+Expression *expressionSimplify(Expression *expression) {
+    if (expressionIsSparse(expression)) {
+        int numTerms = 0;
+        for (int k = 0; k < expression->numTerms; k++) {
+            if (expression->factorValue[k] != 0) {
+                expression->powers[numTerms] = expression->powers[k];
+                expression->factorValue[numTerms] = expression->factorValue[k];
+                numTerms++;
+            }
+        }
+        expression->numTerms = numTerms;
+        expression->powerCount = numTerms > 0 ? expression->powers[numTerms - 1] : 0;
+        expressionAdjustForm(expression);
+        return expression;
+    }
+    // 求出最大非零项的阶次
+    int maxPower = 0;
+    for (int i = expression->powerCount; i >= 0; i--) {
+        if (expression->factorValue[i] != 0) {
+            maxPower = i;
+            break;
+        }
+    }
+    expression->powerCount = maxPower;
+    return expression;
+}
+
+// 表达式扩容，保证系数数组至少能容纳powerCount次幂(按两倍增长，新增部分未初始化)
+void expressionReserve(Expression *expression, const int powerCount) {
+    if (powerCount <= expression->capacity) {
+        return;
+    }
+    int capacity = expression->capacity * 2 + 1 > powerCount ? expression->capacity * 2 + 1 : powerCount;
+    long double *factorValue = (long double *) calcMalloc((capacity + 1) * sizeof(long double));
+    memcpy(factorValue, expression->factorValue, (expression->powerCount + 1) * sizeof(long double));
+    calcFree(expression->factorValue);
+    expression->factorValue = factorValue;
+    expression->capacity = capacity;
+}
+
+// 元素转表达式(需确定元素为值类型而非符号)(不自动释放元素内存)
+Expression *elementToExpression(const Element *element) {
+    Expression *expression;
+    if (element->type == NUMBER) {
+        expression = expressionNew(0);
+        expression->factorValue[0] = element->value;
+    } else if (element->type == VARIABLE) {
+        expression = expressionNew(1);
+        expression->factorValue[0] = 0;
+        expression->factorValue[1] = 1;
+    } else {
+        return NULL;
+    }
+    return expression;
+}
+
+// 中间结果的次幂数超过上限时报错，返回0(上限取稠密和稀疏表示中较大的一个，避免次幂数溢出或分配过大的数组)
+int expressionCheckPowerCount(const long long powerCount, CalcError *error) {
+    const CalcConfig *config = calcConfig();
+    int limit = config->maxPowerCount > config->maxSparsePowerCount ? config->maxPowerCount : config->maxSparsePowerCount;
+    if (powerCount >= limit) {
+        calcErrorSetNumber(error, MSG_ERROR_POWER_TOO_LARGE, limit);
+        return 0;
+    }
+    return 1;
+}
+
+// 稀疏表示的加减：expression1 + sign * expression2(sign为1或-1)，按次幂从小到大归并两个表达式的各项
+// 两个表达式可以是任意表示，结果根据非零项的多少选择表示方式
+Expression *expressionSparseAdd(const Expression *expression1, const Expression *expression2, const int sign) {
+    int numTerms1 = expressionNumTerms(expression1);
+    int numTerms2 = expressionNumTerms(expression2);
+    Expression *expression = expressionNewSparse(numTerms1 + numTerms2);
+    int i = 0;
+    int j = 0;
+    while (i < numTerms1 || j < numTerms2) {
+        int power1 = i < numTerms1 ? expressionTermPower(expression1, i) : INT_MAX;
+        int power2 = j < numTerms2 ? expressionTermPower(expression2, j) : INT_MAX;
+        int power = power1 < power2 ? power1 : power2;
+        long double value = 0;
+        if (power1 == power) {
+            value += expression1->factorValue[i++];
+        }
+        if (power2 == power) {
+            value = sign > 0 ? value + expression2->factorValue[j] : value - expression2->factorValue[j];
+            j++;
+        }
+        expressionSparseAppend(expression, power, value);
+    }
+    expressionAdjustForm(expression);
+    return expression;
+}
+
+// 下面为多项式系数数组的乘法，系数次幂数从小到大，a有na项、b有nb项，结果累加到result的前na+nb-1项中
+// 逐项相乘(整式乘法)，O(na*nb)
+void polyMultiplySchoolbook(long double *result, const long double *a, const int na, const long double *b,
+                            const int nb) {
+    for (int i = 0; i < na; i++) {
+        for (int j = 0; j < nb; j++) {
+            result[i + j] += a[i] * b[j];
+        }
+    }
+}
+
+// 平方的逐项相乘，a_i*a_j(i<j)只算一次再乘2，乘法次数减半
+void polySquareSchoolbook(long double *result, const long double *a, const int na) {
+    for (int i = 0; i < na; i++) {
+        result[2 * i] += a[i] * a[i];
+        long double doubled = 2 * a[i];
+        for (int j = i + 1; j < na; j++) {
+            result[i + j] += doubled * a[j];
+        }
+    }
+}
+
+// 系数的动态范围：非零系数绝对值的最大值与最小值之比(全为0时返回1)
+long double polyDynamicRange(const long double *a, const int na) {
+    long double maxValue = 0;
+    long double minValue = 0;
+    for (int i = 0; i < na; i++) {
+        long double value = lfabs(a[i]);
+        if (value == 0) {
+            continue;
+        }
+        if (value > maxValue) {
+            maxValue = value;
+        }
+        if (minValue == 0 || value < minValue) {
+            minValue = value;
+        }
+    }
+    return minValue == 0 ? 1 : maxValue / minValue;
+}
+
+// Karatsuba乘法需要的临时空间(long double的个数)
+int polyKaratsubaScratchSize(const int n) {
+    if (n < KARATSUBA_THRESHOLD) {
+        return 0;
+    }
+    int high = n - n / 2;
+    return 8 * high + polyKaratsubaScratchSize(high);
+}
+
+// Karatsuba乘法，a和b都为n项，O(n^1.585)
+/*
+ a = a0 + a1*x^m, b = b0 + b1*x^m
+ a*b = a0*b0 + ((a0+a1)*(b0+b1) - a0*b0 - a1*b1)*x^m + a1*b1*x^2m
+ 中间项的相减在系数大小相差悬殊时会损失精度，因此只在项数较多时使用
+*/
+void polyMultiplyKaratsuba(long double *result, const long double *a, const long double *b, const int n,
+                           long double *scratch) {
+    if (n < KARATSUBA_THRESHOLD) {
+        polyMultiplySchoolbook(result, a, n, b, n);
+        return;
+    }
+    int low = n / 2; // 低半部分的项数m
+    int high = n - low; // 高半部分的项数(>=m)
+    // 临时空间：两个和(各high项)、三个乘积(z0为2*low-1项，z1和z2为2*high-1项)
+    long double *sumA = scratch;
+    long double *sumB = sumA + high;
+    long double *z0 = sumB + high;
+    long double *z1 = z0 + 2 * high;
+    long double *z2 = z1 + 2 * high;
+    long double *next = z2 + 2 * high;
+    for (int i = 0; i < high; i++) {
+        sumA[i] = a[low + i] + (i < low ? a[i] : 0);
+        sumB[i] = b[low + i] + (i < low ? b[i] : 0);
+    }
+    memset(z0, 0, (2 * low - 1) * sizeof(long double));
+    memset(z1, 0, (2 * high - 1) * sizeof(long double));
+    memset(z2, 0, (2 * high - 1) * sizeof(long double));
+    polyMultiplyKaratsuba(z0, a, b, low, next);
+    polyMultiplyKaratsuba(z2, a + low, b + low, high, next);
+    polyMultiplyKaratsuba(z1, sumA, sumB, high, next);
+    for (int i = 0; i < 2 * low - 1; i++) {
+        result[i] += z0[i];
+        z1[i] -= z0[i];
+    }
+    for (int i = 0; i < 2 * high - 1; i++) {
+        z1[i] -= z2[i];
+        result[2 * low + i] += z2[i];
+    }
+    for (int i = 0; i < 2 * high - 1; i++) {
+        result[low + i] += z1[i];
+    }
+}
+
+// 多项式乘法：较短的多项式项数较少或系数大小相差悬殊(如(x+1)^n的展开)时逐项相乘，
+// 否则把较长的多项式按较短多项式的项数分段，每段使用Karatsuba乘法
+void polyMultiply(long double *result, const long double *a, const int na, const long double *b, const int nb) {
+    if (na < nb) {
+        polyMultiply(result, b, nb, a, na);
+        return;
+    }
+    if (nb < KARATSUBA_THRESHOLD ||
+        polyDynamicRange(a, na) > KARATSUBA_MAX_DYNAMIC_RANGE ||
+        polyDynamicRange(b, nb) > KARATSUBA_MAX_DYNAMIC_RANGE) {
+        if (a == b && na == nb) {
+            polySquareSchoolbook(result, a, na);
+        } else {
+            polyMultiplySchoolbook(result, a, na, b, nb);
+        }
+        return;
+    }
+    long double *scratch = (long double *) calcMalloc(polyKaratsubaScratchSize(nb) * sizeof(long double));
+    int offset = 0;
+    for (; offset + nb <= na; offset += nb) {
+        polyMultiplyKaratsuba(result + offset, a + offset, b, nb, scratch);
+    }
+    calcFree(scratch);
+    if (offset < na) {
+        polyMultiply(result + offset, a + offset, na - offset, b, nb);
+    }
+}
+
+// 稀疏表示的乘法：非零项两两相乘，按次幂排序后合并同次幂的项，O(n1*n2*log(n1*n2))
+typedef struct {
+    int power;
+    long double value;
+} SparseTerm;
+
+int sparseTermCompare(const void *a, const void *b) {
+    return ((const SparseTerm *) a)->power - ((const SparseTerm *) b)->power;
+}
+
+Expression *expressionSparseMultiply(const Expression *expression1, const Expression *expression2) {
+    int numTerms1 = expressionNumTerms(expression1);
+    int numTerms2 = expressionNumTerms(expression2);
+    SparseTerm *products = (SparseTerm *) calcMalloc(
+            ((size_t) expressionCountNonZero(expression1) * expressionCountNonZero(expression2) + 1) *
+            sizeof(SparseTerm));
+    int numProducts = 0;
+    for (int i = 0; i < numTerms1; i++) {
+        if (expression1->factorValue[i] == 0) {
+            continue;
+        }
+        for (int j = 0; j < numTerms2; j++) {
+            if (expression2->factorValue[j] == 0) {
+                continue;
+            }
+            products[numProducts].power = expressionTermPower(expression1, i) + expressionTermPower(expression2, j);
+            products[numProducts].value = expression1->factorValue[i] * expression2->factorValue[j];
+            numProducts++;
+        }
+    }
+    qsort(products, numProducts, sizeof(SparseTerm), sparseTermCompare);
+    Expression *expression = expressionNewSparse(numProducts);
+    for (int k = 0; k < numProducts;) {
+        int power = products[k].power;
+        long double value = 0;
+        for (; k < numProducts && products[k].power == power; k++) {
+            value += products[k].value;
+        }
+        expressionSparseAppend(expression, power, value);
+    }
+    calcFree(products);
+    expressionAdjustForm(expression);
+    return expression;
+}
+
+// 表达式乘法(结果取次幂数之和的为新的次幂数，然后循环并累积各个次幂数的值)(基于整式乘法，项数多时使用Karatsuba乘法)
+// 结果次幂很高而非零项的乘积很少时(如(x^100+1)*(x^200-1))使用稀疏表示的乘法
+Expression *expressionMultiply(const Expression *expression1, const Expression *expression2, CalcError *error) {
+    if (!expressionCheckPowerCount((long long) expression1->powerCount + expression2->powerCount, error)) {
+        return NULL;
+    }
+    // 整式乘法
+    // 取次幂数之和为结果次幂，然后逐项循环求值
+    int powerCount = expression1->powerCount + expression2->powerCount;
+    if (powerCount >= SPARSE_MIN_POWER_COUNT &&
+        expressionShouldBeSparse(powerCount, (long long) expressionCountNonZero(expression1) *
+                                             expressionCountNonZero(expression2))) {
+        return expressionSparseMultiply(expression1, expression2);
+    }
+    // 稠密乘法，稀疏表示的操作数先转为稠密表示
+    const Expression *dense1 = expressionIsSparse(expression1) ? expressionToDense(expression1) : expression1;
+    const Expression *dense2 = expressionIsSparse(expression2) ? expressionToDense(expression2) : expression2;
+    Expression *expression = expressionNew0(powerCount);
+    polyMultiply(expression->factorValue, dense1->factorValue, dense1->powerCount + 1,
+                 dense2->factorValue, dense2->powerCount + 1);
+    if (dense1 != expression1) {
+        freeExpression((Expression *) dense1);
+    }
+    if (dense2 != expression2) {
+        freeExpression((Expression *) dense2);
+    }
+    // 简化结果
+    expression = expressionSimplify(expression);
+    expressionAdjustForm(expression);
+    return expression;
+}
+
+// 表达式求余(仅支持常数求模一个常数，求模0报错，均为常数故直接计算即可)
+Expression *expressionMod(const Expression *expression1, const Expression *expression2, CalcError *error) {
+    //  模数必须为常数(次幂数为0)
+    if (expression2->powerCount != 0) {
+        calcErrorSet(error, MSG_ERROR_MODULUS_NOT_CONSTANT, NULL);
+        return NULL;
+    }
+    // 模数不能为0
+    if (expression2->factorValue[0] == 0) {
+        calcErrorSet(error, MSG_ERROR_MODULO_BY_ZERO, NULL);
+        return NULL;
+    }
+    // 被除数必须为常数(次幂数为0)
+    if (expression1->powerCount != 0) {
+        calcErrorSet(error, MSG_ERROR_DIVIDEND_NOT_CONSTANT, NULL);
+        return NULL;
+    }
+    // 求余
+    // 新建表达式，直接循环求值
+    int powerCount = expression1->powerCount;
+    Expression *expression = expressionNew(powerCount);
+    for (int i = 0; i <= expression->powerCount; i++) {
+        expression->factorValue[i] =
+                expression1->factorValue[i] -
+                (int) (expression1->factorValue[i] / expression2->factorValue[0]) * expression2->factorValue[0];
+    }
+    // 简化结果
+    expression = expressionSimplify(expression);
+    return expression;
+}
+
+// 二项式直接展开求幂：(a+b*x^p)^n = sum C(n,k)*a^(n-k)*b^k*x^(p*k)，不做任何多项式乘法
+// 要求表达式只有常数项和最高次项两项非零(常数项可以为0，此时即为单项式)
+// 结果适合稀疏表示时(单项式或p较大)直接生成稀疏表示，不分配p*n+1个系数
+Expression *expressionPowerBinomial(const Expression *expression1, const int powerCount) {
+    int power = expression1->powerCount; // p
+    long double a = expressionTermPower(expression1, 0) == 0 ? expression1->factorValue[0] : 0;
+    long double b = expression1->factorValue[expressionNumTerms(expression1) - 1];
+    int sparse = expressionShouldBeSparse(power * powerCount, a == 0 ? 1 : powerCount + 1);
+    Expression *expression = sparse ? expressionNewSparse(powerCount + 1) : expressionNew0(power * powerCount);
+    // 单项式：b^n*x^(p*n)
+    if (a == 0) {
+        long double value = 1;
+        for (int i = 0; i < powerCount; i++) {
+            value *= b;
+        }
+        if (sparse) {
+            expressionSparseAppend(expression, power * powerCount, value);
+        } else {
+            expression->factorValue[power * powerCount] = value;
+        }
+        return expressionSimplify(expression);
+    }
+    // 预先求出a和b的各次幂
+    long double *powersA = (long double *) calcMalloc((powerCount + 1) * sizeof(long double));
+    long double *powersB = (long double *) calcMalloc((powerCount + 1) * sizeof(long double));
+    powersA[0] = 1;
+    powersB[0] = 1;
+    for (int i = 1; i <= powerCount; i++) {
+        powersA[i] = powersA[i - 1] * a;
+        powersB[i] = powersB[i - 1] * b;
+    }
+    // 组合数C(n,k)由C(n,k-1)*(n-k+1)/k递推
+    long double binomial = 1;
+    for (int k = 0; k <= powerCount; k++) {
+        if (k > 0) {
+            binomial = binomial * (powerCount - k + 1) / k;
+        }
+        long double value = binomial * powersA[powerCount - k] * powersB[k];
+        if (sparse) {
+            expressionSparseAppend(expression, power * k, value);
+        } else {
+            expression->factorValue[power * k] = value;
+        }
+    }
+    calcFree(powersA);
+    calcFree(powersB);
+    return expressionSimplify(expression);
+}
+
+// 判断表达式是否只有常数项和最高次项两项非零(可以直接用二项式展开求幂)
+int expressionIsBinomial(const Expression *expression) {
+    if (expressionIsSparse(expression)) {
+        return expression->numTerms == 1 || (expression->numTerms == 2 && expression->powers[0] == 0);
+    }
+    for (int i = 1; i < expression->powerCount; i++) {
+        if (expression->factorValue[i] != 0) {
+            return 0;
+        }
+    }
+    return expression->powerCount > 0;
+}
+
+// 表达式求幂的底层函数，基于表达式乘法实现递归二分的快速幂(需保证幂次为整数)，二项式则直接展开
+Expression *expressionPowerQuick(const Expression *expression1, const int powerCount, CalcError *error) {
+    // 快速幂
+    // 如果幂次为0，返回1
+    if (powerCount == 0) {
+        Expression *expression = expressionNew(0);
+        expression->factorValue[0] = 1;
+        return expression;
+    }
+    // 如果幂次为1，返回原表达式
+    if (powerCount == 1) {
+        return expressionCopy(expression1);
+    }
+    // 二项式(如x+a、x^2-1、3*x^5)直接展开
+    if (expressionIsBinomial(expression1)) {
+        return expressionPowerBinomial(expression1, powerCount);
+    }
+    // 新建表达式，二分递归求值
+    // 求出一半的幂次
+    Expression *expressionHalf = expressionPowerQuick(expression1, powerCount / 2, error);
+    // 两者相乘
+    Expression *expression = expressionMultiply(expressionHalf, expressionHalf, error);
+    // 幂次为奇数时再乘一次原表达式
+    if (powerCount % 2 == 1) {
+        Expression *expressionSquare = expression;
+        expression = expressionMultiply(expressionSquare, expression1, error);
+        freeExpression(expressionSquare);
+    }
+    // 简化结果
+    expression = expressionSimplify(expression);
+    // 释放内存
+    freeExpression(expressionHalf);
+
+    return expression;
+}
+
+// 表达式求幂(结果幂次为两个参数的幂次之积，内部使用上面的快速幂函数计算)
+Expression *expressionPower(const Expression *expression1, const Expression *expression2, CalcError *error) {
+    // 次幂数必须为常数(次幂数为0)
+    if (expression2->powerCount != 0) {
+        calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_CONSTANT, NULL);
+        return NULL;
+    }
+    // 次幂数不能为负数
+    if (expression2->factorValue[0] < 0) {
+        calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_POSITIVE, NULL);
+        return NULL;
+    }
+    // 次幂数必须为整数
+    if (expression2->factorValue[0] != (int) expression2->factorValue[0]) {
+        calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_INTEGER, NULL);
+        return NULL;
+    }
+    // 求幂
+    // 新建表达式，使用快速幂函数计算
+    int powerNum = (int) expression2->factorValue[0];
+    if (!expressionCheckPowerCount((long long) expression1->powerCount * powerNum, error)) {
+        return NULL;
+    }
+    Expression *expression = expressionPowerQuick(expression1, powerNum, error);
+    // 简化结果
+    expression = expressionSimplify(expression);
+    return expression;
+}
+
+
+// 下面为原地运算的函数，结果写入调用者指定的target(target必须是两个操作数之一)，不新建表达式
+// 原地加减只支持稠密表示，数乘和除法两种表示均可
+// 每一项的计算方式与上面对应的函数完全一致(如 0+a1[i]-a2[i])，保证结果逐位相同
+// 原地加减：target = expression1 + sign * expression2(sign为1或-1)，target容量不足时扩容
+void expressionAddInPlace(Expression *target, const Expression *expression1, const Expression *expression2,
+                          const int sign) {
+    int powerCount =
+            expression1->powerCount > expression2->powerCount ?
+            expression1->powerCount : expression2->powerCount;
+    int powerCount1 = expression1->powerCount;
+    int powerCount2 = expression2->powerCount;
+    expressionReserve(target, powerCount);
+    // 扩容后target的系数数组可能改变，因此在扩容后再取两个操作数的数组
+    const long double *factorValue1 = expression1->factorValue;
+    const long double *factorValue2 = expression2->factorValue;
+    for (int i = 0; i <= powerCount; i++) {
+        long double value = 0;
+        if (i <= powerCount1) {
+            value += factorValue1[i];
+        }
+        if (i <= powerCount2) {
+            value = sign > 0 ? value + factorValue2[i] : value - factorValue2[i];
+        }
+        target->factorValue[i] = value;
+    }
+    target->powerCount = powerCount;
+    expressionSimplify(target);
+}
+
+// 原地数乘：expression = expression * factor(两种表示均可，稀疏表示时只需处理非零项)
+void expressionScaleInPlace(Expression *expression, const long double factor) {
+    for (int i = 0; i < expressionNumTerms(expression); i++) {
+        expression->factorValue[i] = 0 + expression->factorValue[i] * factor;
+    }
+    expressionSimplify(expression);
+}
+
+// 原地除以常数(仅支持除以一个常数，除以0报错，循环将每个系数均除以除数即可)，出错返回0
+int expressionDivideInPlace(Expression *expression1, const Expression *expression2, CalcError *error) {
+    if (expression2->powerCount != 0) {
+        calcErrorSet(error, MSG_ERROR_DIVISOR_NOT_CONSTANT, NULL);
+        return 0;
+    }
+    if (expression2->factorValue[0] == 0) {
+        calcErrorSet(error, MSG_ERROR_DIVIDE_BY_ZERO, NULL);
+        return 0;
+    }
+    for (int i = 0; i < expressionNumTerms(expression1); i++) {
+        expression1->factorValue[i] = expression1->factorValue[i] / expression2->factorValue[0];
+    }
+    expressionSimplify(expression1);
+    return 1;
+}
+
+
+// 下面为计算表达式的相关函数
+// 操作符结构体
+typedef struct {
+    char symbol; // 符号
+    int priority; // 优先级(实际优先级，遇到左括号会增加优先级，遇到右括号会减少优先级)
+} Operator;
+
+// 输出操作符和优先级用于debug的工具函数
+void operatorPrint(const Operator *operator) {
+    printf("OPERATOR(%c, %d)", operator->symbol, operator->priority);
+}
+
+// 输出操作符优先级，+-为1、*/%为2、^为3，每遇到一个左括号则接下来的运算符优先级全部加4，每一个右括号则取消加4
+int operatorPriority(const char symbol) {
+    switch (symbol) {
+        case '+':
+        case '-':
+            return 1;
+        case '*':
+        case '/':
+        case '%':
+            return 2;
+        case '^':
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+// 释放表达式栈(包括栈中每个表达式的系数数组)和操作符栈
+void expressionStackFree(Expression *expressionStack, const int numExpressions, Operator *operatorStack) {
+    for (int i = 0; i < numExpressions; i++) {
+        expressionFreeTerms(&expressionStack[i]);
+    }
+    calcFree(expressionStack);
+    calcFree(operatorStack);
+}
+
+// 弹出栈顶的两个表达式，用操作符计算后将结果压回栈中，出错返回0
+// 加减、除法、与常数相乘在栈中的表达式上原地进行，不新建表达式；其他情况调用对应的函数新建结果表达式
+int expressionStackApply(Expression *expressionStack, int *numExpressions, const Operator *operator, CalcError *error) {
+    // 弹出两个表达式
+    if (*numExpressions < 2) {
+        calcErrorSet(error, MSG_ERROR_STACK_EMPTY, NULL);
+        return 0;
+    }
+    Expression *expression1 = &expressionStack[*numExpressions - 2];
+    Expression *expression2 = &expressionStack[*numExpressions - 1];
+    // log：输出表达式
+    if (debugTrace()) {
+        printf("Pop two expressions:");
+        expressionPrint(expression1);
+        printf("\t");
+        expressionPrint(expression2);
+        printf("\n");
+    }
+    // 根据运算符计算，结果放在expression1的位置
+    Expression *expressionResult = NULL;
+    int ok = 1;
+    switch (operator->symbol) {
+        case '+':
+        case '-':
+            // 有稀疏表示的操作数时按项归并，新建结果表达式
+            if (expressionIsSparse(expression1) || expressionIsSparse(expression2)) {
+                expressionResult = expressionSparseAdd(expression1, expression2, operator->symbol == '+' ? 1 : -1);
+                break;
+            }
+            // 结果写入容量较大的操作数，尽量避免扩容
+            if (expression2->capacity > expression1->capacity) {
+                expressionAddInPlace(expression2, expression1, expression2, operator->symbol == '+' ? 1 : -1);
+                Expression temp = *expression1;
+                *expression1 = *expression2;
+                *expression2 = temp;
+            } else {
+                expressionAddInPlace(expression1, expression1, expression2, operator->symbol == '+' ? 1 : -1);
+            }
+            break;
+        case '*':
+            if (expression2->powerCount == 0) {
+                expressionScaleInPlace(expression1, expression2->factorValue[0]);
+            } else if (expression1->powerCount == 0) {
+                expressionScaleInPlace(expression2, expression1->factorValue[0]);
+                Expression temp = *expression1;
+                *expression1 = *expression2;
+                *expression2 = temp;
+            } else {
+                expressionResult = expressionMultiply(expression1, expression2, error);
+                ok = expressionResult != NULL;
+            }
+            break;
+        case '/':
+            ok = expressionDivideInPlace(expression1, expression2, error);
+            break;
+        case '%':
+            expressionResult = expressionMod(expression1, expression2, error);
+            ok = expressionResult != NULL;
+            break;
+        case '^':
+            expressionResult = expressionPower(expression1, expression2, error);
+            ok = expressionResult != NULL;
+            break;
+        default:
+            calcErrorSet(error, MSG_ERROR_UNKNOWN_OPERATOR, NULL);
+            ok = 0;
+            break;
+    }
+    // 新建的结果表达式替换expression1(保留其系数数组，释放结构体本身)
+    if (expressionResult != NULL) {
+        expressionFreeTerms(expression1);
+        *expression1 = *expressionResult;
+        calcFree(expressionResult);
+    }
+    // 释放第二个操作数
+    expressionFreeTerms(expression2);
+    (*numExpressions)--;
+    if (!ok) {
+        return 0;
+    }
+    // 原地运算后可能出现次幂很高但大部分系数为0的结果(如高次项相消)，需要时转为稀疏表示
+    expressionAdjustForm(expression1);
+    // log：输出表达式
+    if (debugTrace()) {
+        printf("Stack an expression:");
+        expressionPrint(expression1);
+        printf("\n");
+    }
+    return 1;
+}
+
+// 下面为字节码(后缀表达式程序)相关的结构体和函数
+// 元素列表先编译为后缀形式的字节码程序，再由执行函数计算为多项式表达式(或精确计算、静态估计)
+// 程序是一块不含指针的连续内存，一个请求只编译一次，估计、精确计算和展开都执行同一个程序
+// 指令
+typedef enum {
+    OP_PUSH_CONST, // 压入常数(依次取常数表中的下一个)
+    OP_PUSH_X, // 压入未知数x
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_MOD,
+    OP_POWER,
+    // 编译时发现的错误编译为报错指令，执行到该处时才报错，保证与逐个元素计算时的报错顺序一致
+    OP_FAIL_STACK_EMPTY,
+    OP_FAIL_UNKNOWN_ELEMENT,
+    OP_FAIL_STACK_COUNT
+} Opcode;
+
+// 程序，常数表和指令紧跟在结构体后面
+typedef struct {
+    int size; // 整个程序占用的字节数(含结构体本身)
+    int numInstructions;
+    int numConstants;
+    int maxDepth; // 执行时栈的最大深度
+    long double constants[]; // 常数表，之后为numInstructions个字节的指令
+} Program;
+
+// 程序的指令数组
+unsigned char *programCode(const Program *program) {
+    return (unsigned char *) (program->constants + program->numConstants);
+}
+
+// 操作符对应的指令
+Opcode operatorOpcode(const char symbol) {
+    switch (symbol) {
+        case '+':
+            return OP_ADD;
+        case '-':
+            return OP_SUBTRACT;
+        case '*':
+            return OP_MULTIPLY;
+        case '/':
+            return OP_DIVIDE;
+        case '%':
+            return OP_MOD;
+        default:
+            return OP_POWER;
+    }
+}
+
+// 指令对应的操作符
+char opcodeSymbol(const Opcode opcode) {
+    static const char symbols[] = {0, 0, '+', '-', '*', '/', '%', '^'};
+    return opcode <= OP_POWER ? symbols[opcode] : 0;
+}
+
+// 编译：与逐个元素计算的过程完全相同(括号优先级加4，操作符单调栈)，只是把"计算"换成输出对应的指令，得到后缀表达式
+/*
+ 数字和未知数直接输出压栈指令，操作符入栈时弹出优先级不低于它的操作符并输出对应的指令，最后弹出剩余的操作符
+ 同时记录执行时栈的深度：操作符弹出两个表达式压入一个，深度不足时输出报错指令并结束编译
+*/
+Program *programCompile(const Element *elements, const int numElements) {
+    int numConstants = 0;
+    for (int i = 0; i < numElements; i++) {
+        if (elements[i].type == NUMBER) {
+            numConstants++;
+        }
+    }
+    // 每个元素至多一条指令，另加一条报错指令
+    int size = (int) (sizeof(Program) + numConstants * sizeof(long double) + numElements + 1);
+    Program *program = (Program *) calcMalloc(size);
+    memset(program, 0, size);
+    program->size = size;
+    program->numConstants = numConstants;
+    unsigned char *code = programCode(program);
+    int numInstructions = 0;
+    int constantIndex = 0;
+    int depth = 0;
+    int maxDepth = 0;
+    int numOperators = 0;
+    Operator *operatorStack = (Operator *) calcMalloc(numElements * sizeof(Operator));
+    int currentPlusPriority = 0; // 当前的额外优先级
+    int failed = 0;
+    for (int i = 0; i < numElements && !failed; i++) {
+        switch (elements[i].type) {
+            case NUMBER:
+                program->constants[constantIndex++] = elements[i].value;
+                code[numInstructions++] = OP_PUSH_CONST;
+                depth++;
+                break;
+            case VARIABLE:
+                code[numInstructions++] = OP_PUSH_X;
+                depth++;
+                break;
+            case OPERATOR: {
+                // 如果是左括号，接下来的算符的优先级加4
+                if (elements[i].value == '(') {
+                    currentPlusPriority += 4;
+                    break;
+                }
+                // 如果是右括号，接下来的算符的优先级减4
+                if (elements[i].value == ')') {
+                    currentPlusPriority -= 4;
+                    break;
+                }
+                // 弹出栈顶优先级不低于当前运算符的运算符并输出指令，然后当前运算符入栈
+                int currentPriority = operatorPriority((char) elements[i].value);
+                while (numOperators > 0 &&
+                       operatorStack[numOperators - 1].priority >= currentPriority + currentPlusPriority) {
+                    numOperators--;
+                    if (depth < 2) {
+                        code[numInstructions++] = OP_FAIL_STACK_EMPTY;
+                        failed = 1;
+                        break;
+                    }
+                    code[numInstructions++] = operatorOpcode(operatorStack[numOperators].symbol);
+                    depth--;
+                }
+                operatorStack[numOperators].symbol = (char) elements[i].value;
+                operatorStack[numOperators].priority = currentPriority + currentPlusPriority;
+                numOperators++;
+                break;
+            }
+            default:
+                // 不可能到达此分支(等号已在解析时转换)，报错
+                code[numInstructions++] = OP_FAIL_UNKNOWN_ELEMENT;
+                failed = 1;
+                break;
+        }
+        if (depth > maxDepth) {
+            maxDepth = depth;
+        }
+    }
+    // 弹出剩余的操作符
+    while (!failed && numOperators > 0) {
+        numOperators--;
+        if (depth < 2) {
+            code[numInstructions++] = OP_FAIL_STACK_EMPTY;
+            failed = 1;
+            break;
+        }
+        code[numInstructions++] = operatorOpcode(operatorStack[numOperators].symbol);
+        depth--;
+    }
+    // 最后栈中应恰好剩一个表达式
+    if (!failed && depth != 1) {
+        code[numInstructions++] = OP_FAIL_STACK_COUNT;
+    }
+    calcFree(operatorStack);
+    program->numInstructions = numInstructions;
+    program->maxDepth = maxDepth;
+    return program;
+}
+
+// 报错指令对应的错误码
+MsgErrorCode opcodeError(const Opcode opcode) {
+    switch (opcode) {
+        case OP_FAIL_STACK_EMPTY:
+            return MSG_ERROR_STACK_EMPTY;
+        case OP_FAIL_UNKNOWN_ELEMENT:
+            return MSG_ERROR_UNKNOWN_ELEMENT;
+        case OP_FAIL_STACK_COUNT:
+            return MSG_ERROR_STACK_COUNT;
+        default:
+            return MSG_ERROR_UNKNOWN_OPERATOR;
+    }
+}
+
+// 执行程序，计算为多项式表达式(运算与逐个元素计算时完全相同，结果逐位一致)，出错返回NULL
+Expression *programRunExpression(const Program *program, CalcError *error) {
+    const unsigned char *code = programCode(program);
+    int numExpressions = 0;
+    int constantIndex = 0;
+    Expression *expressionStack = (Expression *) calcMalloc((program->maxDepth + 1) * sizeof(Expression));
+    for (int i = 0; i < program->numInstructions; i++) {
+        Opcode opcode = (Opcode) code[i];
+        switch (opcode) {
+            case OP_PUSH_CONST:
+            case OP_PUSH_X: {
+                // 转换为表达式入栈(栈中直接保存结构体，释放新建的结构体本身，保留系数数组)
+                Element element = {VARIABLE, 0, NULL, 0};
+                if (opcode == OP_PUSH_CONST) {
+                    element.type = NUMBER;
+                    element.value = program->constants[constantIndex++];
+                }
+                Expression *elementExpression = elementToExpression(&element);
+                expressionStack[numExpressions++] = *elementExpression;
+                calcFree(elementExpression);
+                // log：输出表达式
+                if (debugTrace()) {
+                    printf("Stack an expression:");
+                    expressionPrint(&expressionStack[numExpressions - 1]);
+                    printf("\n");
+                }
+                break;
+            }
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_MOD:
+            case OP_POWER: {
+                Operator operator = {opcodeSymbol(opcode), 0};
+                // log：输出操作符
+                if (debugTrace()) {
+                    printf("Pop an operator:");
+                    operatorPrint(&operator);
+                    printf("\n");
+                }
+                // 弹出两个表达式计算，结果入栈；每一步之前检查期限
+                if (calcDeadlineExceeded()) {
+                    calcErrorSet(error, MSG_ERROR_TIMEOUT, NULL);
+                    expressionStackFree(expressionStack, numExpressions, NULL);
+                    return NULL;
+                }
+                if (!expressionStackApply(expressionStack, &numExpressions, &operator, error)) {
+                    expressionStackFree(expressionStack, numExpressions, NULL);
+                    return NULL;
+                }
+                break;
+            }
+            default:
+                calcErrorSet(error, opcodeError(opcode), NULL);
+                expressionStackFree(expressionStack, numExpressions, NULL);
+                return NULL;
+        }
+    }
+    // 返回栈中唯一的表达式(直接接管其系数数组，不复制)
+    Expression *expressionResult = (Expression *) calcMalloc(sizeof(Expression));
+    *expressionResult = expressionStack[0];
+    // 简化结果
+    expressionResult = expressionSimplify(expressionResult);
+    // 释放栈内存
+    expressionStackFree(expressionStack, 0, NULL);
+    return expressionResult;
+}
+
+// 表达式计算(括号优先级改变，操作符和变量常量入栈计算)：先编译为字节码程序，再执行程序计算为多项式表达式
+Expression *expressionCalculate(const Element *elements, const int numElements, CalcError *error) {
+    Program *program = programCompile(elements, numElements);
+    Expression *expressionResult = programRunExpression(program, error);
+    calcFree(program);
+    return expressionResult;
+}
+
+// 下面为纯数值计算的相关函数(计算式不含未知数，每个值都是常数，不需要新建多项式表达式)
+// 数值栈和操作符栈都是固定大小的栈上数组，计算过程不分配任何内存
+// 每种运算的写法与常数表达式的对应运算完全一致(包括0+a*b这样的累加形式)，结果与多项式计算逐位相同
+
+// 常数的整数次幂，与常数表达式的快速幂(expressionPowerQuick)相同的二分递归顺序
+long double scalarPower(const long double value, const int powerCount) {
+    if (powerCount == 0) {
+        return 1;
+    }
+    if (powerCount == 1) {
+        return value;
+    }
+    long double half = scalarPower(value, powerCount / 2);
+    long double result = 0 + half * half;
+    if (powerCount % 2 == 1) {
+        result = 0 + result * value;
+    }
+    return result;
+}
+
+// 弹出栈顶的两个数值，用操作符计算后将结果压回栈中，出错返回0(错误码与表达式运算相同)
+int scalarStackApply(long double *valueStack, int *numValues, const char symbol, CalcError *error) {
+    if (*numValues < 2) {
+        calcErrorSet(error, MSG_ERROR_STACK_EMPTY, NULL);
+        return 0;
+    }
+    long double value1 = valueStack[*numValues - 2];
+    long double value2 = valueStack[*numValues - 1];
+    long double value;
+    switch (symbol) {
+        case '+':
+            value = (0 + value1) + value2;
+            break;
+        case '-':
+            value = (0 + value1) - value2;
+            break;
+        case '*':
+            value = 0 + value1 * value2;
+            break;
+        case '/':
+            if (value2 == 0) {
+                calcErrorSet(error, MSG_ERROR_DIVIDE_BY_ZERO, NULL);
+                return 0;
+            }
+            value = value1 / value2;
+            break;
+        case '%':
+            if (value2 == 0) {
+                calcErrorSet(error, MSG_ERROR_MODULO_BY_ZERO, NULL);
+                return 0;
+            }
+            value = value1 - (int) (value1 / value2) * value2;
+            break;
+        case '^':
+            if (value2 < 0) {
+                calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_POSITIVE, NULL);
+                return 0;
+            }
+            if (value2 != (int) value2) {
+                calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_INTEGER, NULL);
+                return 0;
+            }
+            value = scalarPower(value1, (int) value2);
+            break;
+        default:
+            calcErrorSet(error, MSG_ERROR_UNKNOWN_OPERATOR, NULL);
+            return 0;
+    }
+    (*numValues)--;
+    valueStack[*numValues - 1] = value;
+    return 1;
+}
+
+// 纯数值计算：与expressionCalculate相同的优先级规则(括号优先级加4，操作符单调栈)，直接在数值上运算
+// 双精度模式下每个常数和每一步的结果都舍入到double
+// 成功返回1并把结果写入result，出错返回0，栈空间不足(括号嵌套过深)或含有未知数时返回-1，此时需改用多项式计算
+int scalarCalculate(const Element *elements, const int numElements, const Precision precision, long double *result,
+                    CalcError *error) {
+    long double valueStack[SCALAR_STACK_SIZE];
+    int numValues = 0;
+    Operator operatorStack[SCALAR_STACK_SIZE];
+    int numOperators = 0;
+    int currentPlusPriority = 0; // 当前的额外优先级
+    for (int i = 0; i < numElements; i++) {
+        switch (elements[i].type) {
+            case NUMBER:
+                if (numValues == SCALAR_STACK_SIZE) {
+                    return -1;
+                }
+                valueStack[numValues++] = precisionRound(elements[i].value, precision);
+                break;
+            case OPERATOR: {
+                // 如果是左括号，接下来的算符的优先级加4
+                if (elements[i].value == '(') {
+                    currentPlusPriority += 4;
+                    break;
+                }
+                // 如果是右括号，接下来的算符的优先级减4
+                if (elements[i].value == ')') {
+                    currentPlusPriority -= 4;
+                    break;
+                }
+                // 弹出栈顶优先级不低于当前运算符的运算符并计算，然后当前运算符入栈
+                int currentPriority = operatorPriority((char) elements[i].value);
+                while (numOperators > 0 &&
+                       operatorStack[numOperators - 1].priority >= currentPriority + currentPlusPriority) {
+                    numOperators--;
+                    if (!scalarStackApply(valueStack, &numValues, operatorStack[numOperators].symbol, error)) {
+                        return 0;
+                    }
+                    valueStack[numValues - 1] = precisionRound(valueStack[numValues - 1], precision);
+                }
+                if (numOperators == SCALAR_STACK_SIZE) {
+                    return -1;
+                }
+                operatorStack[numOperators].symbol = (char) elements[i].value;
+                operatorStack[numOperators].priority = currentPriority + currentPlusPriority;
+                numOperators++;
+                break;
+            }
+            case VARIABLE:
+                return -1;
+            default:
+                // 不可能到达此分支，报错
+                calcErrorSet(error, MSG_ERROR_UNKNOWN_ELEMENT, NULL);
+                return 0;
+        }
+    }
+    // 弹出剩余的操作符并计算
+    while (numOperators > 0) {
+        numOperators--;
+        if (!scalarStackApply(valueStack, &numValues, operatorStack[numOperators].symbol, error)) {
+            return 0;
+        }
+        valueStack[numValues - 1] = precisionRound(valueStack[numValues - 1], precision);
+    }
+    if (numValues != 1) {
+        calcErrorSet(error, MSG_ERROR_STACK_COUNT, NULL);
+        return 0;
+    }
+    *result = valueStack[0];
+    return 1;
+}
+
+// 下面为静态估计的相关函数：不展开多项式，只按运算规则推算程序结果的次幂数、非零项和计算量
+// 用于在展开之前判断计算能否完成(一定会因次幂数过大而报错的方程直接报错)，以及服务端的准入控制
+
+// 推算时次幂数上界的上限，避免溢出
+const long long ESTIMATE_MAX_POWER_COUNT = 1LL << 40;
+// 系数绝对值的log2低于该值时认为可能下溢为0(long double最小的正规数为2^-16382)
+const double ESTIMATE_MIN_LOG2 = -16000;
+// 无穷大和NaN的log2按该值处理
+const double ESTIMATE_INFINITE_LOG2 = 16384;
+// 求根的代价 = 该系数 * 次幂数^2 * 非零项数(导数序列共有次幂数层，每层求值的次数与次幂数相当)，按实测的耗时定标
+const double ESTIMATE_ROOT_COST_FACTOR = 0.6;
+
+// 栈中一个值(多项式)的估计
+typedef struct {
+    long long powerCount; // 次幂数的上界
+    int exact; // 次幂数是否恰好为powerCount(最高次项一定不为0)
+    double leadLog2; // exact时最高次项系数的绝对值不小于2^leadLog2
+    double numTerms; // 非零项数的上界
+    int isConstant; // 是否为只由常数运算得到的常数，此时value与实际计算的值逐位相同
+    long double value;
+    // full时lowPower到powerCount次的各项都一定不为0(更低次的项都为0)：lowPower次项的符号为sign，
+    // 相邻两项的符号之比为alternate(1或-1，只有一项时为0)，各项系数的绝对值不小于2^minLog2
+    int full;
+    long long lowPower;
+    int sign;
+    int alternate;
+    double minLog2;
+} EstimateValue;
+
+// 静态估计的结果(代价的单位为一次long double系数乘加，大约1纳秒)
+typedef struct {
+    long long powerCount; // 结果次幂数的上界
+    int exact; // 结果的次幂数是否恰好为powerCount
+    int dense; // 结果是否一定为稠密表示(各项都不为0，非零项多到不适合稀疏表示)
+    int mayFail; // 是否可能因次幂数以外的原因报错(除数、模数、指数不是已知的常数，编译时发现的错误等)
+    long long maxPowerCount; // 所有中间结果次幂数上界的最大值
+    long long overflowPowerCount; // 两个操作数次幂数都确定的乘法和求幂中，结果次幂数的最大值
+    double expandCost; // 展开多项式的代价
+    double rootCost; // 求根的代价(计算式为0)
+} CalcEstimate;
+
+// 非零有限数绝对值的log2的整数部分(向下取整，不使用数学库)，无穷大和NaN返回ESTIMATE_INFINITE_LOG2
+double estimateLog2(long double value) {
+    value = lfabs(value);
+    if (value - value != 0) {
+        return ESTIMATE_INFINITE_LOG2;
+    }
+    int exponent = 0;
+    while (value >= 0x1p64L) {
+        value *= 0x1p-64L;
+        exponent += 64;
+    }
+    while (value >= 2) {
+        value *= 0.5L;
+        exponent++;
+    }
+    while (value < 0x1p-64L) {
+        value *= 0x1p64L;
+        exponent -= 64;
+    }
+    while (value < 1) {
+        value *= 2;
+        exponent--;
+    }
+    return exponent;
+}
+
+// 常数的估计
+void estimateConstant(const long double value, EstimateValue *result) {
+    memset(result, 0, sizeof(EstimateValue));
+    result->isConstant = 1;
+    result->value = value;
+    result->exact = value != 0;
+    result->numTerms = value != 0;
+    result->leadLog2 = value != 0 ? estimateLog2(value) : 0;
+    // 有限的非零常数才有确定的符号
+    if (value != 0 && value - value == 0) {
+        result->full = 1;
+        result->sign = value > 0 ? 1 : -1;
+        result->minLog2 = result->leadLog2;
+    }
+}
+
+// 符号模式中与lowPower相距distance次的项的符号
+int estimatePatternSign(const int sign, const int alternate, const long long distance) {
+    return distance % 2 == 1 && alternate < 0 ? -sign : sign;
+}
+
+// 加减 a + sign * b 的符号模式：两个操作数的非零项相接或重叠，且重叠的项符号相同(相加不会相消)时结果的各项都不为0
+void estimateAddPattern(const EstimateValue *a, const EstimateValue *b, const int sign, EstimateValue *result) {
+    if (!a->full || !b->full || a->lowPower > b->powerCount + 1 || b->lowPower > a->powerCount + 1) {
+        return;
+    }
+    if (a->alternate != 0 && b->alternate != 0 && a->alternate != b->alternate) {
+        return;
+    }
+    int signA = a->sign;
+    int signB = b->sign * sign;
+    int alternate = a->alternate != 0 ? a->alternate : b->alternate;
+    if (alternate == 0 && a->lowPower != b->lowPower) {
+        // 两个操作数都只有一项且次幂相邻，由两项的符号决定
+        alternate = signA * signB;
+    }
+    long long lowPower = a->lowPower < b->lowPower ? a->lowPower : b->lowPower;
+    int lowSign = a->lowPower == lowPower ? signA : signB;
+    if (estimatePatternSign(lowSign, alternate, a->lowPower - lowPower) != signA ||
+        estimatePatternSign(lowSign, alternate, b->lowPower - lowPower) != signB) {
+        return;
+    }
+    result->full = 1;
+    result->lowPower = lowPower;
+    result->sign = lowSign;
+    result->alternate = result->powerCount > lowPower ? alternate : 0;
+    result->minLog2 = a->minLog2 < b->minLog2 ? a->minLog2 : b->minLog2;
+}
+
+// 快速幂结果的非零项数上界：不超过次幂数+1，也不超过底数非零项数的powerNum次方
+double estimatePowerTerms(const EstimateValue *base, const long long powerNum) {
+    double bound = (double) base->powerCount * powerNum + 1;
+    double terms = 1;
+    if (base->numTerms > 1) {
+        for (long long i = 0; i < powerNum && terms < bound; i++) {
+            terms *= base->numTerms;
+        }
+    }
+    return terms < bound ? terms : bound;
+}
+
+// 快速幂的代价：与expressionPowerQuick相同的二分递归，每层一次平方，幂次为奇数时再乘一次底数；至多两项时按二项式直接展开
+double estimatePowerCost(const EstimateValue *base, const int powerNum) {
+    if (powerNum <= 1) {
+        return base->numTerms;
+    }
+    if (base->numTerms <= 2) {
+        return powerNum + 1;
+    }
+    double half = estimatePowerTerms(base, powerNum / 2);
+    double cost = estimatePowerCost(base, powerNum / 2) + half * half;
+    if (powerNum % 2 == 1) {
+        cost += estimatePowerTerms(base, powerNum - 1) * base->numTerms;
+    }
+    return cost;
+}
+
+// 两个操作数计算后的估计(不是已知常数的情况)，代价和可能的报错记入estimate
+/*
+ 次幂数：加减取较大者，只有两者不同(或各项都不为0)时才能确定；乘法为两者之和，求幂为底数的幂次倍
+ 各项都不为0的模式：乘积的每一项都是符号相同的若干项之和，不会相消；除以常数只改变符号；系数过小时放弃(可能下溢为0)
+*/
+void estimateApply(const Opcode opcode, const EstimateValue *a, const EstimateValue *b, EstimateValue *result,
+                   CalcEstimate *estimate) {
+    memset(result, 0, sizeof(EstimateValue));
+    switch (opcode) {
+        case OP_ADD:
+        case OP_SUBTRACT: {
+            int sign = opcode == OP_ADD ? 1 : -1;
+            // 加减常数0不改变另一个操作数(减法时变号)
+            if (b->isConstant && b->value == 0) {
+                *result = *a;
+                break;
+            }
+            if (a->isConstant && a->value == 0) {
+                *result = *b;
+                result->sign *= sign;
+                break;
+            }
+            result->powerCount = a->powerCount > b->powerCount ? a->powerCount : b->powerCount;
+            if (a->powerCount != b->powerCount) {
+                const EstimateValue *higher = a->powerCount > b->powerCount ? a : b;
+                result->exact = higher->exact;
+                result->leadLog2 = higher->leadLog2;
+            }
+            result->numTerms = a->numTerms + b->numTerms;
+            estimateAddPattern(a, b, sign, result);
+            estimate->expandCost += a->numTerms + b->numTerms;
+            break;
+        }
+        case OP_MULTIPLY:
+            result->powerCount = a->powerCount + b->powerCount;
+            result->exact = a->exact && b->exact && a->leadLog2 + b->leadLog2 >= ESTIMATE_MIN_LOG2;
+            result->leadLog2 = a->leadLog2 + b->leadLog2;
+            result->numTerms = a->numTerms * b->numTerms;
+            if (a->exact && b->exact && result->powerCount > estimate->overflowPowerCount) {
+                estimate->overflowPowerCount = result->powerCount;
+            }
+            if (a->full && b->full && (a->alternate == 0 || b->alternate == 0 || a->alternate == b->alternate) &&
+                a->minLog2 + b->minLog2 >= ESTIMATE_MIN_LOG2) {
+                result->full = 1;
+                result->lowPower = a->lowPower + b->lowPower;
+                result->sign = a->sign * b->sign;
+                result->alternate = a->alternate != 0 ? a->alternate : b->alternate;
+                result->minLog2 = a->minLog2 + b->minLog2;
+            }
+            estimate->expandCost += a->numTerms * b->numTerms;
+            break;
+        case OP_DIVIDE:
+            // 除数必须为非零常数，否则可能报错
+            if (!b->isConstant || b->value == 0) {
+                estimate->mayFail = 1;
+                result->powerCount = a->powerCount;
+                result->numTerms = a->numTerms;
+                break;
+            }
+            *result = *a;
+            result->isConstant = 0;
+            // 除以无穷大或NaN的结果不确定是否为0
+            if (b->value - b->value != 0) {
+                result->exact = 0;
+                result->full = 0;
+                break;
+            }
+            result->leadLog2 = a->leadLog2 - estimateLog2(b->value) - 1;
+            result->exact = a->exact && result->leadLog2 >= ESTIMATE_MIN_LOG2;
+            result->minLog2 = a->minLog2 - estimateLog2(b->value) - 1;
+            result->full = a->full && result->minLog2 >= ESTIMATE_MIN_LOG2;
+            result->sign = b->value > 0 ? a->sign : -a->sign;
+            estimate->expandCost += a->numTerms;
+            break;
+        case OP_POWER: {
+            // 指数必须为非负整数常数，否则可能报错
+            if (!b->isConstant || b->value < 0 || b->value != (int) b->value) {
+                estimate->mayFail = 1;
+                result->powerCount = a->powerCount;
+                result->numTerms = a->numTerms;
+                break;
+            }
+            int powerNum = (int) b->value;
+            if (powerNum == 0) {
+                estimateConstant(1, result);
+                break;
+            }
+            result->powerCount = a->powerCount > ESTIMATE_MAX_POWER_COUNT / powerNum ?
+                                 ESTIMATE_MAX_POWER_COUNT : a->powerCount * powerNum;
+            result->leadLog2 = a->leadLog2 * powerNum;
+            result->exact = a->exact && result->leadLog2 >= ESTIMATE_MIN_LOG2;
+            result->numTerms = estimatePowerTerms(a, powerNum);
+            if (a->exact && result->powerCount > estimate->overflowPowerCount) {
+                estimate->overflowPowerCount = result->powerCount;
+            }
+            if (a->full && a->minLog2 * powerNum >= ESTIMATE_MIN_LOG2) {
+                result->full = 1;
+                result->lowPower = a->lowPower * powerNum;
+                result->sign = a->sign < 0 && powerNum % 2 == 1 ? -1 : 1;
+                result->alternate = a->alternate;
+                result->minLog2 = a->minLog2 * powerNum;
+            }
+            estimate->expandCost += estimatePowerCost(a, powerNum);
+            break;
+        }
+        default:
+            // 取模的被除数必须为常数，两个操作数都是已知常数的情况已在调用前计算
+            estimate->mayFail = 1;
+            result->powerCount = a->powerCount;
+            result->numTerms = a->numTerms;
+            break;
+    }
+    if (result->powerCount > ESTIMATE_MAX_POWER_COUNT) {
+        result->powerCount = ESTIMATE_MAX_POWER_COUNT;
+    }
+    // 各项都不为0时次幂数和非零项数都是确定的
+    if (result->full) {
+        result->exact = 1;
+        result->numTerms = (double) (result->powerCount - result->lowPower + 1);
+    } else if (result->numTerms > (double) result->powerCount + 1) {
+        result->numTerms = (double) result->powerCount + 1;
+    }
+    if (result->powerCount > estimate->maxPowerCount) {
+        estimate->maxPowerCount = result->powerCount;
+    }
+}
+
+// 静态估计程序的结果和展开的代价(不展开多项式，也不检查期限)；求根的代价按结果的次幂数和非零项数估计
+void programEstimate(const Program *program, CalcEstimate *estimate) {
+    const unsigned char *code = programCode(program);
+    int depth = 0;
+    int constantIndex = 0;
+    CalcError error;
+    EstimateValue *stack = (EstimateValue *) calcMalloc((program->maxDepth + 1) * sizeof(EstimateValue));
+    memset(estimate, 0, sizeof(CalcEstimate));
+    for (int i = 0; i < program->numInstructions; i++) {
+        Opcode opcode = (Opcode) code[i];
+        if (opcode == OP_PUSH_CONST) {
+            estimateConstant(program->constants[constantIndex++], &stack[depth++]);
+            continue;
+        }
+        if (opcode == OP_PUSH_X) {
+            memset(&stack[depth], 0, sizeof(EstimateValue));
+            stack[depth].powerCount = 1;
+            stack[depth].exact = 1;
+            stack[depth].numTerms = 1;
+            stack[depth].full = 1;
+            stack[depth].lowPower = 1;
+            stack[depth].sign = 1;
+            depth++;
+            continue;
+        }
+        if (opcode > OP_POWER) {
+            estimate->mayFail = 1;
+            break;
+        }
+        EstimateValue *a = &stack[depth - 2];
+        EstimateValue *b = &stack[depth - 1];
+        depth--;
+        // 两个已知常数按数值运算的规则计算(与多项式计算逐位相同)，出错的运算记为可能报错
+        if (a->isConstant && b->isConstant) {
+            long double values[2] = {a->value, b->value};
+            int numValues = 2;
+            if (scalarStackApply(values, &numValues, opcodeSymbol(opcode), &error)) {
+                estimateConstant(values[0], a);
+            } else {
+                estimate->mayFail = 1;
+                estimateConstant(0, a);
+                a->isConstant = 0;
+            }
+            continue;
+        }
+        EstimateValue result;
+        estimateApply(opcode, a, b, &result, estimate);
+        *a = result;
+    }
+    if (depth >= 1) {
+        const EstimateValue *result = &stack[0];
+        estimate->powerCount = result->powerCount;
+        estimate->exact = result->exact;
+        estimate->dense = result->full &&
+                          !expressionShouldBeSparse(result->powerCount, result->powerCount - result->lowPower + 1);
+        estimate->rootCost = ESTIMATE_ROOT_COST_FACTOR * (double) result->powerCount * result->powerCount *
+                             result->numTerms;
+    } else {
+        estimate->mayFail = 1;
+    }
+    calcFree(stack);
+}
+
+// 根据估计判断计算一定会因次幂数过大而报错时，返回报错信息中的上限，不能确定时返回0
+/*
+ 只在没有其他报错可能时判断，保证与实际展开后的报错相同：
+ 两个操作数次幂数都确定的乘法或求幂达到上限时，展开过程中报错(inExpansion为1)；
+ 否则所有中间结果都低于上限、结果一定为稠密表示且次幂数达到稠密表示的上限时，最终结果的检查报错(inExpansion为0)
+*/
+int estimatePowerLimit(const CalcEstimate *estimate, const CalcConfig *config, int *inExpansion) {
+    if (estimate->mayFail) {
+        return 0;
+    }
+    int limit = config->maxPowerCount > config->maxSparsePowerCount ? config->maxPowerCount
+                                                                      : config->maxSparsePowerCount;
+    if (estimate->overflowPowerCount >= limit) {
+        *inExpansion = 1;
+        return limit;
+    }
+    if (estimate->maxPowerCount < limit && estimate->exact && estimate->dense &&
+        estimate->powerCount >= config->maxPowerCount) {
+        *inExpansion = 0;
+        return config->maxPowerCount;
+    }
+    return 0;
+}
+
+// 表达式求值，表达式未知数代入后的值(令x=x_0)
+// 稀疏表示时只计算非零项，相邻两项之间未知数的幂次差用快速幂求出
+long double expressionEvaluate(const Expression *expression, const long double variableValue) {
+    long double result = 0;
+    if (expressionIsSparse(expression)) {
+        long double variableValuePower = 1;
+        int power = 0;
+        for (int k = 0; k < expression->numTerms; k++) {
+            variableValuePower *= lpowi(variableValue, expression->powers[k] - power);
+            power = expression->powers[k];
+            result += expression->factorValue[k] * variableValuePower;
+        }
+        return result;
+    }
+    long double variableValuePower = 1; // 记录未知数的幂次值
+    for (int i = 0; i <= expression->powerCount; i++) {
+        result += expression->factorValue[i] * variableValuePower;
+        variableValuePower *= variableValue;
+    }
+    return result;
+}
+
+// 下面为批量求值的相关函数(一次求出表达式在多个点处的值，用于求根时的区间端点和求值表)
+// 一次同时求值的点数：x87没有向量指令，但同时推进多个互不相关的Horner递推可以掩盖乘加的延迟
+#define EVALUATE_BATCH_WIDTH 4
+
+// 批量求值(long double)：results[i] = expression(variableValues[i])，使用Horner法从最高次项向低次项递推
+// 稀疏表示时相邻两个非零项之间乘以x的次幂差：p(x) = p_high(x)*x^gap + a
+void expressionEvaluateBatch(const Expression *expression, const long double *variableValues, long double *results,
+                             const int count) {
+    int numTerms = expressionNumTerms(expression);
+    int i = 0;
+    if (!expressionIsSparse(expression)) {
+        const long double *factorValue = expression->factorValue;
+        int powerCount = expression->powerCount;
+        for (; i + EVALUATE_BATCH_WIDTH <= count; i += EVALUATE_BATCH_WIDTH) {
+            long double x0 = variableValues[i], x1 = variableValues[i + 1];
+            long double x2 = variableValues[i + 2], x3 = variableValues[i + 3];
+            long double value0 = factorValue[powerCount], value1 = value0, value2 = value0, value3 = value0;
+            for (int k = powerCount - 1; k >= 0; k--) {
+                value0 = value0 * x0 + factorValue[k];
+                value1 = value1 * x1 + factorValue[k];
+                value2 = value2 * x2 + factorValue[k];
+                value3 = value3 * x3 + factorValue[k];
+            }
+            results[i] = value0;
+            results[i + 1] = value1;
+            results[i + 2] = value2;
+            results[i + 3] = value3;
+        }
+    }
+    // 稀疏表示和剩余的点逐个求值
+    for (; i < count; i++) {
+        long double variableValue = variableValues[i];
+        long double value = expression->factorValue[numTerms - 1];
+        int power = expressionTermPower(expression, numTerms - 1);
+        for (int k = numTerms - 2; k >= -1; k--) {
+            int nextPower = k >= 0 ? expressionTermPower(expression, k) : 0;
+            if (power - nextPower == 1) {
+                value *= variableValue;
+            } else if (power > nextPower) {
+                value *= lpowi(variableValue, power - nextPower);
+            }
+            if (k >= 0) {
+                value += expression->factorValue[k];
+            }
+            power = nextPower;
+        }
+        results[i] = value;
+    }
+}
+
+// 双精度的Horner法内核：coefficients为稠密的系数数组(次幂从小到大)，对count个点求值
+typedef void (*HornerDoubleKernel)(const double *coefficients, int powerCount, const double *variableValues,
+                                   double *results, int count);
+
+// 通用内核(任何平台)
+void hornerDoubleGeneric(const double *coefficients, const int powerCount, const double *variableValues,
+                         double *results, const int count) {
+    for (int i = 0; i < count; i++) {
+        double value = coefficients[powerCount];
+        for (int k = powerCount - 1; k >= 0; k--) {
+            value = value * variableValues[i] + coefficients[k];
+        }
+        results[i] = value;
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// AVX2内核：每条指令同时处理4个点，乘加使用FMA(剩余不足4个的点也用FMA，保证每个点的结果与所在位置无关)
+__attribute__((target("avx2,fma")))
+void hornerDoubleAvx2(const double *coefficients, const int powerCount, const double *variableValues,
+                      double *results, const int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d x = _mm256_loadu_pd(variableValues + i);
+        __m256d value = _mm256_set1_pd(coefficients[powerCount]);
+        for (int k = powerCount - 1; k >= 0; k--) {
+            value = _mm256_fmadd_pd(value, x, _mm256_set1_pd(coefficients[k]));
+        }
+        _mm256_storeu_pd(results + i, value);
+    }
+    for (; i < count; i++) {
+        double value = coefficients[powerCount];
+        for (int k = powerCount - 1; k >= 0; k--) {
+            value = __builtin_fma(value, variableValues[i], coefficients[k]);
+        }
+        results[i] = value;
+    }
+}
+
+// AVX-512内核：每条指令同时处理8个点，剩余的点用掩码加载和存储
+__attribute__((target("avx512f")))
+void hornerDoubleAvx512(const double *coefficients, const int powerCount, const double *variableValues,
+                        double *results, const int count) {
+    for (int i = 0; i < count; i += 8) {
+        __mmask8 mask = count - i >= 8 ? (__mmask8) 0xFF : (__mmask8) ((1u << (count - i)) - 1);
+        __m512d x = _mm512_maskz_loadu_pd(mask, variableValues + i);
+        __m512d value = _mm512_set1_pd(coefficients[powerCount]);
+        for (int k = powerCount - 1; k >= 0; k--) {
+            value = _mm512_fmadd_pd(value, x, _mm512_set1_pd(coefficients[k]));
+        }
+        _mm512_mask_storeu_pd(results + i, mask, value);
+    }
+}
+#endif
+
+// 按当前CPU支持的指令集选择双精度内核
+HornerDoubleKernel hornerDoubleKernel() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return hornerDoubleAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return hornerDoubleAvx2;
+    }
+#endif
+    return hornerDoubleGeneric;
+}
+
+// 判断表达式的系数是否都在双精度的范围内(否则只能用long double求值)
+int expressionFitsDouble(const Expression *expression) {
+    for (int k = 0; k < expressionNumTerms(expression); k++) {
+        if (lfabs(expression->factorValue[k]) > DBL_MAX) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 批量求值(double)：稠密表示时按CPU支持的指令集使用AVX-512/AVX2内核，稀疏表示或系数超出双精度范围时逐点用long double求值
+void expressionEvaluateBatchDouble(const Expression *expression, const double *variableValues, double *results,
+                                   const int count) {
+    if (expressionIsSparse(expression) || !expressionFitsDouble(expression)) {
+        for (int i = 0; i < count; i++) {
+            long double variableValue = variableValues[i];
+            long double value;
+            expressionEvaluateBatch(expression, &variableValue, &value, 1);
+            results[i] = (double) value;
+        }
+        return;
+    }
+    double *coefficients = (double *) calcMalloc((expression->powerCount + 1) * sizeof(double));
+    for (int k = 0; k <= expression->powerCount; k++) {
+        coefficients[k] = (double) expression->factorValue[k];
+    }
+    hornerDoubleKernel()(coefficients, expression->powerCount, variableValues, results, count);
+    calcFree(coefficients);
+}
+
+// 表达式求导，a_(n-1)'=a_n*n
+Expression *expressionDerivative(const Expression *expression) {
+    // 稀疏表示时逐个非零项求导，结果仍为稀疏表示(次幂降低后不适合时转为稠密表示)
+    if (expressionIsSparse(expression)) {
+        Expression *expressionDerivative = expressionNewSparse(expression->numTerms);
+        for (int k = 0; k < expression->numTerms; k++) {
+            if (expression->powers[k] > 0) {
+                expressionSparseAppend(expressionDerivative, expression->powers[k] - 1,
+                                       expression->factorValue[k] * expression->powers[k]);
+            }
+        }
+        expressionAdjustForm(expressionDerivative);
+        return expressionDerivative;
+    }
+    // 求导
+    // 新建表达式，逐项求导
+    Expression *expressionDerivative = expressionNew(expression->powerCount - 1);
+    for (int i = 0; i <= expressionDerivative->powerCount; i++) {
+        expressionDerivative->factorValue[i] = expression->factorValue[i + 1] * (i + 1);
+    }
+    // 简化结果
+    expressionDerivative = expressionSimplify(expressionDerivative);
+    return expressionDerivative;
+}
+
+// 表达式及其导数同时求值(Horner法)，返回表达式的值，导数的值写入derivative
+// 求根时每次迭代只需一次求值即可同时得到牛顿法需要的函数值和导数值
+long double expressionEvaluateWithDerivative(const Expression *expression, const long double variableValue,
+                                             long double *derivative) {
+    int numTerms = expressionNumTerms(expression);
+    long double value = expression->factorValue[numTerms - 1];
+    long double derivativeValue = 0;
+    int power = expressionTermPower(expression, numTerms - 1);
+    // 从最高次项向低次项递推：p(x) = p_high(x)*x^gap + a，p'(x) = p_high'(x)*x^gap + p_high(x)*gap*x^(gap-1)
+    for (int k = numTerms - 2; k >= -1; k--) {
+        int nextPower = k >= 0 ? expressionTermPower(expression, k) : 0;
+        int gap = power - nextPower;
+        if (gap > 0) {
+            long double variableValueGapMinus1 = lpowi(variableValue, gap - 1);
+            derivativeValue = derivativeValue * variableValueGapMinus1 * variableValue + value * gap * variableValueGapMinus1;
+            value = value * variableValueGapMinus1 * variableValue;
+        }
+        if (k >= 0) {
+            value += expression->factorValue[k];
+        }
+        power = nextPower;
+    }
+    *derivative = derivativeValue;
+    return value;
+}
+
+// 判断x是否大于Cauchy根界R(R为 |an|*x^n = |a(n-1)|*x^(n-1)+...+|a0| 的唯一正根，所有根的绝对值都不超过R)
+// 两边同除以x^n以免溢出：|an| > sum |ai|/x^(n-i)
+int expressionAboveRootBound(const Expression *expression, const long double x) {
+    int numTerms = expressionNumTerms(expression);
+    long double inverse = 1 / x;
+    long double sum = 0;
+    for (int k = 0; k < numTerms - 1; k++) {
+        sum += lfabs(expression->factorValue[k]) *
+               lpowi(inverse, expression->powerCount - expressionTermPower(expression, k));
+    }
+    return lfabs(expression->factorValue[numTerms - 1]) > sum;
+}
+
+// 求根的上界：大于Cauchy根界R的最小的2的幂(不超过2R，比固定的区间紧得多)
+long double expressionRootBound(const Expression *expression) {
+    long double bound = 1;
+    if (expressionAboveRootBound(expression, bound)) {
+        while (bound > ROOT_THRESHOLD && expressionAboveRootBound(expression, bound / 2)) {
+            bound /= 2;
+        }
+    } else {
+        for (int i = 0; i < ROOT_BOUND_MAX_DOUBLINGS && !expressionAboveRootBound(expression, bound); i++) {
+            bound *= 2;
+        }
+    }
+    return bound;
+}
+
+// 判断表达式在x处的值是否与0无法区分(不超过求值时舍入误差的上界 2(n+1)*eps*sum|ai*x^i|)
+int expressionIsNumericallyZero(const Expression *expression, const long double x) {
+    long double value = 0;
+    long double magnitude = 0;
+    for (int k = 0; k < expressionNumTerms(expression); k++) {
+        long double term = expression->factorValue[k] * lpowi(x, expressionTermPower(expression, k));
+        value += term;
+        magnitude += lfabs(term);
+    }
+    return lfabs(value) <= 2 * (expression->powerCount + 1) * LDBL_EPSILON * magnitude;
+}
+
+// 批量判断表达式在各点处的值(values为已经求出的值)是否与0无法区分，误差上界同上，其中的sum|ai*x^i|
+// 即系数取绝对值的表达式在|x|处的值，也批量求出
+void expressionIsNumericallyZeroBatch(const Expression *expression, const long double *points,
+                                      const long double *values, int *zero, const int count) {
+    Expression *magnitudeExpression = expressionCopy(expression);
+    for (int k = 0; k < expressionNumTerms(magnitudeExpression); k++) {
+        magnitudeExpression->factorValue[k] = lfabs(magnitudeExpression->factorValue[k]);
+    }
+    long double *magnitudes = (long double *) calcMalloc(2 * count * sizeof(long double));
+    long double *absolutePoints = magnitudes + count;
+    for (int i = 0; i < count; i++) {
+        absolutePoints[i] = lfabs(points[i]);
+    }
+    expressionEvaluateBatch(magnitudeExpression, absolutePoints, magnitudes, count);
+    for (int i = 0; i < count; i++) {
+        zero[i] = lfabs(values[i]) <= 2 * (expression->powerCount + 1) * LDBL_EPSILON * magnitudes[i];
+    }
+    calcFree(magnitudes);
+    freeExpression(magnitudeExpression);
+}
+
+// 在区间(left, right)内求单调函数的根，要求左右端点的函数值异号
+// 安全牛顿法：牛顿迭代的结果落在当前区间外或收敛过慢时改用二分，区间每次迭代都会缩小，最多迭代ROOT_REFINE_MAX_ITERATIONS次
+long double expressionRefineRoot(const Expression *expression, long double left, long double right,
+                                 long double valueLeft) {
+    long double root = (left + right) / 2;
+    long double lastStep = right - left;
+    for (int iteration = 0; iteration < ROOT_REFINE_MAX_ITERATIONS; iteration++) {
+        long double derivative;
+        long double value = expressionEvaluateWithDerivative(expression, root, &derivative);
+        if (value == 0) {
+            return root;
+        }
+        // 用本次的函数值缩小区间
+        if ((value < 0) == (valueLeft < 0)) {
+            left = root;
+            valueLeft = value;
+        } else {
+            right = root;
+        }
+        // 牛顿步长落在区间外、不是有限值或者没有比上上步缩小一半时，改用二分
+        long double step = derivative != 0 ? value / derivative : 0;
+        long double next = root - step;
+        if (derivative == 0 || !(next > left && next < right) || lfabs(2 * step) > lfabs(lastStep)) {
+            next = (left + right) / 2;
+            step = root - next;
+        }
+        lastStep = step;
+        if (lfabs(next - root) <= ROOT_REFINE_TOLERANCE * (1 + lfabs(root)) || next == left || next == right) {
+            return next;
+        }
+        root = next;
+    }
+    return root;
+}
+
+// 合并相同的根：从begin开始的一组根(相邻两根的差值小于阈值，或者两根之间的值与0无法区分)的结束位置
+// (重根附近的舍入误差会产生多个相邻的根)
+int rootGroupEnd(const Expression *expression, const long double *roots, const int numRoots, const int begin) {
+    int end = begin + 1;
+    while (end < numRoots && (roots[end] - roots[end - 1] < ROOT_THRESHOLD ||
+                              expressionIsNumericallyZero(expression, (roots[end - 1] + roots[end]) / 2))) {
+        end++;
+    }
+    return end;
+}
+
+// 一组根合并后的值：取平均值，绝对值小于阈值的根视为0
+long double rootGroupValue(const long double *roots, const int begin, const int end) {
+    long double sum = roots[begin];
+    for (int i = begin + 1; i < end; i++) {
+        sum += roots[i];
+    }
+    long double root = sum / (end - begin);
+    return lfabs(root) < ROOT_THRESHOLD ? 0 : root;
+}
+
+// 流式输出已经确定的根：从*begin开始的一组根后面已有不与它合并的根，或者已经求出全部的根(complete)时，
+// 这一组合并后的值不会再变，交给当前的输出流
+void rootStreamEmit(const Expression *expression, const long double *roots, const int numRoots, int *begin,
+                    const int complete) {
+    while (*begin < numRoots) {
+        int end = rootGroupEnd(expression, roots, numRoots, *begin);
+        if (end == numRoots && !complete) {
+            return;
+        }
+        currentResultStream->onRoot(currentResultStream->arg, rootGroupValue(roots, *begin, end));
+        currentResultStream->numRoots++;
+        *begin = end;
+    }
+}
+
+// 表达式求根：导数序列逐层隔离根，然后安全牛顿法求出每个根
+/*
+ 相邻两个极值点(导数的根)之间函数单调，至多有一个根，端点值异号时有且只有一个根
+ 因此自底向上处理导数序列：n-1阶导数为一次式，其根直接求出；
+ k阶导数的根把 [-B, B] 分为若干单调区间，在其中求出k-1阶导数的根，直到原表达式
+ B为原表达式的根界，由高斯-卢卡斯定理，各阶导数的根也都在 [-B, B] 内
+ 各阶导数除以其最大系数的绝对值归一化(不改变根)，以免高次多项式的导数系数(n!量级)溢出
+ 极值点处的值与0无法区分时(如重根)也作为这一层的根，重根的位置由更高阶导数的单根逐层传递下来，不因舍入误差偏移
+ 整个过程没有递归，每个单调区间的求值次数有上限
+*/
+long double *expressionFindRoot(const Expression *expression, int *numRoots) {
+    // 求根
+    int powerCount = expression->powerCount;
+    if (currentResultStream != NULL) {
+        currentResultStream->numRoots = 0;
+    }
+    // 如果表达式阶数为0，则返回空列表
+    if (powerCount == 0) {
+        *numRoots = 0;
+        return NULL;
+    }
+    // 如果表达式阶数为1，则返回列表(-表达式.常数项/表达式.一次项)
+    if (powerCount == 1) {
+        *numRoots = 1;
+        long double *roots = (long double *) calcMalloc(sizeof(long double));
+        roots[0] = -expression->factorValue[0] / expression->factorValue[1];
+        if (lfabs(roots[0]) < ROOT_THRESHOLD) roots[0] = 0;
+        if (currentResultStream != NULL) {
+            int streamed = 0;
+            rootStreamEmit(expression, roots, 1, &streamed, 1);
+        }
+        return roots;
+    }
+    long double bound = expressionRootBound(expression);
+    if (bound > ROOT_BOUND_MAX) {
+        bound = ROOT_BOUND_MAX;
+    }
+    // 求出导数序列：derivatives[k]为归一化的k阶导数(derivatives[0]为原表达式本身，不归一化)，直到一次式为止
+    Expression **derivatives = (Expression **) calcMalloc(powerCount * sizeof(Expression *));
+    derivatives[0] = (Expression *) expression;
+    int numLevels = 1;
+    while (numLevels < powerCount && derivatives[numLevels - 1]->powerCount > 1) {
+        Expression *derivative = expressionDerivative(derivatives[numLevels - 1]);
+        long double maxValue = 0;
+        for (int k = 0; k < expressionNumTerms(derivative); k++) {
+            if (lfabs(derivative->factorValue[k]) > maxValue) {
+                maxValue = lfabs(derivative->factorValue[k]);
+            }
+        }
+        for (int k = 0; k < expressionNumTerms(derivative); k++) {
+            derivative->factorValue[k] /= maxValue;
+        }
+        derivatives[numLevels++] = derivative;
+    }
+    // 最高阶的导数为一次式，直接求根
+    Expression *linear = derivatives[numLevels - 1];
+    long double *criticalPoints = (long double *) calcMalloc(sizeof(long double));
+    int numCriticalPoints = 1;
+    criticalPoints[0] = -linear->factorValue[0] / linear->factorValue[1];
+    // 自底向上逐层求根，上一层的根即为这一层的极值点
+    long double *roots = NULL;
+    int numRootsNew = 0;
+    // 流式输出时，原表达式的根中已经输出的个数
+    int streamed = 0;
+    // 超过期限时不再继续求根
+    for (int level = numLevels - 2; level >= 0 && !calcDeadlineExceeded(); level--) {
+        const Expression *current = derivatives[level];
+        // 端点依次为 -B, 极值点..., B，每个端点只求一次值
+        int numPoints = numCriticalPoints + 2;
+        long double *points = (long double *) calcMalloc(numPoints * sizeof(long double));
+        long double *values = (long double *) calcMalloc(numPoints * sizeof(long double));
+        points[0] = -bound;
+        for (int i = 0; i < numCriticalPoints; i++) {
+            points[i + 1] = criticalPoints[i];
+        }
+        points[numPoints - 1] = bound;
+        expressionEvaluateBatch(current, points, values, numPoints);
+        // 每个极值点至多贡献一个根，每个单调区间至多一个根
+        roots = (long double *) calcMalloc((2 * numPoints) * sizeof(long double));
+        numRootsNew = 0;
+        // 极值点处的值与0无法区分时即为这一层的根(重根)，周围的候选根由rootGroupEnd合并；原表达式另外沿用固定的阈值
+        // 与0无法区分的端点的符号不可靠(如高次展开式的舍入误差)，记为0，不用于判断异号，
+        // 因此重根附近不会再求出多余的根，重根的位置由更高阶导数的单根逐层精确传递下来
+        int *zero = (int *) calcMalloc(numPoints * sizeof(int));
+        expressionIsNumericallyZeroBatch(current, points, values, zero, numPoints);
+        int *signs = (int *) calcMalloc(numPoints * sizeof(int));
+        for (int i = 0; i < numPoints; i++) {
+            signs[i] = zero[i] ? 0 : values[i] > 0 ? 1 : values[i] < 0 ? -1 : 0;
+        }
+        for (int i = 0; i < numPoints && !calcDeadlineExceeded(); i++) {
+            if (i > 0 && i < numPoints - 1 && (zero[i] || (level == 0 && lfabs(values[i]) <= ROOT_THRESHOLD))) {
+                roots[numRootsNew++] = points[i];
+            }
+            // 区间两端异号，区间内有且只有一个根
+            if (i + 1 < numPoints && signs[i] * signs[i + 1] < 0) {
+                roots[numRootsNew++] = expressionRefineRoot(current, points[i], points[i + 1], values[i]);
+            }
+            // 原表达式的根按从小到大的顺序求出，之后的根不会再与前面已经分开的一组合并
+            if (level == 0 && currentResultStream != NULL) {
+                rootStreamEmit(expression, roots, numRootsNew, &streamed, 0);
+            }
+        }
+        calcFree(points);
+        calcFree(values);
+        calcFree(signs);
+        calcFree(zero);
+        calcFree(criticalPoints);
+        // 这一层的根即为下一层的极值点(没有根时下一层在整个区间上单调)
+        criticalPoints = roots;
+        numCriticalPoints = numRootsNew;
+    }
+    // 超过期限：丢弃已求出的部分结果(此时criticalPoints即为roots，或者是还没有求过任何一层时一次式的根)
+    if (calcDeadlineExceeded()) {
+        calcFree(criticalPoints);
+        roots = NULL;
+        numRootsNew = 0;
+    }
+    // 输出还没有输出的根(超过期限时已经输出的部分不再撤回)
+    if (currentResultStream != NULL) {
+        rootStreamEmit(expression, roots, numRootsNew, &streamed, 1);
+    }
+    // 合并相同的根，合并后取平均值
+    int numMerged = 0;
+    for (int i = 0; i < numRootsNew;) {
+        int j = rootGroupEnd(expression, roots, numRootsNew, i);
+        roots[numMerged++] = rootGroupValue(roots, i, j);
+        i = j;
+    }
+    numRootsNew = numMerged;
+    // log：输出根
+    if (debugTrace()) {
+        printf("Roots:");
+        for (int i = 0; i < numRootsNew; i++) {
+            printf("%Lf  ", roots[i]);
+        }
+    }
+    // 释放各阶导数的内存
+    for (int level = 1; level < numLevels; level++) {
+        freeExpression(derivatives[level]);
+    }
+    calcFree(derivatives);
+    // 返回结果列表
+    *numRoots = numRootsNew;
+    return roots;
+}
+
+// 下面为双精度模式(PRECISION_DOUBLE)相关的结构体和函数
+// 方程直接展开为double系数的稠密多项式，求根也全程使用double：端点和误差上界用双精度的Horner内核(AVX-512/AVX2)批量求值，
+// 与0无法区分的判断按DBL_EPSILON；次幂数达到稠密表示的上限或系数溢出时放弃，退回long double计算
+typedef struct {
+    int powerCount;
+    double *factorValue; // 系数，次幂数从小到大
+} DoublePolynomial;
+
+// 新建多项式，系数全为0
+DoublePolynomial *doublePolynomialNew(const int powerCount) {
+    DoublePolynomial *polynomial = (DoublePolynomial *) calcMalloc(sizeof(DoublePolynomial));
+    polynomial->powerCount = powerCount;
+    polynomial->factorValue = (double *) calcMalloc((powerCount + 1) * sizeof(double));
+    memset(polynomial->factorValue, 0, (powerCount + 1) * sizeof(double));
+    return polynomial;
+}
+
+void freeDoublePolynomial(DoublePolynomial *polynomial) {
+    if (polynomial == NULL) {
+        return;
+    }
+    calcFree(polynomial->factorValue);
+    calcFree(polynomial);
+}
+
+// 去掉最高次的0系数
+DoublePolynomial *doublePolynomialSimplify(DoublePolynomial *polynomial) {
+    while (polynomial->powerCount > 0 && polynomial->factorValue[polynomial->powerCount] == 0) {
+        polynomial->powerCount--;
+    }
+    return polynomial;
+}
+
+// 加减：polynomial1 + sign * polynomial2
+DoublePolynomial *doublePolynomialAdd(const DoublePolynomial *polynomial1, const DoublePolynomial *polynomial2,
+                                      const int sign) {
+    int powerCount =
+            polynomial1->powerCount > polynomial2->powerCount ? polynomial1->powerCount : polynomial2->powerCount;
+    DoublePolynomial *polynomial = doublePolynomialNew(powerCount);
+    for (int i = 0; i <= powerCount; i++) {
+        double value = i <= polynomial1->powerCount ? polynomial1->factorValue[i] : 0;
+        if (i <= polynomial2->powerCount) {
+            value = sign > 0 ? value + polynomial2->factorValue[i] : value - polynomial2->factorValue[i];
+        }
+        polynomial->factorValue[i] = value;
+    }
+    return doublePolynomialSimplify(polynomial);
+}
+
+// 乘法(逐项相乘，稠密表示的次幂数有上限，不需要Karatsuba)
+DoublePolynomial *doublePolynomialMultiply(const DoublePolynomial *polynomial1, const DoublePolynomial *polynomial2) {
+    DoublePolynomial *polynomial = doublePolynomialNew(polynomial1->powerCount + polynomial2->powerCount);
+    for (int i = 0; i <= polynomial1->powerCount; i++) {
+        double value1 = polynomial1->factorValue[i];
+        for (int j = 0; j <= polynomial2->powerCount; j++) {
+            polynomial->factorValue[i + j] += value1 * polynomial2->factorValue[j];
+        }
+    }
+    return doublePolynomialSimplify(polynomial);
+}
+
+// 判断多项式是否为0
+int doublePolynomialIsZero(const DoublePolynomial *polynomial) {
+    return polynomial->powerCount == 0 && polynomial->factorValue[0] == 0;
+}
+
+// 执行程序，展开为double系数的多项式(常数即程序的常数表，解析时已舍入到double)：成功返回1并写入result；
+// 出错返回0，错误码与long double计算相同；次幂数达到稠密表示的上限、系数不是有限值或下溢时返回-1
+// (乘除法的最高次项不会相消，它下溢为0会改变多项式的次数，long double的指数范围更大，不会出现这种情况)
+int programRunDoublePolynomial(const Program *program, DoublePolynomial **result, CalcError *error) {
+    const unsigned char *code = programCode(program);
+    int depth = 0;
+    int constantIndex = 0;
+    int ok = 1;
+    DoublePolynomial **stack = (DoublePolynomial **) calcMalloc((program->maxDepth + 1) * sizeof(DoublePolynomial *));
+    for (int i = 0; i < program->numInstructions && ok == 1; i++) {
+        Opcode opcode = (Opcode) code[i];
+        if (opcode == OP_PUSH_CONST || opcode == OP_PUSH_X) {
+            DoublePolynomial *polynomial = doublePolynomialNew(opcode == OP_PUSH_X ? 1 : 0);
+            if (opcode == OP_PUSH_X) {
+                polynomial->factorValue[1] = 1;
+            } else {
+                polynomial->factorValue[0] = (double) program->constants[constantIndex++];
+            }
+            stack[depth++] = polynomial;
+            continue;
+        }
+        if (opcode > OP_POWER) {
+            calcErrorSet(error, opcodeError(opcode), NULL);
+            ok = 0;
+            break;
+        }
+        if (calcDeadlineExceeded()) {
+            calcErrorSet(error, MSG_ERROR_TIMEOUT, NULL);
+            ok = 0;
+            break;
+        }
+        DoublePolynomial *polynomial1 = stack[depth - 2];
+        DoublePolynomial *polynomial2 = stack[depth - 1];
+        DoublePolynomial *polynomial = NULL;
+        switch (opcode) {
+            case OP_ADD:
+            case OP_SUBTRACT:
+                polynomial = doublePolynomialAdd(polynomial1, polynomial2, opcode == OP_ADD ? 1 : -1);
+                break;
+            case OP_MULTIPLY:
+                if (polynomial1->powerCount + polynomial2->powerCount >= calcConfig()->maxPowerCount) {
+                    ok = -1;
+                    break;
+                }
+                polynomial = doublePolynomialMultiply(polynomial1, polynomial2);
+                if (!doublePolynomialIsZero(polynomial1) && !doublePolynomialIsZero(polynomial2) &&
+                    (polynomial->powerCount != polynomial1->powerCount + polynomial2->powerCount ||
+                     doublePolynomialIsZero(polynomial))) {
+                    ok = -1;
+                }
+                break;
+            case OP_DIVIDE: {
+                if (polynomial2->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_DIVISOR_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                double divisor = polynomial2->factorValue[0];
+                if (divisor == 0) {
+                    calcErrorSet(error, MSG_ERROR_DIVIDE_BY_ZERO, NULL);
+                    ok = 0;
+                    break;
+                }
+                polynomial = doublePolynomialNew(polynomial1->powerCount);
+                for (int k = 0; k <= polynomial1->powerCount; k++) {
+                    polynomial->factorValue[k] = polynomial1->factorValue[k] / divisor;
+                }
+                polynomial = doublePolynomialSimplify(polynomial);
+                if (!doublePolynomialIsZero(polynomial1) &&
+                    (polynomial->powerCount != polynomial1->powerCount || doublePolynomialIsZero(polynomial))) {
+                    ok = -1;
+                }
+                break;
+            }
+            case OP_MOD: {
+                if (polynomial2->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_MODULUS_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                double modulus = polynomial2->factorValue[0];
+                if (modulus == 0) {
+                    calcErrorSet(error, MSG_ERROR_MODULO_BY_ZERO, NULL);
+                    ok = 0;
+                    break;
+                }
+                if (polynomial1->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_DIVIDEND_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                double value = polynomial1->factorValue[0];
+                polynomial = doublePolynomialNew(0);
+                polynomial->factorValue[0] = value - (int) (value / modulus) * modulus;
+                break;
+            }
+            default: {
+                if (polynomial2->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                double exponent = polynomial2->factorValue[0];
+                if (exponent < 0) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_POSITIVE, NULL);
+                    ok = 0;
+                    break;
+                }
+                if (exponent != (int) exponent) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_INTEGER, NULL);
+                    ok = 0;
+                    break;
+                }
+                int powerNum = (int) exponent;
+                if ((long long) polynomial1->powerCount * powerNum >= calcConfig()->maxPowerCount) {
+                    ok = -1;
+                    break;
+                }
+                // 快速幂
+                polynomial = doublePolynomialNew(0);
+                polynomial->factorValue[0] = 1;
+                DoublePolynomial *base = doublePolynomialNew(polynomial1->powerCount);
+                memcpy(base->factorValue, polynomial1->factorValue, (polynomial1->powerCount + 1) * sizeof(double));
+                while (powerNum > 0) {
+                    if (powerNum & 1) {
+                        DoublePolynomial *product = doublePolynomialMultiply(polynomial, base);
+                        freeDoublePolynomial(polynomial);
+                        polynomial = product;
+                    }
+                    powerNum >>= 1;
+                    if (powerNum > 0) {
+                        DoublePolynomial *square = doublePolynomialMultiply(base, base);
+                        freeDoublePolynomial(base);
+                        base = square;
+                    }
+                }
+                freeDoublePolynomial(base);
+                if (!doublePolynomialIsZero(polynomial1) &&
+                    (polynomial->powerCount != polynomial1->powerCount * (int) exponent ||
+                     doublePolynomialIsZero(polynomial))) {
+                    ok = -1;
+                }
+                break;
+            }
+        }
+        if (ok != 1) {
+            freeDoublePolynomial(polynomial);
+            break;
+        }
+        freeDoublePolynomial(polynomial1);
+        freeDoublePolynomial(polynomial2);
+        depth--;
+        stack[depth - 1] = polynomial;
+    }
+    // 系数溢出(long double的指数范围更大)时整个表达式改用long double计算
+    for (int k = 0; ok == 1 && k <= stack[0]->powerCount; k++) {
+        if (!__builtin_isfinite(stack[0]->factorValue[k])) {
+            ok = -1;
+        }
+    }
+    if (ok != 1) {
+        for (int i = 0; i < depth; i++) {
+            freeDoublePolynomial(stack[i]);
+        }
+        calcFree(stack);
+        return ok;
+    }
+    *result = stack[0];
+    calcFree(stack);
+    return 1;
+}
+
+// 求导并除以最大系数的绝对值(不改变根，避免高阶导数的系数溢出)
+DoublePolynomial *doublePolynomialNormalizedDerivative(const DoublePolynomial *polynomial) {
+    DoublePolynomial *derivative = doublePolynomialNew(polynomial->powerCount - 1);
+    double maxValue = 0;
+    for (int i = 0; i <= derivative->powerCount; i++) {
+        derivative->factorValue[i] = polynomial->factorValue[i + 1] * (i + 1);
+        if (__builtin_fabs(derivative->factorValue[i]) > maxValue) {
+            maxValue = __builtin_fabs(derivative->factorValue[i]);
+        }
+    }
+    for (int i = 0; i <= derivative->powerCount; i++) {
+        derivative->factorValue[i] /= maxValue;
+    }
+    return doublePolynomialSimplify(derivative);
+}
+
+// 判断x是否大于Cauchy根界(同expressionAboveRootBound)
+int doublePolynomialAboveRootBound(const DoublePolynomial *polynomial, const double x) {
+    double inverse = 1 / x;
+    double inversePower = 1;
+    double sum = 0;
+    for (int k = polynomial->powerCount - 1; k >= 0; k--) {
+        inversePower *= inverse;
+        sum += __builtin_fabs(polynomial->factorValue[k]) * inversePower;
+    }
+    return __builtin_fabs(polynomial->factorValue[polynomial->powerCount]) > sum;
+}
+
+// 求根的上界：大于Cauchy根界的最小的2的幂，超过ROOT_BOUND_MAX时不再倍增(双精度的指数范围小得多)
+double doublePolynomialRootBound(const DoublePolynomial *polynomial) {
+    double bound = 1;
+    if (doublePolynomialAboveRootBound(polynomial, bound)) {
+        while (bound > ROOT_THRESHOLD && doublePolynomialAboveRootBound(polynomial, bound / 2)) {
+            bound /= 2;
+        }
+    } else {
+        while (bound < ROOT_BOUND_MAX && !doublePolynomialAboveRootBound(polynomial, bound)) {
+            bound *= 2;
+        }
+    }
+    return bound < ROOT_BOUND_MAX ? bound : (double) ROOT_BOUND_MAX;
+}
+
+// 判断多项式在x处的值是否与0无法区分(舍入误差的上界 2(n+1)*eps*sum|ai*x^i|，eps为双精度的)
+int doublePolynomialIsNumericallyZero(const DoublePolynomial *polynomial, const double x) {
+    double value = polynomial->factorValue[polynomial->powerCount];
+    double magnitude = __builtin_fabs(value);
+    for (int k = polynomial->powerCount - 1; k >= 0; k--) {
+        value = value * x + polynomial->factorValue[k];
+        magnitude = magnitude * __builtin_fabs(x) + __builtin_fabs(polynomial->factorValue[k]);
+    }
+    return __builtin_fabs(value) <= 2 * (polynomial->powerCount + 1) * DBL_EPSILON * magnitude;
+}
+
+// 在区间(left, right)内求单调函数的根，要求左右端点的函数值异号(安全牛顿法，同expressionRefineRoot)
+double doublePolynomialRefineRoot(const DoublePolynomial *polynomial, double left, double right, double valueLeft) {
+    const double *factorValue = polynomial->factorValue;
+    double root = (left + right) / 2;
+    double lastStep = right - left;
+    for (int iteration = 0; iteration < ROOT_REFINE_MAX_ITERATIONS; iteration++) {
+        // Horner法同时求出函数值和导数值
+        double value = factorValue[polynomial->powerCount];
+        double derivative = 0;
+        for (int k = polynomial->powerCount - 1; k >= 0; k--) {
+            derivative = derivative * root + value;
+            value = value * root + factorValue[k];
+        }
+        if (value == 0) {
+            return root;
+        }
+        if ((value < 0) == (valueLeft < 0)) {
+            left = root;
+            valueLeft = value;
+        } else {
+            right = root;
+        }
+        double step = derivative != 0 ? value / derivative : 0;
+        double next = root - step;
+        if (derivative == 0 || !(next > left && next < right) || __builtin_fabs(2 * step) > __builtin_fabs(lastStep)) {
+            next = (left + right) / 2;
+            step = root - next;
+        }
+        lastStep = step;
+        if (__builtin_fabs(next - root) <= ROOT_REFINE_TOLERANCE * (1 + __builtin_fabs(root)) || next == left ||
+            next == right) {
+            return next;
+        }
+        root = next;
+    }
+    return root;
+}
+
+// 合并相同的根(同rootGroupEnd)：从begin开始的一组根的结束位置
+int doubleRootGroupEnd(const DoublePolynomial *polynomial, const double *roots, const int numRoots, const int begin) {
+    int end = begin + 1;
+    while (end < numRoots && (roots[end] - roots[end - 1] < ROOT_THRESHOLD ||
+                              doublePolynomialIsNumericallyZero(polynomial, (roots[end - 1] + roots[end]) / 2))) {
+        end++;
+    }
+    return end;
+}
+
+// 一组根合并后的值：取平均值，绝对值小于阈值的根视为0
+double doubleRootGroupValue(const double *roots, const int begin, const int end) {
+    double sum = roots[begin];
+    for (int i = begin + 1; i < end; i++) {
+        sum += roots[i];
+    }
+    double root = sum / (end - begin);
+    return __builtin_fabs(root) < ROOT_THRESHOLD ? 0 : root;
+}
+
+// 流式输出已经确定的根(同rootStreamEmit)
+void doubleRootStreamEmit(const DoublePolynomial *polynomial, const double *roots, const int numRoots, int *begin,
+                          const int complete) {
+    while (*begin < numRoots) {
+        int end = doubleRootGroupEnd(polynomial, roots, numRoots, *begin);
+        if (end == numRoots && !complete) {
+            return;
+        }
+        currentResultStream->onRoot(currentResultStream->arg, doubleRootGroupValue(roots, *begin, end));
+        currentResultStream->numRoots++;
+        *begin = end;
+    }
+}
+
+// 双精度多项式求根：与expressionFindRoot相同的导数序列隔离根 + 安全牛顿法，全程使用double
+// 每一层的端点值和误差上界(系数取绝对值的多项式在|x|处的值)都用双精度的Horner内核一次批量求出；结果按long double返回
+long double *doublePolynomialFindRoot(const DoublePolynomial *polynomial, int *numRoots) {
+    int powerCount = polynomial->powerCount;
+    if (currentResultStream != NULL) {
+        currentResultStream->numRoots = 0;
+    }
+    if (powerCount == 0) {
+        *numRoots = 0;
+        return NULL;
+    }
+    double *roots = NULL;
+    int numRootsNew = 0;
+    int streamed = 0;
+    if (powerCount == 1) {
+        roots = (double *) calcMalloc(sizeof(double));
+        roots[0] = -polynomial->factorValue[0] / polynomial->factorValue[1];
+        numRootsNew = 1;
+    } else {
+        HornerDoubleKernel horner = hornerDoubleKernel();
+        double bound = doublePolynomialRootBound(polynomial);
+        // 导数序列：derivatives[0]为原多项式本身，其余为归一化的各阶导数，直到一次式为止
+        DoublePolynomial **derivatives = (DoublePolynomial **) calcMalloc(powerCount * sizeof(DoublePolynomial *));
+        derivatives[0] = (DoublePolynomial *) polynomial;
+        int numLevels = 1;
+        while (numLevels < powerCount && derivatives[numLevels - 1]->powerCount > 1) {
+            derivatives[numLevels] = doublePolynomialNormalizedDerivative(derivatives[numLevels - 1]);
+            numLevels++;
+        }
+        const DoublePolynomial *linear = derivatives[numLevels - 1];
+        double *criticalPoints = (double *) calcMalloc(sizeof(double));
+        int numCriticalPoints = 1;
+        criticalPoints[0] = -linear->factorValue[0] / linear->factorValue[1];
+        // 系数取绝对值的多项式(求误差上界用)，各层共用
+        double *magnitudeFactors = (double *) calcMalloc((powerCount + 1) * sizeof(double));
+        for (int level = numLevels - 2; level >= 0 && !calcDeadlineExceeded(); level--) {
+            const DoublePolynomial *current = derivatives[level];
+            int numPoints = numCriticalPoints + 2;
+            // 端点、端点的绝对值、函数值、误差上界
+            double *buffer = (double *) calcMalloc(4 * numPoints * sizeof(double));
+            int *signs = (int *) calcMalloc(numPoints * sizeof(int));
+            double *points = buffer;
+            double *absolutePoints = buffer + numPoints;
+            double *values = buffer + 2 * numPoints;
+            double *magnitudes = buffer + 3 * numPoints;
+            points[0] = -bound;
+            for (int i = 0; i < numCriticalPoints; i++) {
+                points[i + 1] = criticalPoints[i];
+            }
+            points[numPoints - 1] = bound;
+            for (int i = 0; i < numPoints; i++) {
+                absolutePoints[i] = __builtin_fabs(points[i]);
+            }
+            for (int k = 0; k <= current->powerCount; k++) {
+                magnitudeFactors[k] = __builtin_fabs(current->factorValue[k]);
+            }
+            horner(current->factorValue, current->powerCount, points, values, numPoints);
+            horner(magnitudeFactors, current->powerCount, absolutePoints, magnitudes, numPoints);
+            // 与0无法区分的端点即为这一层的根(重根)，其符号不可靠，记为0(同expressionFindRoot)
+            double errorScale = 2 * (current->powerCount + 1) * DBL_EPSILON;
+            for (int i = 0; i < numPoints; i++) {
+                signs[i] = __builtin_fabs(values[i]) <= errorScale * magnitudes[i] ? 0 : values[i] > 0 ? 1 : -1;
+            }
+            roots = (double *) calcMalloc(2 * numPoints * sizeof(double));
+            numRootsNew = 0;
+            for (int i = 0; i < numPoints && !calcDeadlineExceeded(); i++) {
+                if (i > 0 && i < numPoints - 1 &&
+                    (signs[i] == 0 || (level == 0 && __builtin_fabs(values[i]) <= ROOT_THRESHOLD))) {
+                    roots[numRootsNew++] = points[i];
+                }
+                if (i + 1 < numPoints && signs[i] * signs[i + 1] < 0) {
+                    roots[numRootsNew++] = doublePolynomialRefineRoot(current, points[i], points[i + 1], values[i]);
+                }
+                if (level == 0 && currentResultStream != NULL) {
+                    doubleRootStreamEmit(polynomial, roots, numRootsNew, &streamed, 0);
+                }
+            }
+            calcFree(buffer);
+            calcFree(signs);
+            calcFree(criticalPoints);
+            criticalPoints = roots;
+            numCriticalPoints = numRootsNew;
+        }
+        calcFree(magnitudeFactors);
+        if (calcDeadlineExceeded()) {
+            calcFree(criticalPoints);
+            roots = NULL;
+            numRootsNew = 0;
+        }
+        for (int level = 1; level < numLevels; level++) {
+            freeDoublePolynomial(derivatives[level]);
+        }
+        calcFree(derivatives);
+    }
+    if (currentResultStream != NULL) {
+        doubleRootStreamEmit(polynomial, roots, numRootsNew, &streamed, 1);
+    }
+    // 合并相同的根，按long double返回
+    long double *merged = numRootsNew > 0 ? (long double *) calcMalloc(numRootsNew * sizeof(long double)) : NULL;
+    int numMerged = 0;
+    for (int i = 0; i < numRootsNew;) {
+        int j = doubleRootGroupEnd(polynomial, roots, numRootsNew, i);
+        merged[numMerged++] = doubleRootGroupValue(roots, i, j);
+        i = j;
+    }
+    calcFree(roots);
+    *numRoots = numMerged;
+    return merged;
+}
+
+// 下面为精确模式(有理数)相关的结构体和函数
+// 分子分母为128位整数，每次运算后约分；任何一步溢出(或常数无法精确表示)时放弃精确计算，退回long double计算
+// 计算式的结果精确输出为整数或分数；等式先精确展开多项式，再除去重因子(p/gcd(p,p'))，只剩单根后再数值求根
+typedef __int128 RationalInt;
+
+// 128位整数的最大值
+#define RATIONAL_INT_MAX ((RationalInt) (((unsigned __int128) 1 << 127) - 1))
+// 有理数，分母总为正，分子分母互质
+typedef struct {
+    RationalInt numerator;
+    RationalInt denominator;
+} Rational;
+
+// 最大公约数(非负)
+RationalInt rationalGcd(RationalInt a, RationalInt b) {
+    if (a < 0) {
+        a = -a;
+    }
+    if (b < 0) {
+        b = -b;
+    }
+    while (b != 0) {
+        RationalInt t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// 由分子分母构造有理数(分母不为0)，规范符号并约分；出现128位整数的最小值(取反会溢出)时返回0
+int rationalMake(RationalInt numerator, RationalInt denominator, Rational *result) {
+    if (numerator < -RATIONAL_INT_MAX || denominator < -RATIONAL_INT_MAX) {
+        return 0;
+    }
+    if (denominator < 0) {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+    RationalInt gcd = rationalGcd(numerator, denominator);
+    if (gcd > 1) {
+        numerator /= gcd;
+        denominator /= gcd;
+    }
+    result->numerator = numerator;
+    result->denominator = denominator;
+    return 1;
+}
+
+// 整数
+Rational rationalInteger(const RationalInt value) {
+    Rational result = {value, 1};
+    return result;
+}
+
+int rationalIsZero(const Rational value) {
+    return value.numerator == 0;
+}
+
+// 加减：value1 + sign * value2，溢出时返回0
+int rationalAdd(const Rational value1, const Rational value2, const int sign, Rational *result) {
+    RationalInt gcd = rationalGcd(value1.denominator, value2.denominator);
+    RationalInt term1, term2, numerator, denominator;
+    if (__builtin_mul_overflow(value1.numerator, value2.denominator / gcd, &term1) ||
+        __builtin_mul_overflow(value2.numerator, value1.denominator / gcd, &term2) ||
+        __builtin_mul_overflow(value1.denominator / gcd, value2.denominator, &denominator)) {
+        return 0;
+    }
+    if (sign > 0 ? __builtin_add_overflow(term1, term2, &numerator) : __builtin_sub_overflow(term1, term2, &numerator)) {
+        return 0;
+    }
+    return rationalMake(numerator, denominator, result);
+}
+
+// 乘法(先交叉约分以减少溢出)，溢出时返回0
+int rationalMultiply(const Rational value1, const Rational value2, Rational *result) {
+    RationalInt gcd1 = rationalGcd(value1.numerator, value2.denominator);
+    RationalInt gcd2 = rationalGcd(value2.numerator, value1.denominator);
+    if (gcd1 == 0) {
+        gcd1 = 1;
+    }
+    if (gcd2 == 0) {
+        gcd2 = 1;
+    }
+    RationalInt numerator, denominator;
+    if (__builtin_mul_overflow(value1.numerator / gcd1, value2.numerator / gcd2, &numerator) ||
+        __builtin_mul_overflow(value1.denominator / gcd2, value2.denominator / gcd1, &denominator)) {
+        return 0;
+    }
+    return rationalMake(numerator, denominator, result);
+}
+
+// 除法(除数不为0，由调用者检查)，溢出时返回0
+int rationalDivide(const Rational value1, const Rational value2, Rational *result) {
+    Rational inverse;
+    return rationalMake(value2.denominator, value2.numerator, &inverse) && rationalMultiply(value1, inverse, result);
+}
+
+// 求余：value1 - trunc(value1 / value2) * value2(与long double计算相同，商向0取整)，溢出时返回0
+int rationalMod(const Rational value1, const Rational value2, Rational *result) {
+    Rational quotient;
+    if (!rationalDivide(value1, value2, &quotient)) {
+        return 0;
+    }
+    Rational product;
+    return rationalMultiply(rationalInteger(quotient.numerator / quotient.denominator), value2, &product) &&
+           rationalAdd(value1, product, -1, result);
+}
+
+// 非负整数次幂(快速幂)，溢出时返回0
+int rationalPower(Rational value, RationalInt powerCount, Rational *result) {
+    Rational power = rationalInteger(1);
+    while (powerCount > 0) {
+        if ((powerCount & 1) && !rationalMultiply(power, value, &power)) {
+            return 0;
+        }
+        powerCount >>= 1;
+        if (powerCount > 0 && !rationalMultiply(value, value, &value)) {
+            return 0;
+        }
+    }
+    *result = power;
+    return 1;
+}
+
+// 由数字的原文得到精确的有理数：十进制数字为 D*10^k，十六进制浮点数为 M*2^k(语法同parseNumber，原文已经检查过)
+// 有效数字或10(2)的幂次超出128位整数的范围时无法精确表示，返回0
+int rationalFromLiteral(const char *text, const int length, Rational *result) {
+    int base = 10;
+    int i = 0;
+    if (length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        i = 2;
+    }
+    // 有效数字，末尾的0先不乘入，计入指数(如1e30写成1000...0时也能表示)
+    RationalInt mantissa = 0;
+    int numTrailingZeros = 0;
+    int exponent = 0; // 以base为底
+    int pointOccurred = 0;
+    for (; i < length; i++) {
+        if (text[i] == '.') {
+            pointOccurred = 1;
+            continue;
+        }
+        int digit = base == 16 ? hexDigitValue(text[i]) : text[i] >= '0' && text[i] <= '9' ? text[i] - '0' : -1;
+        if (digit < 0) {
+            break;
+        }
+        exponent -= pointOccurred;
+        if (digit == 0) {
+            numTrailingZeros += mantissa != 0;
+            continue;
+        }
+        for (; numTrailingZeros >= 0; numTrailingZeros--) {
+            int next = numTrailingZeros == 0 ? digit : 0;
+            if (mantissa > (RATIONAL_INT_MAX - next) / base) {
+                return 0;
+            }
+            mantissa = mantissa * base + next;
+        }
+        numTrailingZeros = 0;
+    }
+    exponent += numTrailingZeros;
+    if (mantissa == 0) {
+        *result = rationalInteger(0);
+        return 1;
+    }
+    // 指数部分：十进制数字为10的幂次，十六进制浮点数为2的幂次(每个十六进制数字为2^4)
+    int power = 0;
+    if (i < length) {
+        parseNumberExponent(&text[i + 1], &power);
+    }
+    int radix = 10;
+    if (base == 16) {
+        radix = 2;
+        exponent *= 4;
+    }
+    power += exponent;
+    RationalInt denominator = 1;
+    for (; power > 0; power--) {
+        if (mantissa > RATIONAL_INT_MAX / radix) {
+            return 0;
+        }
+        mantissa *= radix;
+    }
+    for (; power < 0; power++) {
+        if (denominator > RATIONAL_INT_MAX / radix) {
+            return 0;
+        }
+        denominator *= radix;
+    }
+    return rationalMake(mantissa, denominator, result);
+}
+
+long double rationalToLongDouble(const Rational value) {
+    return (long double) value.numerator / (long double) value.denominator;
+}
+
+// 128位整数转为十进制字符串，返回写入的长度
+int rationalIntFormat(RationalInt value, char *buffer) {
+    char digits[48];
+    int numDigits = 0;
+    int negative = value < 0;
+    unsigned __int128 magnitude = negative ? (unsigned __int128) (-(value + 1)) + 1 : (unsigned __int128) value;
+    do {
+        digits[numDigits++] = (char) ('0' + (int) (magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude > 0);
+    int length = 0;
+    if (negative) {
+        buffer[length++] = '-';
+    }
+    while (numDigits > 0) {
+        buffer[length++] = digits[--numDigits];
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+// 有理数转为字符串：整数直接输出，否则输出为 分子/分母
+void rationalFormat(const Rational value, char *buffer) {
+    int length = rationalIntFormat(value.numerator, buffer);
+    if (value.denominator != 1) {
+        buffer[length++] = '/';
+        rationalIntFormat(value.denominator, buffer + length);
+    }
+}
+
+// 精确执行程序(只含常数的计算式)，constants为常数表对应的有理数：成功返回1；出错返回0，错误码与long double计算相同；
+// 溢出时返回-1
+int programRunExact(const Program *program, const Rational *constants, Rational *result, CalcError *error) {
+    const unsigned char *code = programCode(program);
+    int depth = 0;
+    int constantIndex = 0;
+    int ok = 1;
+    // 栈的深度与括号嵌套的层数相同，没有上限，不能放在线程栈上
+    Rational *values = (Rational *) calcMalloc((program->maxDepth + 1) * sizeof(Rational));
+    for (int i = 0; i < program->numInstructions && ok == 1; i++) {
+        Opcode opcode = (Opcode) code[i];
+        if (opcode == OP_PUSH_CONST) {
+            values[depth++] = constants[constantIndex++];
+            continue;
+        }
+        if (opcode == OP_PUSH_X) {
+            ok = -1;
+            break;
+        }
+        if (opcode > OP_POWER) {
+            calcErrorSet(error, opcodeError(opcode), NULL);
+            ok = 0;
+            break;
+        }
+        Rational value1 = values[depth - 2];
+        Rational value2 = values[depth - 1];
+        switch (opcode) {
+            case OP_ADD:
+                ok = rationalAdd(value1, value2, 1, &values[depth - 2]) ? 1 : -1;
+                break;
+            case OP_SUBTRACT:
+                ok = rationalAdd(value1, value2, -1, &values[depth - 2]) ? 1 : -1;
+                break;
+            case OP_MULTIPLY:
+                ok = rationalMultiply(value1, value2, &values[depth - 2]) ? 1 : -1;
+                break;
+            case OP_DIVIDE:
+                if (rationalIsZero(value2)) {
+                    calcErrorSet(error, MSG_ERROR_DIVIDE_BY_ZERO, NULL);
+                    ok = 0;
+                    break;
+                }
+                ok = rationalDivide(value1, value2, &values[depth - 2]) ? 1 : -1;
+                break;
+            case OP_MOD:
+                if (rationalIsZero(value2)) {
+                    calcErrorSet(error, MSG_ERROR_MODULO_BY_ZERO, NULL);
+                    ok = 0;
+                    break;
+                }
+                ok = rationalMod(value1, value2, &values[depth - 2]) ? 1 : -1;
+                break;
+            default:
+                if (value2.numerator < 0) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_POSITIVE, NULL);
+                    ok = 0;
+                    break;
+                }
+                // 超出int范围的指数在long double计算中同样视为非整数
+                if (value2.denominator != 1 || value2.numerator > INT_MAX) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_INTEGER, NULL);
+                    ok = 0;
+                    break;
+                }
+                ok = rationalPower(value1, value2.numerator, &values[depth - 2]) ? 1 : -1;
+                break;
+        }
+        depth--;
+    }
+    if (ok == 1) {
+        *result = values[0];
+    }
+    calcFree(values);
+    return ok;
+}
+
+// 有理系数的多项式(只有稠密表示)，系数次幂数从小到大
+typedef struct {
+    int powerCount;
+    Rational *factorValue;
+} RationalPolynomial;
+
+// 新建多项式，系数全为0
+RationalPolynomial *rationalPolynomialNew(const int powerCount) {
+    RationalPolynomial *polynomial = (RationalPolynomial *) calcMalloc(sizeof(RationalPolynomial));
+    polynomial->powerCount = powerCount;
+    polynomial->factorValue = (Rational *) calcMalloc((powerCount + 1) * sizeof(Rational));
+    for (int i = 0; i <= powerCount; i++) {
+        polynomial->factorValue[i] = rationalInteger(0);
+    }
+    return polynomial;
+}
+
+void freeRationalPolynomial(RationalPolynomial *polynomial) {
+    if (polynomial == NULL) {
+        return;
+    }
+    calcFree(polynomial->factorValue);
+    calcFree(polynomial);
+}
+
+// 去掉最高次的0系数
+RationalPolynomial *rationalPolynomialSimplify(RationalPolynomial *polynomial) {
+    while (polynomial->powerCount > 0 && rationalIsZero(polynomial->factorValue[polynomial->powerCount])) {
+        polynomial->powerCount--;
+    }
+    return polynomial;
+}
+
+int rationalPolynomialIsZero(const RationalPolynomial *polynomial) {
+    return polynomial->powerCount == 0 && rationalIsZero(polynomial->factorValue[0]);
+}
+
+// 加减：polynomial1 + sign * polynomial2，溢出时返回NULL
+RationalPolynomial *rationalPolynomialAdd(const RationalPolynomial *polynomial1, const RationalPolynomial *polynomial2,
+                                          const int sign) {
+    int powerCount = polynomial1->powerCount > polynomial2->powerCount ? polynomial1->powerCount : polynomial2->powerCount;
+    RationalPolynomial *polynomial = rationalPolynomialNew(powerCount);
+    for (int i = 0; i <= powerCount; i++) {
+        Rational value1 = i <= polynomial1->powerCount ? polynomial1->factorValue[i] : rationalInteger(0);
+        Rational value2 = i <= polynomial2->powerCount ? polynomial2->factorValue[i] : rationalInteger(0);
+        if (!rationalAdd(value1, value2, sign, &polynomial->factorValue[i])) {
+            freeRationalPolynomial(polynomial);
+            return NULL;
+        }
+    }
+    return rationalPolynomialSimplify(polynomial);
+}
+
+// 乘法(逐项相乘)，溢出时返回NULL
+RationalPolynomial *rationalPolynomialMultiply(const RationalPolynomial *polynomial1,
+                                               const RationalPolynomial *polynomial2) {
+    RationalPolynomial *polynomial = rationalPolynomialNew(polynomial1->powerCount + polynomial2->powerCount);
+    for (int i = 0; i <= polynomial1->powerCount; i++) {
+        if (rationalIsZero(polynomial1->factorValue[i])) {
+            continue;
+        }
+        for (int j = 0; j <= polynomial2->powerCount; j++) {
+            Rational product;
+            if (!rationalMultiply(polynomial1->factorValue[i], polynomial2->factorValue[j], &product) ||
+                !rationalAdd(polynomial->factorValue[i + j], product, 1, &polynomial->factorValue[i + j])) {
+                freeRationalPolynomial(polynomial);
+                return NULL;
+            }
+        }
+    }
+    return rationalPolynomialSimplify(polynomial);
+}
+
+// 乘以常数，溢出时返回NULL
+RationalPolynomial *rationalPolynomialScale(const RationalPolynomial *polynomial1, const Rational factor) {
+    RationalPolynomial *polynomial = rationalPolynomialNew(polynomial1->powerCount);
+    for (int i = 0; i <= polynomial1->powerCount; i++) {
+        if (!rationalMultiply(polynomial1->factorValue[i], factor, &polynomial->factorValue[i])) {
+            freeRationalPolynomial(polynomial);
+            return NULL;
+        }
+    }
+    return rationalPolynomialSimplify(polynomial);
+}
+
+// 精确执行程序，展开为有理系数的多项式(constants同programRunExact)：成功返回1并写入result；
+// 出错返回0，错误码与long double计算相同；溢出或次幂数超过稠密表示的上限时返回-1
+int programRunExactPolynomial(const Program *program, const Rational *constants, RationalPolynomial **result,
+                              CalcError *error) {
+    const unsigned char *code = programCode(program);
+    int depth = 0;
+    int constantIndex = 0;
+    int ok = 1;
+    // 多项式栈从内存池分配(深度随输入增长)
+    RationalPolynomial **stack = (RationalPolynomial **) calcMalloc((program->maxDepth + 1) *
+                                                                    sizeof(RationalPolynomial *));
+    for (int i = 0; i < program->numInstructions && ok == 1; i++) {
+        Opcode opcode = (Opcode) code[i];
+        if (opcode == OP_PUSH_CONST || opcode == OP_PUSH_X) {
+            RationalPolynomial *polynomial = rationalPolynomialNew(opcode == OP_PUSH_X ? 1 : 0);
+            if (opcode == OP_PUSH_X) {
+                polynomial->factorValue[1] = rationalInteger(1);
+            } else {
+                polynomial->factorValue[0] = constants[constantIndex++];
+            }
+            stack[depth++] = polynomial;
+            continue;
+        }
+        if (opcode > OP_POWER) {
+            calcErrorSet(error, opcodeError(opcode), NULL);
+            ok = 0;
+            break;
+        }
+        if (calcDeadlineExceeded()) {
+            calcErrorSet(error, MSG_ERROR_TIMEOUT, NULL);
+            ok = 0;
+            break;
+        }
+        RationalPolynomial *polynomial1 = stack[depth - 2];
+        RationalPolynomial *polynomial2 = stack[depth - 1];
+        RationalPolynomial *polynomial = NULL;
+        switch (opcode) {
+            case OP_ADD:
+            case OP_SUBTRACT:
+                polynomial = rationalPolynomialAdd(polynomial1, polynomial2, opcode == OP_ADD ? 1 : -1);
+                break;
+            case OP_MULTIPLY:
+                if (polynomial1->powerCount + polynomial2->powerCount >= calcConfig()->maxPowerCount) {
+                    ok = -1;
+                    break;
+                }
+                polynomial = rationalPolynomialMultiply(polynomial1, polynomial2);
+                break;
+            case OP_DIVIDE: {
+                if (polynomial2->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_DIVISOR_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                if (rationalIsZero(polynomial2->factorValue[0])) {
+                    calcErrorSet(error, MSG_ERROR_DIVIDE_BY_ZERO, NULL);
+                    ok = 0;
+                    break;
+                }
+                Rational inverse;
+                if (rationalMake(polynomial2->factorValue[0].denominator, polynomial2->factorValue[0].numerator,
+                                 &inverse)) {
+                    polynomial = rationalPolynomialScale(polynomial1, inverse);
+                }
+                break;
+            }
+            case OP_MOD:
+                if (polynomial2->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_MODULUS_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                if (rationalIsZero(polynomial2->factorValue[0])) {
+                    calcErrorSet(error, MSG_ERROR_MODULO_BY_ZERO, NULL);
+                    ok = 0;
+                    break;
+                }
+                if (polynomial1->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_DIVIDEND_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                polynomial = rationalPolynomialNew(0);
+                if (!rationalMod(polynomial1->factorValue[0], polynomial2->factorValue[0],
+                                 &polynomial->factorValue[0])) {
+                    freeRationalPolynomial(polynomial);
+                    polynomial = NULL;
+                }
+                break;
+            default: {
+                if (polynomial2->powerCount != 0) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_CONSTANT, NULL);
+                    ok = 0;
+                    break;
+                }
+                Rational exponent = polynomial2->factorValue[0];
+                if (exponent.numerator < 0) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_POSITIVE, NULL);
+                    ok = 0;
+                    break;
+                }
+                if (exponent.denominator != 1 || exponent.numerator > INT_MAX) {
+                    calcErrorSet(error, MSG_ERROR_EXPONENT_NOT_INTEGER, NULL);
+                    ok = 0;
+                    break;
+                }
+                int powerNum = (int) exponent.numerator;
+                if ((long long) polynomial1->powerCount * powerNum >= calcConfig()->maxPowerCount) {
+                    ok = -1;
+                    break;
+                }
+                // 快速幂
+                polynomial = rationalPolynomialNew(0);
+                polynomial->factorValue[0] = rationalInteger(1);
+                RationalPolynomial *base = rationalPolynomialScale(polynomial1, rationalInteger(1));
+                while (powerNum > 0 && polynomial != NULL && base != NULL) {
+                    if (powerNum & 1) {
+                        RationalPolynomial *product = rationalPolynomialMultiply(polynomial, base);
+                        freeRationalPolynomial(polynomial);
+                        polynomial = product;
+                    }
+                    powerNum >>= 1;
+                    if (powerNum > 0) {
+                        RationalPolynomial *square = rationalPolynomialMultiply(base, base);
+                        freeRationalPolynomial(base);
+                        base = square;
+                    }
+                }
+                if (base == NULL) {
+                    freeRationalPolynomial(polynomial);
+                    polynomial = NULL;
+                }
+                freeRationalPolynomial(base);
+                break;
+            }
+        }
+        if (ok == 1 && polynomial == NULL) {
+            ok = -1;
+        }
+        if (ok != 1) {
+            break;
+        }
+        freeRationalPolynomial(polynomial1);
+        freeRationalPolynomial(polynomial2);
+        depth--;
+        stack[depth - 1] = polynomial;
+    }
+    if (ok == 1) {
+        *result = stack[--depth];
+    }
+    for (int i = 0; i < depth; i++) {
+        freeRationalPolynomial(stack[i]);
+    }
+    calcFree(stack);
+    return ok;
+}
+
+// 带余除法：dividend = quotient * divisor + remainder(除式不为0)，溢出时返回0
+int rationalPolynomialDivide(const RationalPolynomial *dividend, const RationalPolynomial *divisor,
+                             RationalPolynomial **quotient, RationalPolynomial **remainder) {
+    int quotientPowerCount = dividend->powerCount - divisor->powerCount;
+    *quotient = rationalPolynomialNew(quotientPowerCount > 0 ? quotientPowerCount : 0);
+    *remainder = rationalPolynomialScale(dividend, rationalInteger(1));
+    if (*remainder == NULL) {
+        freeRationalPolynomial(*quotient);
+        return 0;
+    }
+    Rational leading = divisor->factorValue[divisor->powerCount];
+    while (!rationalPolynomialIsZero(*remainder) && (*remainder)->powerCount >= divisor->powerCount) {
+        int shift = (*remainder)->powerCount - divisor->powerCount;
+        Rational factor;
+        if (!rationalDivide((*remainder)->factorValue[(*remainder)->powerCount], leading, &factor)) {
+            break;
+        }
+        (*quotient)->factorValue[shift] = factor;
+        int ok = 1;
+        for (int i = 0; i <= divisor->powerCount && ok; i++) {
+            Rational product;
+            ok = rationalMultiply(factor, divisor->factorValue[i], &product) &&
+                 rationalAdd((*remainder)->factorValue[i + shift], product, -1, &(*remainder)->factorValue[i + shift]);
+        }
+        if (!ok) {
+            break;
+        }
+        // 最高次项已精确消去
+        (*remainder)->factorValue[(*remainder)->powerCount] = rationalInteger(0);
+        rationalPolynomialSimplify(*remainder);
+    }
+    if (!rationalPolynomialIsZero(*remainder) && (*remainder)->powerCount >= divisor->powerCount) {
+        freeRationalPolynomial(*quotient);
+        freeRationalPolynomial(*remainder);
+        return 0;
+    }
+    rationalPolynomialSimplify(*quotient);
+    return 1;
+}
+
+// 化为首一多项式(最高次项系数为1)，溢出时返回NULL
+RationalPolynomial *rationalPolynomialMonic(const RationalPolynomial *polynomial) {
+    Rational inverse;
+    Rational leading = polynomial->factorValue[polynomial->powerCount];
+    if (!rationalMake(leading.denominator, leading.numerator, &inverse)) {
+        return NULL;
+    }
+    return rationalPolynomialScale(polynomial, inverse);
+}
+
+// 去掉重因子：返回 p / gcd(p, p')，各根都是单根且与p的根相同(p的次幂数至少为1)，溢出时返回NULL
+// 最大公因式用辗转相除求出，每一步化为首一多项式以控制系数的大小
+RationalPolynomial *rationalPolynomialSquareFree(const RationalPolynomial *polynomial) {
+    RationalPolynomial *derivative = rationalPolynomialNew(polynomial->powerCount - 1);
+    for (int i = 0; i < polynomial->powerCount; i++) {
+        if (!rationalMultiply(polynomial->factorValue[i + 1], rationalInteger(i + 1), &derivative->factorValue[i])) {
+            freeRationalPolynomial(derivative);
+            return NULL;
+        }
+    }
+    RationalPolynomial *a = rationalPolynomialMonic(polynomial);
+    RationalPolynomial *b = rationalPolynomialMonic(rationalPolynomialSimplify(derivative));
+    freeRationalPolynomial(derivative);
+    while (a != NULL && b != NULL && !rationalPolynomialIsZero(b)) {
+        RationalPolynomial *quotient;
+        RationalPolynomial *remainder;
+        if (!rationalPolynomialDivide(a, b, &quotient, &remainder)) {
+            freeRationalPolynomial(a);
+            a = NULL;
+            break;
+        }
+        freeRationalPolynomial(quotient);
+        freeRationalPolynomial(a);
+        a = b;
+        b = rationalPolynomialIsZero(remainder) ? remainder : rationalPolynomialMonic(remainder);
+        if (b != remainder) {
+            freeRationalPolynomial(remainder);
+        }
+    }
+    // 任何一步溢出(a或b为NULL)时放弃
+    if (a == NULL || b == NULL) {
+        freeRationalPolynomial(a);
+        freeRationalPolynomial(b);
+        return NULL;
+    }
+    freeRationalPolynomial(b);
+    // a为最大公因式，p除以它(整除)
+    RationalPolynomial *quotient;
+    RationalPolynomial *remainder;
+    int ok = rationalPolynomialDivide(polynomial, a, &quotient, &remainder);
+    freeRationalPolynomial(a);
+    if (!ok) {
+        return NULL;
+    }
+    freeRationalPolynomial(remainder);
+    return quotient;
+}
+
+// 有理系数的多项式转为表达式(long double系数)
+Expression *rationalPolynomialToExpression(const RationalPolynomial *polynomial) {
+    Expression *expression = expressionNew(polynomial->powerCount);
+    for (int i = 0; i <= polynomial->powerCount; i++) {
+        expression->factorValue[i] = rationalToLongDouble(polynomial->factorValue[i]);
+    }
+    return expression;
+}
+
+// 解析出错时的错误码记入error，错误信息写入result_msg(最多resultSize-1个字符)
+void parseStatusMessage(const ParseStatus status, CalcError *error, char *result_msg, const size_t resultSize) {
+    switch (status) {
+        case PARSE_UNKNOWN_SYMBOL:
+            formatError("Error:\t%s", error, result_msg, resultSize);
+            break;
+        case PARSE_EMPTY:
+            calcErrorSet(error, MSG_ERROR_MISSING_EXPRESSION, NULL);
+            formatError("Error:\t%s", error, result_msg, resultSize);
+            break;
+        case PARSE_INVALID:
+            formatError("Error: \t%s\n", error, result_msg, resultSize);
+            break;
+        case PARSE_VARIABLE_IN_CALCULATION: // 报错，只有等式中才能出现未知数，计算式不行
+            calcErrorSet(error, MSG_ERROR_VARIABLE_IN_CALCULATION, NULL);
+            formatError("Error:\t%s", error, result_msg, resultSize);
+            break;
+        default:
+            break;
+    }
+}
+
+// 输出计算式的结果：数值过大、"%Lf"的输出放不下时改用科学计数法
+void formatResult(const long double value, char *result_msg, const size_t resultSize) {
+    int length = snprintf(result_msg, resultSize, "Result:\t%Lf\n", value);
+    if (length >= (int) resultSize) {
+        snprintf(result_msg, resultSize, "Result:\t%Le\n", value);
+    }
+}
+
+// 输出计算式的结果：设置了结果流时只把数值交给结果流，不格式化(result_msg为空字符串)
+void outputResult(const long double value, char *result_msg, const size_t resultSize) {
+    if (currentResultStream == NULL) {
+        formatResult(value, result_msg, resultSize);
+        return;
+    }
+    currentResultStream->hasValue = 1;
+    currentResultStream->value = value;
+    if (resultSize > 0) {
+        result_msg[0] = '\0';
+    }
+}
+
+// 输出求出的根，放不下的根省略为"..."
+void formatRoots(const long double *roots, const int numRoots, char *result_msg, const size_t resultSize) {
+    if (numRoots == 0) { // 无解
+        snprintf(result_msg, resultSize, "Roots:\tNo roots\n");
+        return;
+    }
+    // 循环输出解，末尾留出"...\n"的位置
+    int result_len = snprintf(result_msg, resultSize, "Roots:\t");
+    char result_tmp[32];
+    for (int i = 0; i < numRoots; i++) {
+        int length = snprintf(result_tmp, sizeof(result_tmp), "%Lf ", roots[i]);
+        if (length >= (int) sizeof(result_tmp)) {
+            length = snprintf(result_tmp, sizeof(result_tmp), "%Le ", roots[i]);
+        }
+        if (result_len + length + 5 > (int) resultSize) {
+            snprintf(result_msg + result_len, resultSize - result_len, "...\n");
+            return;
+        }
+        memcpy(result_msg + result_len, result_tmp, length);
+        result_len += length;
+    }
+    snprintf(result_msg + result_len, resultSize - result_len, "\n");
+}
+
+// 输出求出的根：设置了结果流时根已在求根过程中交给结果流，不再格式化(result_msg为空字符串)
+void outputRoots(const long double *roots, const int numRoots, char *result_msg, const size_t resultSize) {
+    if (currentResultStream == NULL) {
+        formatRoots(roots, numRoots, result_msg, resultSize);
+    } else if (resultSize > 0) {
+        result_msg[0] = '\0';
+    }
+}
+
+// 精确模式的计算：计算式精确求值；等式精确展开后去掉重因子，再对只有单根的多项式数值求根
+// program为元素列表编译后的程序；成功返回1，出错返回0(结果或错误信息写入result_msg)，无法精确计算时返回-1，此时需改用long double计算
+int calculateExact(const Element *elements, const int numElements, const Program *program, const int isEquation,
+                   CalcError *error, char *result_msg, const size_t resultSize) {
+    // 常数按原文精确转为有理数(与程序的常数表顺序相同)，有无法精确表示的常数时整个表达式改用long double计算
+    Rational *constants = (Rational *) calcMalloc((numElements + 1) * sizeof(Rational));
+    int numConstants = 0;
+    for (int i = 0; i < numElements; i++) {
+        if (elements[i].type == NUMBER &&
+            !rationalFromLiteral(elements[i].text, elements[i].length, &constants[numConstants++])) {
+            calcFree(constants);
+            return -1;
+        }
+    }
+    int ok;
+    if (!isEquation) {
+        Rational value;
+        ok = programRunExact(program, constants, &value, error);
+        calculationStageMark(CALCULATION_STAGE_CALCULATE);
+        if (ok == 1) {
+            char result_tmp[96];
+            rationalFormat(value, result_tmp);
+            snprintf(result_msg, resultSize, "Result:\t%s\n", result_tmp);
+            calculationStageMark(CALCULATION_STAGE_FORMAT);
+        }
+    } else {
+        RationalPolynomial *polynomial;
+        ok = programRunExactPolynomial(program, constants, &polynomial, error);
+        if (ok == 1) {
+            // 常数多项式(无解或恒成立)与long double计算的处理相同
+            if (polynomial->powerCount > 0) {
+                // 求最大公因式时溢出则直接对精确展开的多项式求根
+                RationalPolynomial *squareFree = rationalPolynomialSquareFree(polynomial);
+                Expression *expression = rationalPolynomialToExpression(squareFree != NULL ? squareFree : polynomial);
+                calculationStatsSetPowerCount(polynomial->powerCount);
+                calculationStageMark(CALCULATION_STAGE_CALCULATE);
+                int numRoots;
+                long double *roots = expressionFindRoot(expression, &numRoots);
+                calculationStageMark(CALCULATION_STAGE_FIND_ROOT);
+                if (calcDeadlineExceeded()) {
+                    calcErrorSet(error, MSG_ERROR_TIMEOUT, NULL);
+                    ok = 0;
+                } else {
+                    outputRoots(roots, numRoots, result_msg, resultSize);
+                    calculationStageMark(CALCULATION_STAGE_FORMAT);
+                }
+                calcFree(roots);
+                freeExpression(expression);
+                freeRationalPolynomial(squareFree);
+            } else {
+                ok = -1;
+            }
+            freeRationalPolynomial(polynomial);
+        }
+    }
+    if (ok == 0) {
+        formatError("Error: \t%s\n", error, result_msg, resultSize);
+    }
+    calcFree(constants);
+    return ok;
+}
+
+// 双精度模式的计算：执行程序展开为double系数的多项式，计算式直接输出常数项，等式用双精度求根
+// 成功返回1，出错返回0(结果或错误信息写入result_msg)，无法用double计算时返回-1，此时需改用long double计算
+int calculateDouble(const Program *program, const int isEquation, CalcError *error, char *result_msg,
+                    const size_t resultSize) {
+    DoublePolynomial *polynomial;
+    int ok = programRunDoublePolynomial(program, &polynomial, error);
+    calculationStageMark(CALCULATION_STAGE_CALCULATE);
+    if (ok == 0) {
+        formatError("Error: \t%s\n", error, result_msg, resultSize);
+    }
+    if (ok != 1) {
+        return ok;
+    }
+    calculationStatsSetPowerCount(polynomial->powerCount);
+    if (!isEquation) {
+        outputResult(polynomial->factorValue[0], result_msg, resultSize);
+    } else {
+        int numRoots;
+        long double *roots = doublePolynomialFindRoot(polynomial, &numRoots);
+        calculationStageMark(CALCULATION_STAGE_FIND_ROOT);
+        if (calcDeadlineExceeded()) {
+            calcErrorSet(error, MSG_ERROR_TIMEOUT, NULL);
+            formatError("Error: \t%s\n", error, result_msg, resultSize);
+            ok = 0;
+        } else {
+            outputRoots(roots, numRoots, result_msg, resultSize);
+        }
+        calcFree(roots);
+    }
+    calculationStageMark(CALCULATION_STAGE_FORMAT);
+    freeDoublePolynomial(polynomial);
+    return ok;
+}
+
+// 预先解析、编译的请求：准入控制时calculate_estimate_r已经解析、编译并估计过表达式，结果留在上下文中，
+// 接着用同一个上下文计算同一个表达式时直接复制使用，一个请求只解析、编译一次
+// 与上下文的内存池无关，结构体、表达式原文、元素数组和程序放在同一块malloc的内存中
+struct CalcPrepared {
+    int numElements;
+    int isEquation;
+    CalcEstimate estimate; // 静态估计的结果
+    Element *elements; // 数字的原文指向expression
+    Program *program;
+    char *expression; // 表达式原文的副本
+};
+
+// 按long double对齐
+size_t calcPreparedAlign(size_t offset) {
+    return (offset + _Alignof(long double) - 1) / _Alignof(long double) * _Alignof(long double);
+}
+
+// 把解析、编译和估计的结果留在上下文中(替换之前留下的)
+void calcPreparedStore(CalcContext *context, const char *expression, const Element *elements, const int numElements,
+                       const int isEquation, const Program *program, const CalcEstimate *estimate) {
+    size_t elementsOffset = calcPreparedAlign(sizeof(struct CalcPrepared));
+    size_t programOffset = calcPreparedAlign(elementsOffset + numElements * sizeof(Element));
+    size_t expressionOffset = programOffset + program->size;
+    size_t expressionLength = strlen(expression);
+    free(context->prepared);
+    struct CalcPrepared *prepared = (struct CalcPrepared *) malloc(expressionOffset + expressionLength + 1);
+    prepared->numElements = numElements;
+    prepared->isEquation = isEquation;
+    prepared->estimate = *estimate;
+    prepared->elements = (Element *) ((char *) prepared + elementsOffset);
+    prepared->program = (Program *) ((char *) prepared + programOffset);
+    prepared->expression = (char *) prepared + expressionOffset;
+    memcpy(prepared->expression, expression, expressionLength + 1);
+    memcpy(prepared->program, program, program->size);
+    for (int i = 0; i < numElements; i++) {
+        prepared->elements[i] = elements[i];
+        if (elements[i].type == NUMBER) {
+            prepared->elements[i].text = prepared->expression + (elements[i].text - expression);
+        }
+    }
+    context->prepared = prepared;
+}
+
+// 取出上下文中留下的请求：是同一个表达式时把元素数组和程序复制到当前的内存池(数字的原文指向expression)并返回1，
+// 否则返回0；无论是否使用，留下的请求都被丢弃
+int calcPreparedTake(CalcContext *context, const char *expression, Element **elements, int *numElements,
+                     int *isEquation, Program **program, CalcEstimate *estimate) {
+    struct CalcPrepared *prepared = context->prepared;
+    if (prepared == NULL) {
+        return 0;
+    }
+    context->prepared = NULL;
+    if (strcmp(prepared->expression, expression) != 0) {
+        free(prepared);
+        return 0;
+    }
+    *numElements = prepared->numElements;
+    *isEquation = prepared->isEquation;
+    *estimate = prepared->estimate;
+    *elements = (Element *) calcMalloc(prepared->numElements * sizeof(Element));
+    for (int i = 0; i < prepared->numElements; i++) {
+        (*elements)[i] = prepared->elements[i];
+        if (prepared->elements[i].type == NUMBER) {
+            (*elements)[i].text = expression + (prepared->elements[i].text - prepared->expression);
+        }
+    }
+    *program = (Program *) calcMalloc(prepared->program->size);
+    memcpy(*program, prepared->program, prepared->program->size);
+    free(prepared);
+    return 1;
+}
+
+// 计算表达式的主体(字符串->元素列表->最终表达式->求根/求值)，内存通过calcMalloc/calcFree分配释放
+// 配置和错误码的暂存区都来自上下文，不使用任何可变的全局状态
+int calculateExpressionBody(CalcContext *context, const char *expression, char *result_msg,
+                            const size_t resultSize) {
+    const Precision precision = context->config.precision;
+    // 解析字符串->元素(符号/字母/数字)，错误信息中出错的符号过长时截断
+    CalcError *error = &context->error;
+    int numElements;
+    int isEquation;
+    Element *elements;
+    // 编译后的程序：静态估计、精确计算和展开多项式共用，需要时才编译，一个请求只编译一次
+    Program *program = NULL;
+    CalcEstimate estimate;
+    int hasEstimate = calcPreparedTake(context, expression, &elements, &numElements, &isEquation, &program,
+                                       &estimate);
+    if (!hasEstimate) {
+        ParseStatus status;
+        elements = parseExpression(expression, &numElements, &isEquation, &status, error);
+        // 判断元素数组的正确性
+        if (status != PARSE_OK) {
+            calculationStageMark(CALCULATION_STAGE_PARSE);
+            parseStatusMessage(status, error, result_msg, resultSize);
+            freeElements(elements);
+            return 0;
+        }
+    }
+    calculationStageMark(CALCULATION_STAGE_PARSE);
+    if (debugTrace()) {
+        // 输出看看结果
+        printf("Parsed Elements:\t");
+        for (int i = 0; i < numElements; i++) {
+            elementPrint(&elements[i]);
+        }
+        printf("\n");
+    }
+
+    // 方程先静态估计，能确定展开时一定因次幂数过大而报错的直接报错(报错信息与展开后相同)，不必先付出展开的代价
+    if (isEquation && !debugTrace()) {
+        if (!hasEstimate) {
+            program = programCompile(elements, numElements);
+            programEstimate(program, &estimate);
+        }
+        int inExpansion;
+        int powerLimit = estimatePowerLimit(&estimate, &context->config, &inExpansion);
+        if (powerLimit > 0) {
+            calculationStageMark(CALCULATION_STAGE_CALCULATE);
+            calcErrorSetNumber(error, MSG_ERROR_POWER_TOO_LARGE, powerLimit);
+            formatError(inExpansion ? "Error: \t%s\n" : "Error:\t%s\n", error, result_msg, resultSize);
+            calcFree(program);
+            freeElements(elements);
+            return 0;
+        }
+    }
+
+    // 精确模式先尝试精确计算，溢出等无法精确计算的情况退回long double计算
+    if (precision == PRECISION_EXACT && !debugTrace()) {
+        if (program == NULL) {
+            program = programCompile(elements, numElements);
+        }
+        int ok = calculateExact(elements, numElements, program, isEquation, error, result_msg, resultSize);
+        if (ok >= 0) {
+            calcFree(program);
+            freeElements(elements);
+            return ok;
+        }
+    }
+
+    // 计算式直接在数值上计算，不需要展开多项式(调试时仍走多项式计算以输出计算过程)
+    if (!isEquation && !debugTrace()) {
+        long double value;
+        int ok = scalarCalculate(elements, numElements, precision, &value, error);
+        calculationStageMark(CALCULATION_STAGE_CALCULATE);
+        if (ok == 1) {
+            outputResult(value, result_msg, resultSize);
+            calculationStageMark(CALCULATION_STAGE_FORMAT);
+            calcFree(program);
+            freeElements(elements);
+            return 1;
+        }
+        if (ok == 0) {
+            formatError("Error: \t%s\n", error, result_msg, resultSize);
+            calcFree(program);
+            freeElements(elements);
+            return 0;
+        }
+    }
+
+    if (program == NULL) {
+        program = programCompile(elements, numElements);
+    }
+    // 双精度模式展开和求根都使用double，次幂数超过稠密表示的上限或系数溢出时退回下面的long double计算
+    if (precision == PRECISION_DOUBLE && !debugTrace()) {
+        int ok = calculateDouble(program, isEquation, error, result_msg, resultSize);
+        if (ok >= 0) {
+            calcFree(program);
+            freeElements(elements);
+            return ok;
+        }
+    }
+
+    // 正式开始计算表达式(执行编译后的程序，将元素列表转为整个多项式)
+    Expression *expressionResult = programRunExpression(program, error);
+    calcFree(program);
+    calculationStageMark(CALCULATION_STAGE_CALCULATE);
+    if (expressionResult == NULL) {
+        formatError("Error: \t%s\n", error, result_msg, resultSize);
+        freeElements(elements);
+        return 0;
+    }
+    calculationStatsSetPowerCount(expressionResult->powerCount);
+    // 双精度模式退回到这里时(稀疏表示或系数超出double的范围)，多项式的系数舍入到double
+    if (precision == PRECISION_DOUBLE) {
+        for (int i = 0; i < expressionNumTerms(expressionResult); i++) {
+            expressionResult->factorValue[i] = precisionRound(expressionResult->factorValue[i], precision);
+        }
+    }
+    if (debugTrace()) {
+        // 输出结果
+        printf("Final expression:\t");
+        expressionPrint(expressionResult);
+        printf("\n");
+    }
+    // 特判：如果超过最大次幂数(稠密表示默认255次幂，稀疏表示默认4096次幂)，报错
+    int powerLimit = expressionIsSparse(expressionResult) ? context->config.maxSparsePowerCount
+                                                          : context->config.maxPowerCount;
+    if (expressionResult->powerCount >= powerLimit) {
+        calcErrorSetNumber(error, MSG_ERROR_POWER_TOO_LARGE, powerLimit);
+        formatError("Error:\t%s\n", error, result_msg, resultSize);
+        freeExpression(expressionResult);
+        freeElements(elements);
+        return 0;
+    }
+
+    // 求值/求根，然后输出
+    if (!isEquation) {
+        // 求值，已经求完，直接输出结果
+        outputResult(expressionResult->factorValue[0], result_msg, resultSize);
+    } else {
+        // 求根，导数序列隔离根后用安全牛顿法计算
+        int numRoots;
+        long double *roots = expressionFindRoot(expressionResult, &numRoots);
+        calculationStageMark(CALCULATION_STAGE_FIND_ROOT);
+        // 超过期限时求根被中止，报告超时
+        if (calcDeadlineExceeded()) {
+            calcErrorSet(error, MSG_ERROR_TIMEOUT, NULL);
+            formatError("Error: \t%s\n", error, result_msg, resultSize);
+            freeExpression(expressionResult);
+            freeElements(elements);
+            return 0;
+        }
+        // 输出结果
+        outputRoots(roots, numRoots, result_msg, resultSize);
+        calcFree(roots);
+    }
+    calculationStageMark(CALCULATION_STAGE_FORMAT);
+    // 释放内存
+    freeExpression(expressionResult);
+    freeElements(elements);
+
+    return 1;
+}
+
+// 可重入的计算表达式的函数：结果最多写入resultSize-1个字符(过长时截断)
+// 计算过程中的分配都来自上下文的内存池，计算结束后一次性重置；同一个上下文不能同时在多个线程中使用
+// 出错时(返回0)context->error为错误码和参数，与result_msg中的错误信息对应
+int calculate_expression_r(CalcContext *context, const char *expression, char *result_msg, const size_t resultSize) {
+    CalcContextSaved saved;
+    calcContextEnter(context, &saved);
+    int ok = calculateExpressionBody(context, expression, result_msg, resultSize);
+    calcContextLeave(context, &saved);
+    return ok;
+}
+
+// 可重入的流式计算函数：与calculate_expression_r相同，但方程的每个根一经确定就交给stream(不受resultSize的限制)，
+// 计算式的数值结果也放入stream，这两种结果不再格式化(result_msg为空字符串)；错误信息和精确模式的有理数结果仍写入result_msg
+// 计算结束后stream->numRoots为输出的根数，没有求根时为-1；超过期限时已输出的根仍然有效，context->error为超时
+int calculate_expression_stream_r(CalcContext *context, const char *expression, CalcResultStream *stream,
+                                  char *result_msg, const size_t resultSize) {
+    CalcResultStream *savedStream = currentResultStream;
+    stream->numRoots = -1;
+    stream->hasValue = 0;
+    currentResultStream = stream;
+    int ok = calculate_expression_r(context, expression, result_msg, resultSize);
+    currentResultStream = savedStream;
+    return ok;
+}
+
+// 可重入的静态估计函数：解析表达式并估计展开和求根的代价，不做任何计算(计算式的求根代价为0)；解析出错时返回0
+// 解析和编译的结果留在上下文中，接着用该上下文计算同一个表达式时直接使用
+int calculate_estimate_r(CalcContext *context, const char *expression, CalcEstimate *estimate) {
+    CalcContextSaved saved;
+    calcContextEnter(context, &saved);
+    int numElements;
+    int isEquation;
+    ParseStatus status;
+    Element *elements = parseExpression(expression, &numElements, &isEquation, &status, &context->error);
+    int ok = status == PARSE_OK;
+    if (ok) {
+        Program *program = programCompile(elements, numElements);
+        programEstimate(program, estimate);
+        // 留给接下来对同一个表达式的计算，不必再解析和编译
+        calcPreparedStore(context, expression, elements, numElements, isEquation, program, estimate);
+        calcFree(program);
+        if (!isEquation) {
+            estimate->rootCost = 0;
+        }
+    }
+    freeElements(elements);
+    calcContextLeave(context, &saved);
+    return ok;
+}
+
+// 不带上下文的函数使用的上下文：每个线程一个，每次调用时按calcDefaultConfig重新设置配置
+CalcContext *calcThreadContext() {
+    static _Thread_local CalcContext context;
+    Arena arena = context.arena;
+    calcContextInit(&context, NULL);
+    context.arena = arena;
+    return &context;
+}
+
+// 按指定精度计算表达式，result_msg至少要有CALC_RESULT_LENGTH个字符
+int calculate_expression_precision(const char *expression, const Precision precision, char *result_msg) {
+    CalcContext *context = calcThreadContext();
+    context->config.precision = precision;
+    return calculate_expression_r(context, expression, result_msg, CALC_RESULT_LENGTH);
+}
+
+// 最终的计算表达式的函数(使用默认的计算精度)
+int calculate_expression(const char *expression, char *result_msg) {
+    return calculate_expression_precision(expression, calcDefaultConfig.precision, result_msg);
+}
+
+// 求值表中第index个点的x坐标(等距分布，只有一个点时即为from；按双精度取整，与批量求值使用的点完全相同)
+long double calculateTablePoint(const long double from, const long double to, const int numPoints, const int index) {
+    return (double) (numPoints == 1 ? from : from + (to - from) * index / (numPoints - 1));
+}
+
+// 求值表：表达式(可以含未知数x，不能是等式)在[from, to]上等距的numPoints个点处的值，写入values
+// 先展开为多项式，再用双精度的批量求值(AVX-512/AVX2)一次求出所有点，双精度溢出的点改用long double重新求值
+// 成功返回1；出错返回0，错误信息按calculate_expression的格式写入result_msg
+int calculateTableBody(CalcContext *context, const char *expression, const long double from, const long double to,
+                       const int numPoints, long double *values, char *result_msg, const size_t resultSize) {
+    CalcError *error = &context->error;
+    if (numPoints <= 0 || numPoints > MAX_TABLE_POINTS) {
+        calcErrorSetNumber(error, MSG_ERROR_TABLE_POINTS, MAX_TABLE_POINTS);
+        formatError("Error:\t%s\n", error, result_msg, resultSize);
+        return 0;
+    }
+    int numElements;
+    int isEquation;
+    ParseStatus status;
+    Element *elements = parseExpression(expression, &numElements, &isEquation, &status, error);
+    calculationStageMark(CALCULATION_STAGE_PARSE);
+    // 求值表中的表达式允许出现未知数
+    if (status != PARSE_OK && status != PARSE_VARIABLE_IN_CALCULATION) {
+        parseStatusMessage(status, error, result_msg, resultSize);
+        freeElements(elements);
+        return 0;
+    }
+    if (isEquation) {
+        calcErrorSet(error, MSG_ERROR_EQUATION_TABLE, NULL);
+        formatError("Error:\t%s\n", error, result_msg, resultSize);
+        freeElements(elements);
+        return 0;
+    }
+    Expression *expressionResult = expressionCalculate(elements, numElements, error);
+    freeElements(elements);
+    if (expressionResult == NULL) {
+        formatError("Error: \t%s\n", error, result_msg, resultSize);
+        return 0;
+    }
+    int powerLimit = expressionIsSparse(expressionResult) ? context->config.maxSparsePowerCount
+                                                          : context->config.maxPowerCount;
+    if (expressionResult->powerCount >= powerLimit) {
+        calcErrorSetNumber(error, MSG_ERROR_POWER_TOO_LARGE, powerLimit);
+        formatError("Error:\t%s\n", error, result_msg, resultSize);
+        freeExpression(expressionResult);
+        return 0;
+    }
+    double *variableValues = (double *) calcMalloc(numPoints * sizeof(double));
+    double *results = (double *) calcMalloc(numPoints * sizeof(double));
+    for (int i = 0; i < numPoints; i++) {
+        variableValues[i] = (double) calculateTablePoint(from, to, numPoints, i);
+    }
+    expressionEvaluateBatchDouble(expressionResult, variableValues, results, numPoints);
+    for (int i = 0; i < numPoints; i++) {
+        values[i] = results[i];
+        if (!__builtin_isfinite(results[i])) {
+            long double variableValue = variableValues[i];
+            expressionEvaluateBatch(expressionResult, &variableValue, &values[i], 1);
+        }
+    }
+    calculationStatsSetPowerCount(expressionResult->powerCount);
+    calculationStageMark(CALCULATION_STAGE_CALCULATE);
+    calcFree(variableValues);
+    calcFree(results);
+    freeExpression(expressionResult);
+    snprintf(result_msg, resultSize, "Table:\t%d points\n", numPoints);
+    return 1;
+}
+
+// 可重入的求值表函数，上下文的使用同calculate_expression_r，values至少要有numPoints个元素
+int calculate_table_r(CalcContext *context, const char *expression, const long double from, const long double to,
+                      const int numPoints, long double *values, char *result_msg, const size_t resultSize) {
+    CalcContextSaved saved;
+    calcContextEnter(context, &saved);
+    int ok = calculateTableBody(context, expression, from, to, numPoints, values, result_msg, resultSize);
+    calcContextLeave(context, &saved);
+    return ok;
+}
+
+// 求值表的对外函数(使用当前线程的上下文)，result_msg至少要有CALC_RESULT_LENGTH个字符
+int calculate_table(const char *expression, const long double from, const long double to, const int numPoints,
+                    long double *values, char *result_msg) {
+    return calculate_table_r(calcThreadContext(), expression, from, to, numPoints, values, result_msg,
+                             CALC_RESULT_LENGTH);
+}
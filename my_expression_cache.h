@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 表达式结果缓存：以规范化后的表达式字符串为键，缓存calculate_expression的结果
+// 根和计算式的数值结果按二进制缓存(文本模式命中时再格式化，流式请求命中时直接交给结果流)，错误缓存错误码和参数
+// 使用哈希表(拉链法)查找，双向链表维护最近使用顺序，超出内存上限时淘汰最久未使用的条目
+// 缓存不加锁，每个工作者各自持有一个
+
+// 缓存默认的内存上限(字节)
+#define EXPRESSION_CACHE_DEFAULT_BYTES (4 * 1024 * 1024)
+// 哈希表初始桶数(2的幂)，条目数超过桶数时扩容为两倍
+#define EXPRESSION_CACHE_INITIAL_BUCKETS 256
+
+// 缓存条目，键、结果字符串、错误码的参数和根紧跟在结构体后面，与结构体一起分配
+typedef struct CacheEntry {
+    struct CacheEntry *hashNext; // 同一个桶中的下一个条目
+    struct CacheEntry *lruPrev; // 更近使用的条目
+    struct CacheEntry *lruNext; // 更久未使用的条目
+    unsigned int hash;
+    int keyLength;
+    int resultLength; // 结果字符串的长度(根和数值结果不存文本，为0)
+    int argumentLength;
+    int ok; // calculate_expression的返回值
+    MsgErrorCode errorCode; // 出错(ok为0)时的错误码
+    int numRoots; // 根的个数，-1表示结果不是根(计算式、出错或精确模式的有理数结果)
+    int hasValue; // 是否为计算式的数值结果
+    long double value; // 计算式的数值结果
+    _Alignas(long double) char data[]; // key'\0'result'\0'argument'\0'，之后按long double对齐放根
+} CacheEntry;
+
+// 未命中时收集求出的根(同时转交调用者的结果流)，存入缓存的条目
+typedef struct {
+    CalcResultStream *forward; // 调用者的结果流，NULL表示调用者需要文本结果
+    long double *roots;
+    int numRoots;
+    int capacity;
+} CacheCapture;
+
+typedef struct {
+    CacheEntry **buckets;
+    unsigned int numBuckets;
+    int numEntries;
+    size_t usedBytes; // 当前所有条目占用的内存
+    size_t maxBytes; // 内存上限
+    CacheEntry *lruHead; // 最近使用
+    CacheEntry *lruTail; // 最久未使用
+    // 统计
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+} ExpressionCache;
+
+// 新建缓存，maxBytes为0表示不缓存(返回NULL)
+ExpressionCache *expressionCacheNew(size_t maxBytes) {
+    if (maxBytes == 0) {
+        return NULL;
+    }
+    ExpressionCache *cache = (ExpressionCache *) calloc(1, sizeof(ExpressionCache));
+    cache->numBuckets = EXPRESSION_CACHE_INITIAL_BUCKETS;
+    cache->buckets = (CacheEntry **) calloc(cache->numBuckets, sizeof(CacheEntry *));
+    cache->maxBytes = maxBytes;
+    return cache;
+}
+
+// 释放缓存及其全部条目
+void freeExpressionCache(ExpressionCache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    CacheEntry *entry = cache->lruHead;
+    while (entry != NULL) {
+        CacheEntry *next = entry->lruNext;
+        free(entry);
+        entry = next;
+    }
+    free(cache->buckets);
+    free(cache);
+}
+
+// 是否为可能与前后连成一个数字的字符(数字、字母和小数点，如指数符号e/p和十六进制的x)
+int expressionLiteralChar(const char ch) {
+    return isNumeric(ch) || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+// 是否为指数符号(十进制的e和十六进制的p)
+int expressionExponentChar(const char ch) {
+    return ch == 'e' || ch == 'E' || ch == 'p' || ch == 'P';
+}
+
+// 规范化表达式：去掉空格，但去掉后前后可能连成一个数字的空格保留为一个，返回规范化后的长度
+// 保留的空格：两边都是数字、字母或小数点(如"1 2"与"12"，"2 e-1"与"2e-1"，"0 x1p3"与"0x1p3")，
+// 指数符号e/p与其后的正负号之间、指数符号之后的正负号与数字之间(如"1e -3"、"1e- 3"与"1e-3")
+int expressionNormalize(const char *expression, char *normalized) {
+    int length = 0;
+    int pendingSpace = 0;
+    for (const char *p = expression; *p != '\0'; p++) {
+        if (*p == ' ') {
+            pendingSpace = 1;
+            continue;
+        }
+        if (pendingSpace && length > 0) {
+            char previous = normalized[length - 1];
+            int exponentSign = (previous == '+' || previous == '-') && length > 1 &&
+                               expressionExponentChar(normalized[length - 2]);
+            if ((expressionLiteralChar(previous) && expressionLiteralChar(*p)) ||
+                (expressionExponentChar(previous) && (*p == '+' || *p == '-')) ||
+                (exponentSign && *p >= '0' && *p <= '9')) {
+                normalized[length++] = ' ';
+            }
+        }
+        pendingSpace = 0;
+        normalized[length++] = *p;
+    }
+    normalized[length] = '\0';
+    return length;
+}
+
+// FNV-1a哈希
+unsigned int expressionCacheHash(const char *key, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char) key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 从最近使用链表中摘下条目
+void expressionCacheUnlink(ExpressionCache *cache, CacheEntry *entry) {
+    if (entry->lruPrev != NULL) {
+        entry->lruPrev->lruNext = entry->lruNext;
+    } else {
+        cache->lruHead = entry->lruNext;
+    }
+    if (entry->lruNext != NULL) {
+        entry->lruNext->lruPrev = entry->lruPrev;
+    } else {
+        cache->lruTail = entry->lruPrev;
+    }
+}
+
+// 将条目放到最近使用链表的头部
+void expressionCachePushFront(ExpressionCache *cache, CacheEntry *entry) {
+    entry->lruPrev = NULL;
+    entry->lruNext = cache->lruHead;
+    if (cache->lruHead != NULL) {
+        cache->lruHead->lruPrev = entry;
+    }
+    cache->lruHead = entry;
+    if (cache->lruTail == NULL) {
+        cache->lruTail = entry;
+    }
+}
+
+// 条目中根的位置：三个字符串之后按long double对齐
+size_t expressionCacheRootsOffset(int keyLength, int resultLength, int argumentLength) {
+    size_t offset = (size_t) keyLength + resultLength + argumentLength + 3;
+    return (offset + _Alignof(long double) - 1) / _Alignof(long double) * _Alignof(long double);
+}
+
+// 条目中的根
+const long double *expressionCacheRoots(const CacheEntry *entry) {
+    return (const long double *) (entry->data + expressionCacheRootsOffset(entry->keyLength, entry->resultLength,
+                                                                           entry->argumentLength));
+}
+
+// 条目占用的内存
+size_t expressionCacheEntryBytes(const CacheEntry *entry) {
+    size_t rootsOffset = expressionCacheRootsOffset(entry->keyLength, entry->resultLength, entry->argumentLength);
+    return sizeof(CacheEntry) + rootsOffset + (entry->numRoots > 0 ? entry->numRoots * sizeof(long double) : 0);
+}
+
+// 淘汰最久未使用的条目
+void expressionCacheEvict(ExpressionCache *cache) {
+    CacheEntry *entry = cache->lruTail;
+    CacheEntry **link = &cache->buckets[entry->hash & (cache->numBuckets - 1)];
+    while (*link != entry) {
+        link = &(*link)->hashNext;
+    }
+    *link = entry->hashNext;
+    expressionCacheUnlink(cache, entry);
+    cache->usedBytes -= expressionCacheEntryBytes(entry);
+    cache->numEntries--;
+    cache->evictions++;
+    free(entry);
+}
+
+// 哈希表扩容为两倍
+void expressionCacheGrow(ExpressionCache *cache) {
+    unsigned int numBuckets = cache->numBuckets * 2;
+    CacheEntry **buckets = (CacheEntry **) calloc(numBuckets, sizeof(CacheEntry *));
+    for (CacheEntry *entry = cache->lruHead; entry != NULL; entry = entry->lruNext) {
+        CacheEntry **bucket = &buckets[entry->hash & (numBuckets - 1)];
+        entry->hashNext = *bucket;
+        *bucket = entry;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->numBuckets = numBuckets;
+}
+
+// 查找缓存，命中时将条目移到最近使用位置并返回，未命中返回NULL
+CacheEntry *expressionCacheGet(ExpressionCache *cache, const char *key, int keyLength, unsigned int hash) {
+    for (CacheEntry *entry = cache->buckets[hash & (cache->numBuckets - 1)]; entry != NULL; entry = entry->hashNext) {
+        if (entry->hash == hash && entry->keyLength == keyLength && memcmp(entry->data, key, keyLength) == 0) {
+            // 移到最近使用链表头部
+            expressionCacheUnlink(cache, entry);
+            expressionCachePushFront(cache, entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// 表达式的结果是否已在缓存中(只查找，不计入命中统计，也不改变最近使用顺序)，cache为NULL时返回0
+int expressionCacheContains(const ExpressionCache *cache, const char *expression) {
+    if (cache == NULL) {
+        return 0;
+    }
+    // 表达式长度没有上限，键放在堆上
+    char *key = (char *) malloc(strlen(expression) + 1);
+    int keyLength = expressionNormalize(expression, key);
+    unsigned int hash = expressionCacheHash(key, keyLength);
+    int found = 0;
+    for (const CacheEntry *entry = cache->buckets[hash & (cache->numBuckets - 1)]; entry != NULL;
+         entry = entry->hashNext) {
+        if (entry->hash == hash && entry->keyLength == keyLength && memcmp(entry->data, key, keyLength) == 0) {
+            found = 1;
+            break;
+        }
+    }
+    free(key);
+    return found;
+}
+
+// 插入缓存(调用前需确认键不存在)，单个条目超过内存上限时不缓存
+// stream为未命中时求出的二进制结果(numRoots不小于0时根在roots中)，是根或数值结果时不存result
+void expressionCachePut(ExpressionCache *cache, const char *key, int keyLength, unsigned int hash,
+                        const char *result, int ok, const CalcError *error, const CalcResultStream *stream,
+                        const long double *roots) {
+    int binary = ok && (stream->numRoots >= 0 || stream->hasValue);
+    int resultLength = binary ? 0 : (int) strlen(result);
+    int argumentLength = ok ? 0 : (int) strlen(error->argument);
+    size_t rootsOffset = expressionCacheRootsOffset(keyLength, resultLength, argumentLength);
+    size_t rootsBytes = stream->numRoots > 0 ? stream->numRoots * sizeof(long double) : 0;
+    size_t bytes = sizeof(CacheEntry) + rootsOffset + rootsBytes;
+    if (bytes > cache->maxBytes) {
+        return;
+    }
+    while (cache->usedBytes + bytes > cache->maxBytes && cache->lruTail != NULL) {
+        expressionCacheEvict(cache);
+    }
+    CacheEntry *entry = (CacheEntry *) malloc(bytes);
+    entry->hash = hash;
+    entry->keyLength = keyLength;
+    entry->resultLength = resultLength;
+    entry->argumentLength = argumentLength;
+    entry->ok = ok;
+    entry->errorCode = ok ? 0 : error->code;
+    entry->numRoots = stream->numRoots;
+    entry->hasValue = stream->hasValue;
+    entry->value = stream->value;
+    memcpy(entry->data, key, keyLength);
+    entry->data[keyLength] = '\0';
+    memcpy(entry->data + keyLength + 1, binary ? "" : result, resultLength + 1);
+    memcpy(entry->data + keyLength + resultLength + 2, ok ? "" : error->argument, argumentLength + 1);
+    if (rootsBytes > 0) {
+        memcpy(entry->data + rootsOffset, roots, rootsBytes);
+    }
+    CacheEntry **bucket = &cache->buckets[hash & (cache->numBuckets - 1)];
+    entry->hashNext = *bucket;
+    *bucket = entry;
+    expressionCachePushFront(cache, entry);
+    cache->usedBytes += bytes;
+    cache->numEntries++;
+    if ((unsigned int) cache->numEntries > cache->numBuckets) {
+        expressionCacheGrow(cache);
+    }
+}
+
+// 求出一个根时调用：收集起来(供存入缓存)，并转交调用者的结果流
+void cacheCaptureOnRoot(void *arg, long double root) {
+    CacheCapture *capture = (CacheCapture *) arg;
+    if (capture->numRoots == capture->capacity) {
+        capture->capacity = capture->capacity > 0 ? capture->capacity * 2 : 16;
+        capture->roots = (long double *) realloc(capture->roots, capture->capacity * sizeof(long double));
+    }
+    capture->roots[capture->numRoots++] = root;
+    if (capture->forward != NULL) {
+        capture->forward->onRoot(capture->forward->arg, root);
+    }
+}
+
+// 输出缓存中的结果：stream为NULL时按calculate_expression的格式写入result_msg(根和数值结果在这时才格式化)，
+// 否则与calculate_expression_stream_r相同，根一次全部交给stream，数值结果放入stream，其余结果和错误信息写入result_msg
+void expressionCacheOutput(const CacheEntry *entry, CalcResultStream *stream, char *result_msg,
+                           const size_t resultSize) {
+    int binary = entry->ok && (entry->numRoots >= 0 || entry->hasValue);
+    if (stream != NULL) {
+        const long double *roots = expressionCacheRoots(entry);
+        for (int i = 0; i < entry->numRoots; i++) {
+            stream->onRoot(stream->arg, roots[i]);
+        }
+        stream->numRoots = entry->numRoots;
+        stream->hasValue = entry->hasValue;
+        stream->value = entry->value;
+    }
+    if (binary && stream == NULL) {
+        if (entry->numRoots >= 0) {
+            formatRoots(expressionCacheRoots(entry), entry->numRoots, result_msg, resultSize);
+        } else {
+            formatResult(entry->value, result_msg, resultSize);
+        }
+        return;
+    }
+    const char *result = entry->data + entry->keyLength + 1;
+    size_t length = (size_t) entry->resultLength < resultSize ? (size_t) entry->resultLength : resultSize - 1;
+    memcpy(result_msg, result, length);
+    result_msg[length] = '\0';
+}
+
+// 带缓存的计算表达式：命中时直接使用缓存的结果，否则用context计算后存入缓存(cache为NULL时不使用缓存)
+// stream为NULL时结果最多写入resultSize-1个字符；不为NULL时与calculate_expression_stream_r相同，根和数值结果交给stream
+// 出错时context->error为错误码和参数(命中时也一样)
+int calculate_expression_cached(ExpressionCache *cache, CalcContext *context, const char *expression,
+                                CalcResultStream *stream, char *result_msg, const size_t resultSize) {
+    if (cache == NULL) {
+        if (stream != NULL) {
+            return calculate_expression_stream_r(context, expression, stream, result_msg, resultSize);
+        }
+        return calculate_expression_r(context, expression, result_msg, resultSize);
+    }
+    // 表达式长度没有上限，键放在堆上
+    char *key = (char *) malloc(strlen(expression) + 1);
+    int keyLength = expressionNormalize(expression, key);
+    unsigned int hash = expressionCacheHash(key, keyLength);
+    CacheEntry *entry = expressionCacheGet(cache, key, keyLength, hash);
+    if (entry != NULL) {
+        free(key);
+        cache->hits++;
+        if (!entry->ok) {
+            calcErrorSet(&context->error, entry->errorCode, entry->data + entry->keyLength + entry->resultLength + 2);
+        }
+        expressionCacheOutput(entry, stream, result_msg, resultSize);
+        return entry->ok;
+    }
+    cache->misses++;
+    // 总是按流式计算，根和数值结果以二进制形式存入缓存；调用者需要文本时再格式化
+    CacheCapture capture = {stream, NULL, 0, 0};
+    CalcResultStream captured = {cacheCaptureOnRoot, &capture, -1, 0, 0};
+    int ok = calculate_expression_stream_r(context, expression, &captured, result_msg, resultSize);
+    if (stream != NULL) {
+        stream->numRoots = captured.numRoots;
+        stream->hasValue = captured.hasValue;
+        stream->value = captured.value;
+    } else if (ok && captured.numRoots >= 0) {
+        formatRoots(capture.roots, captured.numRoots, result_msg, resultSize);
+    } else if (ok && captured.hasValue) {
+        formatResult(captured.value, result_msg, resultSize);
+    }
+    // 超时的结果与表达式本身无关，不缓存
+    if (!context->timedOut) {
+        expressionCachePut(cache, key, keyLength, hash, result_msg, ok, &context->error, &captured, capture.roots);
+    }
+    free(capture.roots);
+    free(key);
+    return ok;
+}
+
+// 输出缓存的统计信息到buffer(最多size-1个字符)
+void expressionCacheFormatStats(const ExpressionCache *cache, char *buffer, size_t size) {
+    if (cache == NULL) {
+        snprintf(buffer, size, "cache disabled");
+        return;
+    }
+    snprintf(buffer, size, "cache hits=%lu misses=%lu evictions=%lu entries=%d bytes=%zu/%zu",
+             cache->hits, cache->misses, cache->evictions, cache->numEntries, cache->usedBytes, cache->maxBytes);
+}
@@ -0,0 +1,89 @@
+// 延迟直方图：按2的幂分段，每段再等分为若干个桶(与HdrHistogram相同的思路)
+// 服务端统计(my_metrics.h)和客户端的异步模式共用
+
+// 每段等分为2^HISTOGRAM_SUB_BUCKET_BITS个桶，相对误差不超过1/16
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+// 直方图能区分的最大值为2^(HISTOGRAM_MAX_EXPONENT+1)纳秒(约36分钟)，更大的值记入最后一个桶
+#define HISTOGRAM_MAX_EXPONENT 40
+#define HISTOGRAM_NUM_BUCKETS ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 2) * HISTOGRAM_SUB_BUCKETS)
+
+// 延迟直方图(单位为纳秒)
+typedef struct {
+    unsigned long counts[HISTOGRAM_NUM_BUCKETS];
+    unsigned long count;
+    unsigned long long sum;
+    unsigned long long max;
+} LatencyHistogram;
+
+// 值所在的桶
+int histogramBucket(unsigned long long value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int) value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > HISTOGRAM_MAX_EXPONENT) {
+        return HISTOGRAM_NUM_BUCKETS - 1;
+    }
+    int subBucket = (int) (value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS + subBucket;
+}
+
+// 桶的下界
+unsigned long long histogramBucketValue(int bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return (unsigned long long) bucket;
+    }
+    int exponent = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKET_BITS - 1;
+    int subBucket = bucket % HISTOGRAM_SUB_BUCKETS;
+    return (unsigned long long) (HISTOGRAM_SUB_BUCKETS + subBucket) << (exponent - HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+// 记录一个值
+void histogramRecord(LatencyHistogram *histogram, long long value) {
+    if (value < 0) {
+        value = 0; // 不同进程的时钟读数可能有微小的先后误差
+    }
+    histogram->counts[histogramBucket((unsigned long long) value)]++;
+    histogram->count++;
+    histogram->sum += (unsigned long long) value;
+    if ((unsigned long long) value > histogram->max) {
+        histogram->max = (unsigned long long) value;
+    }
+}
+
+// 把histogram加到total中
+void histogramMerge(LatencyHistogram *total, const LatencyHistogram *histogram) {
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        total->counts[i] += histogram->counts[i];
+    }
+    total->count += histogram->count;
+    total->sum += histogram->sum;
+    if (histogram->max > total->max) {
+        total->max = histogram->max;
+    }
+}
+
+// 百分位数(percentile为0~100)，返回所在桶的上界(不超过最大值)
+unsigned long long histogramPercentile(const LatencyHistogram *histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    double rank = percentile / 100 * histogram->count;
+    unsigned long target = (unsigned long) rank;
+    if (target < rank) {
+        target++; // 向上取整
+    }
+    if (target < 1) {
+        target = 1;
+    }
+    unsigned long seen = 0;
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            unsigned long long upper = i + 1 < HISTOGRAM_NUM_BUCKETS ? histogramBucketValue(i + 1) - 1 : histogram->max;
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// 分级日志：写日志时只把格式化好的一行放入内存中的无锁环形队列，由后台线程成批写出，写日志的线程不会因输出而阻塞
+// 队列满时丢弃新的日志并计数，退出时输出丢弃的条数
+// 每个进程各有一个队列和后台线程，fork出的子进程需调用logAfterFork重新开始
+
+// 日志级别
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+// 编译时保留的最低级别，低于该级别的日志调用在编译时去掉(如-DLOG_COMPILE_LEVEL=1去掉全部debug日志)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// 环形队列的条数(2的幂)和每条日志的最大长度(超出截断)
+#define LOG_RING_SIZE 4096
+#define LOG_MESSAGE_LENGTH 240
+// 后台线程每次写出的最大字节数，以及队列为空时的等待时间(微秒)
+#define LOG_FLUSH_BYTES (64 * 1024)
+#define LOG_IDLE_MICROSECONDS 2000
+
+// 一条日志，sequence用于生产者和后台线程之间的同步(有界无锁队列)
+typedef struct {
+    atomic_uint sequence;
+    int level;
+    int length;
+    struct timespec time;
+    char text[LOG_MESSAGE_LENGTH];
+} LogRecord;
+
+const char *logLevelNames[LOG_LEVEL_OFF] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+int logLevel = LOG_LEVEL_INFO; // 运行时的最低级别
+int logSampleRate = 1; // 采样：每logSampleRate个请求只记录1个的日志
+int logFd = STDOUT_FILENO; // 输出的文件描述符
+
+LogRecord logRing[LOG_RING_SIZE];
+atomic_uint logHead; // 下一个写入的位置(生产者)
+unsigned int logTail; // 下一个读出的位置(只有后台线程使用)
+atomic_ulong logDropped; // 因队列满丢弃的条数
+atomic_int logStopping;
+pthread_t logThread;
+int logRunning = 0;
+pthread_mutex_t logDrainLock = PTHREAD_MUTEX_INITIALIZER; // 没有后台线程时，写日志的线程自己写出
+
+// 当前线程的采样计数
+_Thread_local unsigned long logSampleCounter = 0;
+
+// 写出buffer中的全部内容(被信号打断时继续)
+void logWriteAll(const char *buffer, int length) {
+    while (length > 0) {
+        ssize_t written = write(logFd, buffer, length);
+        if (written <= 0) {
+            return;
+        }
+        buffer += written;
+        length -= (int) written;
+    }
+}
+
+// 取出队列中已写好的日志，成批写出，返回取出的条数
+int logDrain() {
+    static char buffer[LOG_FLUSH_BYTES];
+    int used = 0;
+    int count = 0;
+    for (;;) {
+        LogRecord *record = &logRing[logTail & (LOG_RING_SIZE - 1)];
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != logTail + 1) {
+            break; // 队列为空，或生产者还没写完
+        }
+        // 时间和级别的前缀不超过32字节
+        if (used + record->length + 32 > LOG_FLUSH_BYTES) {
+            logWriteAll(buffer, used);
+            used = 0;
+        }
+        // 时间为UTC，直接计算时分秒(localtime_r内部加锁，fork时可能被复制为已加锁的状态)
+        long secondOfDay = (long) (record->time.tv_sec % 86400);
+        used += sprintf(buffer + used, "%02ld:%02ld:%02ld.%06ld %-5s ", secondOfDay / 3600, secondOfDay / 60 % 60,
+                        secondOfDay % 60, record->time.tv_nsec / 1000, logLevelNames[record->level]);
+        memcpy(buffer + used, record->text, record->length);
+        used += record->length;
+        buffer[used++] = '\n';
+        atomic_store_explicit(&record->sequence, logTail + LOG_RING_SIZE, memory_order_release);
+        logTail++;
+        count++;
+    }
+    logWriteAll(buffer, used);
+    return count;
+}
+
+// 后台线程：不断取出日志写出，队列为空时短暂休眠，收到停止通知后写完剩余日志再退出
+void *logFlushLoop(void *arg) {
+    (void) arg;
+    struct timespec idle = {0, LOG_IDLE_MICROSECONDS * 1000L};
+    for (;;) {
+        int stopping = atomic_load_explicit(&logStopping, memory_order_acquire);
+        if (logDrain() == 0) {
+            if (stopping) {
+                break;
+            }
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+// 清空队列
+void logReset() {
+    for (unsigned int i = 0; i < LOG_RING_SIZE; i++) {
+        atomic_store_explicit(&logRing[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store(&logHead, 0);
+    logTail = 0;
+    atomic_store(&logDropped, 0);
+    atomic_store(&logStopping, 0);
+}
+
+// 清空队列并启动后台线程，写日志前必须先调用；失败返回0(此时日志直接同步写出)
+int logStart() {
+    logReset();
+    logRunning = pthread_create(&logThread, NULL, logFlushLoop, NULL) == 0;
+    return logRunning;
+}
+
+// fork出的子进程中调用：丢弃从父进程复制来的日志(由父进程负责写出)，启动自己的后台线程
+int logAfterFork() {
+    return logStart();
+}
+
+// 停止后台线程，写完剩余的日志
+void logStop() {
+    if (logRunning) {
+        atomic_store_explicit(&logStopping, 1, memory_order_release);
+        pthread_join(logThread, NULL);
+        logRunning = 0;
+    }
+    unsigned long dropped = atomic_load(&logDropped);
+    if (dropped > 0) {
+        char line[64];
+        logWriteAll(line, snprintf(line, sizeof(line), "log: %lu message(s) dropped\n", dropped));
+    }
+}
+
+// 写一条日志：在队列中占一个位置并在其中格式化，队列满时丢弃
+void logWrite(const int level, const char *format, ...) {
+    unsigned int position = atomic_load_explicit(&logHead, memory_order_relaxed);
+    LogRecord *record;
+    for (;;) {
+        record = &logRing[position & (LOG_RING_SIZE - 1)];
+        unsigned int sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        int difference = (int) (sequence - position);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logHead, &position, position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            atomic_fetch_add_explicit(&logDropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            position = atomic_load_explicit(&logHead, memory_order_relaxed);
+        }
+    }
+    record->level = level;
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(record->text, LOG_MESSAGE_LENGTH, format, args);
+    va_end(args);
+    if (length < 0) {
+        length = 0;
+    }
+    record->length = length < LOG_MESSAGE_LENGTH ? length : LOG_MESSAGE_LENGTH - 1;
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+    // 没有后台线程时立即写出
+    if (!logRunning) {
+        pthread_mutex_lock(&logDrainLock);
+        logDrain();
+        pthread_mutex_unlock(&logDrainLock);
+    }
+}
+
+// 采样：当前线程的请求是否记录日志，同一个请求的多行日志应共用一次采样结果
+int logSample() {
+    return logSampleRate <= 1 || logSampleCounter++ % logSampleRate == 0;
+}
+
+// 按级别写日志的宏，参数只在级别满足时才求值
+#define LOG_AT(level, ...) \
+    do { \
+        if ((level) >= logLevel) { \
+            logWrite((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void) 0)
+#endif
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void) 0)
+#endif
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// 解析级别名称(debug/info/warn/error/off)，无法识别返回-1
+int logParseLevel(const char *name) {
+    const char *names[] = {"debug", "info", "warn", "error", "off"};
+    for (int i = 0; i <= LOG_LEVEL_OFF; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
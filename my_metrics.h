@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <stdatomic.h>
+#include "my_histogram.h"
+
+// 服务端统计：每个工作者记录请求数、错误数、缓存命中、各阶段耗时的直方图和多项式次幂数的分布
+// 统计数据放在fork前创建的共享内存中，每个工作者只写自己的一份，读取时把所有工作者的数据加起来(不加锁，只用于观察)
+
+// 次幂数分布的桶数：0, 1, 2, 3-4, 5-8, ..., 按2的幂分段
+#define METRICS_DEGREE_BUCKETS 16
+// 统计文本的最大长度
+#define METRICS_TEXT_LENGTH 1024
+
+// 统计的阶段：排队等待、计算的各个阶段(与CalculationStage一一对应)、整个请求
+typedef enum {
+    METRIC_QUEUE,
+    METRIC_PARSE,
+    METRIC_CALCULATE,
+    METRIC_FIND_ROOT,
+    METRIC_FORMAT,
+    METRIC_TOTAL,
+    NUM_METRIC_STAGES
+} MetricStage;
+
+const char *metricStageNames[NUM_METRIC_STAGES] = {"queue", "parse", "calculate", "find_root", "format", "total"};
+
+// 一个工作者的统计
+typedef struct {
+    unsigned long messages; // 收到的请求消息数
+    unsigned long requests; // 计算的表达式数(批量请求中的每个表达式各算一次)
+    unsigned long errors; // 计算出错的表达式数
+    unsigned long timeouts; // 超过期限的表达式数(同时计入errors)
+    unsigned long rejected; // 准入控制拒绝的表达式数(同时计入errors)
+    unsigned long tables; // 求值表请求数
+    unsigned long cacheHits;
+    unsigned long cacheMisses;
+    LatencyHistogram stages[NUM_METRIC_STAGES];
+    unsigned long degrees[METRICS_DEGREE_BUCKETS]; // 展开的多项式的次幂数分布
+} WorkerMetrics;
+
+// 整个服务端的统计，放在共享内存中
+typedef struct {
+    long long startTime; // 服务端启动的时间
+    int numWorkers;
+    atomic_llong admittedCost; // 所有工作者正在计算的方程的估计代价之和(准入控制使用，工作者之间共享)
+    WorkerMetrics workers[];
+} ServerMetrics;
+
+// 次幂数所在的桶：0, 1, 2, 3-4, 5-8, ..., 超出的记入最后一个桶
+int metricsDegreeBucket(int powerCount) {
+    if (powerCount <= 2) {
+        return powerCount;
+    }
+    int bucket = 2 + (63 - __builtin_clzll((unsigned long long) (powerCount - 1)));
+    return bucket < METRICS_DEGREE_BUCKETS ? bucket : METRICS_DEGREE_BUCKETS - 1;
+}
+
+// 新建统计(共享内存，fork出的工作者进程与主进程共用)，失败返回NULL
+ServerMetrics *metricsNew(int numWorkers) {
+    size_t size = sizeof(ServerMetrics) + numWorkers * sizeof(WorkerMetrics);
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    ServerMetrics *metrics = (ServerMetrics *) memory; // mmap得到的内存已清零
+    metrics->startTime = monotonicNanoseconds();
+    metrics->numWorkers = numWorkers;
+    return metrics;
+}
+
+void freeMetrics(ServerMetrics *metrics) {
+    if (metrics != NULL) {
+        munmap(metrics, sizeof(ServerMetrics) + metrics->numWorkers * sizeof(WorkerMetrics));
+    }
+}
+
+// 记录一次计算：各阶段耗时、次幂数、是否出错、是否命中缓存(useCache为0表示没有缓存)
+void metricsRecordCalculation(WorkerMetrics *metrics, const CalculationStats *stats, int ok, int cacheHit,
+                              int useCache, long long totalNanoseconds) {
+    metrics->requests++;
+    if (!ok) {
+        metrics->errors++;
+    }
+    if (useCache) {
+        if (cacheHit) {
+            metrics->cacheHits++;
+        } else {
+            metrics->cacheMisses++;
+        }
+    }
+    // 命中缓存时没有经过计算，只记录整个请求的耗时；没有经过的阶段(如非方程的求根)不记录
+    if (!cacheHit) {
+        for (int stage = 0; stage < NUM_CALCULATION_STAGES; stage++) {
+            if (stats->stageNanoseconds[stage] > 0) {
+                histogramRecord(&metrics->stages[METRIC_PARSE + stage], stats->stageNanoseconds[stage]);
+            }
+        }
+        if (stats->powerCount >= 0) {
+            metrics->degrees[metricsDegreeBucket(stats->powerCount)]++;
+        }
+    }
+    histogramRecord(&metrics->stages[METRIC_TOTAL], totalNanoseconds);
+}
+
+// 把所有工作者的统计加起来
+void metricsMerge(const ServerMetrics *metrics, WorkerMetrics *total) {
+    memset(total, 0, sizeof(WorkerMetrics));
+    for (int i = 0; i < metrics->numWorkers; i++) {
+        const WorkerMetrics *worker = &metrics->workers[i];
+        total->messages += worker->messages;
+        total->requests += worker->requests;
+        total->errors += worker->errors;
+        total->timeouts += worker->timeouts;
+        total->rejected += worker->rejected;
+        total->tables += worker->tables;
+        total->cacheHits += worker->cacheHits;
+        total->cacheMisses += worker->cacheMisses;
+        for (int stage = 0; stage < NUM_METRIC_STAGES; stage++) {
+            histogramMerge(&total->stages[stage], &worker->stages[stage]);
+        }
+        for (int bucket = 0; bucket < METRICS_DEGREE_BUCKETS; bucket++) {
+            total->degrees[bucket] += worker->degrees[bucket];
+        }
+    }
+}
+
+// 输出统计文本(最多size-1个字符)，返回文本长度
+/*
+ 第一行为计数，之后每个阶段一行：次数、平均值和各百分位数(微秒)，最后一行为次幂数分布
+*/
+int metricsFormat(const ServerMetrics *metrics, char *buffer, int size) {
+    static _Thread_local WorkerMetrics total; // 较大，不放在栈上
+    metricsMerge(metrics, &total);
+    int length = snprintf(buffer, size,
+                          "uptime=%llds messages=%lu requests=%lu errors=%lu timeouts=%lu rejected=%lu tables=%lu"
+                          " cache_hits=%lu cache_misses=%lu admitted_cost=%lld\n"
+                          "stage count mean_us p50_us p99_us p999_us max_us\n",
+                          (monotonicNanoseconds() - metrics->startTime) / 1000000000LL, total.messages,
+                          total.requests, total.errors, total.timeouts, total.rejected, total.tables, total.cacheHits,
+                          total.cacheMisses, atomic_load(&metrics->admittedCost));
+    for (int stage = 0; stage < NUM_METRIC_STAGES && length < size; stage++) {
+        const LatencyHistogram *histogram = &total.stages[stage];
+        length += snprintf(buffer + length, size - length, "%s %lu %.1f %.1f %.1f %.1f %.1f\n",
+                           metricStageNames[stage], histogram->count,
+                           histogram->count > 0 ? histogram->sum / 1000.0 / histogram->count : 0.0,
+                           histogramPercentile(histogram, 50) / 1000.0, histogramPercentile(histogram, 99) / 1000.0,
+                           histogramPercentile(histogram, 99.9) / 1000.0, histogram->max / 1000.0);
+    }
+    if (length < size) {
+        length += snprintf(buffer + length, size - length, "degree");
+    }
+    for (int bucket = 0; bucket < METRICS_DEGREE_BUCKETS && length < size; bucket++) {
+        if (total.degrees[bucket] == 0) {
+            continue;
+        }
+        if (bucket <= 2) {
+            length += snprintf(buffer + length, size - length, " %d:%lu", bucket, total.degrees[bucket]);
+        } else {
+            length += snprintf(buffer + length, size - length, " %d-%d:%lu", (1 << (bucket - 2)) + 1,
+                               1 << (bucket - 1), total.degrees[bucket]);
+        }
+    }
+    if (length < size) {
+        length += snprintf(buffer + length, size - length, "\n");
+    }
+    return length < size ? length : size - 1;
+}
+
+// 把统计文本追加到文件中(每次前面加一行时间)，失败返回0
+int metricsDump(const ServerMetrics *metrics, const char *path) {
+    FILE *file = fopen(path, "a");
+    if (file == NULL) {
+        return 0;
+    }
+    char text[METRICS_TEXT_LENGTH];
+    metricsFormat(metrics, text, sizeof(text));
+    fprintf(file, "# time=%ld\n%s", (long) time(NULL), text);
+    fclose(file);
+    return 1;
+}
@@ -3,53 +3,855 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
+#include <sys/wait.h>
 #include <signal.h> // 包含信号处理的头文件
+#include <pthread.h>
 #include <ctype.h>
 
 #include "msg_mycs.h" // 包含消息结构体的头文件
+#include "shm_mycs.h" // 包含共享内存传输的头文件
 #include "my_calculate_expression.h" // 包含计算表达式的头文件
+#include "my_expression_cache.h" // 包含表达式结果缓存的头文件
+#include "my_metrics.h" // 包含服务端统计的头文件
+#include "my_log.h" // 包含日志的头文件
 
-// 信号处理函数，用于清理消息队列
-int cleanup() {
-    msgctl(msgqid, IPC_RMID, 0); // 删除消息队列
-    exit(0); // 退出程序
+// 流式回复中已求出的根最多等待的时间(纳秒)：距上次发送超过该时间时立即发出，不等回复块装满
+#define STREAM_FLUSH_NANOSECONDS 1000000LL
+
+// 普通工作者每隔多少次接收先尝试取一次重量请求(没有重量请求时再按轻量优先取)
+#define HEAVY_TURN_INTERVAL 4
+
+// 工作者模式：多进程(fork)或多线程(pthread)，所有工作者从同一个消息队列(MSGKEY)中取请求
+// 请求按mtype分为轻量(MSG_TYPE_LIGHT)和重量(MSG_TYPE_HEAVY)两类：普通工作者优先取轻量请求，
+// 另有少数工作者只取轻量请求，保证所有普通工作者都在计算高次方程时，计算式仍能及时得到处理；
+// 为了不让持续的轻量请求饿死重量请求，0号工作者(普通工作者多于一个时)每次先取重量请求，
+// 其余普通工作者每HEAVY_TURN_INTERVAL次接收中有一次先取重量请求
+typedef enum {
+    WORKER_FORK,    // N个子进程
+    WORKER_THREAD   // N个线程
+} WorkerMode;
+
+// 传输方式：SysV消息队列或共享内存环形队列
+typedef enum {
+    TRANSPORT_MSG,  // 消息队列(MSGKEY)
+    TRANSPORT_SHM   // 共享内存(SHM_NAME)
+} Transport;
+
+// 工作者的状态
+typedef struct {
+    int id; // 工作者编号
+    int slotIndex; // 共享内存传输时，当前请求所在的客户端槽位
+    ExpressionCache *cache; // 该工作者的结果缓存(NULL表示不缓存)
+    WorkerMetrics *metrics; // 该工作者的统计(位于共享内存中)
+    CalcContext context; // 该工作者的计算上下文(配置、内存池)，线程模式下各工作者互不共享
+    int lightOnly; // 是否只处理轻量请求
+    int heavyFirst; // 是否每次接收都先取重量请求
+    unsigned receives; // 已接收的次数，用于轮到先取重量请求的时机
+    long long queueNanoseconds; // 当前请求的排队时间(客户端没有发送时间时为0)
+} Worker;
+
+Transport transport = TRANSPORT_MSG;
+ShmControl *shmControl = NULL;
+size_t cacheBytes = EXPRESSION_CACHE_DEFAULT_BYTES; // 每个工作者的缓存内存上限
+ServerMetrics *serverMetrics = NULL; // 所有工作者的统计
+const char *metricsFile = NULL; // 定期输出统计的文件(NULL表示不输出)
+int metricsInterval = 10; // 定期输出统计的间隔(秒)
+int maxBudgetMs = 0; // 每个请求的最长时间预算(毫秒)，客户端没有设置预算时也使用该值，0表示不限
+int numLightWorkers = -1; // 只处理轻量请求的工作者数量，-1表示工作者数量的1/4
+int firstLightWorker = 0; // 编号不小于该值的工作者只处理轻量请求，启动工作者前按numLightWorkers设置
+long long admissionLimit = 0; // 所有工作者同时计算的方程的估计代价之和的上限，0表示不做准入控制
+int backlogMs = 10; // 请求排队超过该时间(毫秒)时视为队列积压，此时才按admissionLimit拒绝请求
+
+// 收到退出信号后置1，主进程据此开始优雅退出
+volatile sig_atomic_t stopRequested = 0;
+
+// 定期输出统计的时间到了后置1
+volatile sig_atomic_t dumpRequested = 0;
+
+// 信号处理函数，只记录退出请求，真正的清理在主流程中完成
+void onStopSignal(int signo) {
+    (void) signo;
+    stopRequested = 1;
 }
 
-int main() {
-    struct msgform msg;
-    int i;
+// 定时器信号处理函数，只记录输出统计的请求
+void onAlarmSignal(int signo) {
+    (void) signo;
+    dumpRequested = 1;
+}
+
+// 接收一条请求，返回msg_string的长度；需要退出时返回-1
+int workerReceive(Worker *worker, struct msgform *msg) {
+    if (transport == TRANSPORT_SHM) {
+        return shmWorkerReceive(shmControl, worker->id, msg, &worker->slotIndex);
+    }
+    // 轮到先取重量请求时不阻塞地取一次，队列中没有重量请求时再按下面的优先级等待
+    if (!worker->lightOnly && (worker->heavyFirst || ++worker->receives % HEAVY_TURN_INTERVAL == 0)) {
+        int length = msgTryReceive(msg, MSG_TYPE_HEAVY);
+        if (length >= 0 && msg->source_pid != MSG_STOP_PID) {
+            return length;
+        }
+        if (length >= 0) {
+            // 退出消息排在所有重量请求之后，但队列中可能还有轻量请求：放回队列，
+            // 按轻量优先的顺序取完轻量请求后再次取到它时才退出
+            if (msgSendLength(msg, 0) < 0) {
+                return -1;
+            }
+        } else if (errno != ENOMSG && errno != EINTR) {
+            return -1;
+        }
+    }
+    // 普通工作者按mtype从小到大取(轻量请求优先)，只处理轻量请求的工作者只取MSG_TYPE_LIGHT
+    long type = worker->lightOnly ? MSG_TYPE_LIGHT : -MSG_TYPE_HEAVY;
+    for (;;) {
+        int length = msgReceive(msg, type);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1; // 队列已被删除(EIDRM)或不可用
+        }
+        // 主进程发出的退出消息，排在它之前的请求都已处理完毕
+        if (msg->source_pid == MSG_STOP_PID) {
+            return -1;
+        }
+        return length;
+    }
+}
+
+// 向当前请求的客户端发送回复(只发送消息头和msg_string的前length字节)
+int workerReply(Worker *worker, const struct msgform *msg, int length) {
+    if (transport == TRANSPORT_SHM) {
+        return shmWorkerReply(shmControl, worker->slotIndex, msg, length);
+    }
+    return msgSendLength(msg, length);
+}
+
+// 请求的期限(单调时钟，纳秒)：客户端的预算与服务端的上限取较小者，从客户端发送请求时起算
+// (没有发送时间时从现在起算)，0表示不限
+long long requestDeadline(const struct msgform *msg) {
+    int budget = msg->budget_ms;
+    if (maxBudgetMs > 0 && (budget <= 0 || budget > maxBudgetMs)) {
+        budget = maxBudgetMs;
+    }
+    if (budget <= 0) {
+        return 0;
+    }
+    long long start = msg->send_time > 0 ? msg->send_time : monotonicNanoseconds();
+    return start + budget * 1000000LL;
+}
+
+// 准入控制：方程在计算前先静态估计代价(不展开多项式)，计入所有工作者正在计算的代价之和；
+// 队列积压(请求排队超过backlogMs)且加上它后超过admissionLimit的请求直接拒绝，不做任何计算；
+// 结果已在缓存中的请求先行放过，既不解析估计也不计入代价
+// 接受时返回1，cost为计入的代价，计算结束后由调用者减去
+int workerAdmit(Worker *worker, const char *expression, long long *cost) {
+    CalcEstimate estimate;
+    *cost = 0;
+    if (admissionLimit <= 0 || strchr(expression, '=') == NULL ||
+        expressionCacheContains(worker->cache, expression) ||
+        !calculate_estimate_r(&worker->context, expression, &estimate)) {
+        return 1;
+    }
+    double estimatedCost = estimate.expandCost + estimate.rootCost;
+    // 代价过大(如次幂数很高的稀疏多项式)时按上限计，避免溢出
+    *cost = estimatedCost < (double) admissionLimit ? (long long) estimatedCost : admissionLimit;
+    long long total = atomic_fetch_add(&serverMetrics->admittedCost, *cost) + *cost;
+    if (total <= admissionLimit || worker->queueNanoseconds < backlogMs * 1000000LL) {
+        return 1;
+    }
+    atomic_fetch_sub(&serverMetrics->admittedCost, *cost);
+    LOG_DEBUG("server(pid=%d, worker=%d) rejected %s: estimated cost %.0f, admitted %lld, queued %lldms", getpid(),
+              worker->id, expression, estimatedCost, total - *cost, worker->queueNanoseconds / 1000000);
+    *cost = 0;
+    return 0;
+}
+
+// 计算一个表达式(带缓存，期限为当前请求的期限)，同时把各阶段耗时、是否出错、是否超时、是否命中缓存记入该工作者的统计
+// stream不为NULL时方程的根边求边交给stream(结果已在缓存中时一次全部交给stream)，出错时worker->context.error为错误码和参数
+int workerCalculate(Worker *worker, const char *expression, char *result_string, CalcResultStream *stream) {
+    CalculationStats stats;
+    unsigned long hits = worker->cache != NULL ? worker->cache->hits : 0;
+    long long start = monotonicNanoseconds();
+    long long cost;
+    int ok;
+    calculationStatsBegin(&stats);
+    worker->context.timedOut = 0;
+    if (worker->context.deadline != 0 && start >= worker->context.deadline) {
+        // 排队时已超过期限，不再计算
+        calcErrorSet(&worker->context.error, MSG_ERROR_TIMEOUT, NULL);
+        formatError("Error: \t%s\n", &worker->context.error, result_string, MAX_MSG_STRING_LENGTH);
+        worker->context.timedOut = 1;
+        ok = 0;
+    } else if (!workerAdmit(worker, expression, &cost)) {
+        calcErrorSet(&worker->context.error, MSG_ERROR_REJECTED, NULL);
+        formatError("Error: \t%s\n", &worker->context.error, result_string, MAX_MSG_STRING_LENGTH);
+        worker->metrics->rejected++;
+        ok = 0;
+    } else {
+        ok = calculate_expression_cached(worker->cache, &worker->context, expression, stream, result_string,
+                                         MAX_MSG_STRING_LENGTH);
+        atomic_fetch_sub(&serverMetrics->admittedCost, cost);
+    }
+    calculationStatsEnd();
+    if (worker->context.timedOut) {
+        worker->metrics->timeouts++;
+    }
+    int cacheHit = worker->cache != NULL && worker->cache->hits != hits;
+    metricsRecordCalculation(worker->metrics, &stats, ok, cacheHit, worker->cache != NULL,
+                             monotonicNanoseconds() - start);
+    return ok;
+}
+
+// 处理统计请求：回复一条单条字符串消息，内容为所有工作者的统计
+void handleStats(Worker *worker, const struct msgform *request) {
+    struct msgform reply;
+
+    reply.mtype = request->source_pid;
+    reply.source_pid = getpid();
+    reply.msg_count = 0;
+    reply.send_time = 0;
+    reply.budget_ms = 0;
+    reply.seq = request->seq; // 回复带回请求的序号
+    int length = metricsFormat(serverMetrics, reply.msg_string, MAX_MSG_STRING_LENGTH);
+    workerReply(worker, &reply, length + 1);
+    LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  stats", getpid(), worker->id, reply.mtype);
+}
+
+// 处理批量请求：逐条计算，结果按顺序打包进回复，一条回复放不下时先发出当前回复再继续打包
+void handleBatch(Worker *worker, const struct msgform *request) {
+    struct msgform reply;
+    int replyUsed;
+    int offset = 0;
+    const char *expressionString;
+    int expressionLength;
+    char expression[MAX_MSG_STRING_LENGTH];
+    char result_string[MAX_MSG_STRING_LENGTH];
+    int logged = logSample();
+
+    if (logged) {
+        LOG_INFO("server(pid=%d, worker=%d) <= client(pid=%d):  batch of %d expressions",
+                 getpid(), worker->id, request->source_pid, request->msg_count);
+    }
+    reply.mtype = request->source_pid;
+    reply.source_pid = getpid();
+    reply.send_time = 0;
+    reply.budget_ms = 0;
+    reply.seq = request->seq;
+    msgBatchInit(&reply, &replyUsed);
+    for (int i = 0; i < request->msg_count; i++) {
+        // 取出一条表达式，记录损坏时按空表达式处理，保证回复条数与请求一致
+        if (msgBatchNext(request, &offset, &expressionString, &expressionLength)) {
+            memcpy(expression, expressionString, expressionLength);
+            expression[expressionLength] = '\0';
+        } else {
+            expression[0] = '\0';
+        }
+        workerCalculate(worker, expression, result_string, NULL);
+        int resultLength = (int) strlen(result_string);
+        if (!msgBatchAppend(&reply, &replyUsed, result_string, resultLength)) {
+            workerReply(worker, &reply, replyUsed);
+            msgBatchInit(&reply, &replyUsed);
+            msgBatchAppend(&reply, &replyUsed, result_string, resultLength);
+        }
+    }
+    workerReply(worker, &reply, replyUsed);
+    if (logged) {
+        LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  batch of %d results",
+                 getpid(), worker->id, reply.mtype, request->msg_count);
+    }
+}
+
+// 流式回复的状态：值先放进当前回复块，块装满时发出
+typedef struct {
+    Worker *worker;
+    struct msgform reply; // 当前回复块
+    MsgStreamKind kind;
+    int numValues; // 已放入的值的个数(包括已发出的)
+    int numPending; // 当前回复块中值的个数
+    long long lastSend; // 上次发送的时间
+} StreamWriter;
+
+void streamWriterInit(StreamWriter *writer, Worker *worker, const struct msgform *request, MsgStreamKind kind) {
+    writer->worker = worker;
+    writer->reply.mtype = request->source_pid;
+    writer->reply.source_pid = getpid();
+    writer->reply.send_time = 0;
+    writer->reply.budget_ms = 0;
+    writer->reply.seq = request->seq; // 每一块都带回请求的序号
+    writer->kind = kind;
+    writer->numValues = 0;
+    writer->numPending = 0;
+    writer->lastSend = monotonicNanoseconds();
+    msgStreamInit(&writer->reply, 0, kind, 0);
+}
+
+// 发出当前回复块，不是最后一块时开始下一块
+void streamWriterSend(StreamWriter *writer, int last) {
+    MsgStreamHeader header;
+    memcpy(&header, writer->reply.msg_string, sizeof(MsgStreamHeader));
+    if (last) {
+        msgStreamSetLast(&writer->reply);
+    }
+    workerReply(writer->worker, &writer->reply, msgStreamLength(&writer->reply));
+    writer->lastSend = monotonicNanoseconds();
+    writer->numPending = 0;
+    if (!last) {
+        msgStreamInit(&writer->reply, header.chunk + 1, writer->kind, writer->numValues);
+    }
+}
+
+// 放入一个值，当前回复块已满时先发出
+void streamWriterAppend(StreamWriter *writer, long double value) {
+    if (!msgStreamAppend(&writer->reply, value)) {
+        streamWriterSend(writer, 0);
+        msgStreamAppend(&writer->reply, value);
+    }
+    writer->numValues++;
+    writer->numPending++;
+}
 
-    extern int cleanup(); // 声明清理函数
-    for (i = 0; i < 20; i++)
-        signal(i, cleanup); // 注册信号处理函数
+// 发出最后一块：error不为NULL时最后一块为错误码和参数，否则text不为NULL时最后一块为text，这两种情况都先发出还没有发出的值
+void streamWriterFinish(StreamWriter *writer, const char *text, const CalcError *error) {
+    if (error != NULL || text != NULL) {
+        if (writer->numPending > 0) {
+            streamWriterSend(writer, 0);
+        }
+        if (error != NULL) {
+            msgStreamSetError(&writer->reply, error->code, error->argument, sizeof(error->argument));
+        } else {
+            msgStreamSetText(&writer->reply, text);
+        }
+    }
+    streamWriterSend(writer, 1);
+}
 
-    msgqid = msgget(MSGKEY, 0777 | IPC_CREAT); // 获取或创建消息队列
+// 求根过程中每确定一个根时调用：放入当前回复块，距上次发送已超过STREAM_FLUSH_NANOSECONDS时立即发出
+void streamOnRoot(void *arg, long double root) {
+    StreamWriter *writer = (StreamWriter *) arg;
+    streamWriterAppend(writer, root);
+    if (writer->numPending > 0 && monotonicNanoseconds() - writer->lastSend >= STREAM_FLUSH_NANOSECONDS) {
+        streamWriterSend(writer, 0);
+    }
+}
+
+// 处理流式请求：方程的根每求出一部分就先回复一部分，最后一块为剩下的根；计算式的结果作为最后一块的值，
+// 错误(包括已回复部分根之后超时)作为最后一块的错误码，都不在服务端格式化为文本
+void handleStream(Worker *worker, struct msgform *request, int length) {
+    StreamWriter writer;
+    CalcResultStream stream = {streamOnRoot, &writer, -1, 0, 0};
+    char result_string[MAX_MSG_STRING_LENGTH];
+    int logged = logSample();
+
+    request->msg_string[length < MAX_MSG_STRING_LENGTH ? length : MAX_MSG_STRING_LENGTH - 1] = '\0';
+    if (logged) {
+        LOG_INFO("server(pid=%d, worker=%d) <= client(pid=%d):  stream %s", getpid(), worker->id,
+                 request->source_pid, request->msg_string);
+    }
+    streamWriterInit(&writer, worker, request, MSG_STREAM_ROOTS);
+    int ok = workerCalculate(worker, request->msg_string, result_string, &stream);
+    if (ok && stream.numRoots >= 0) {
+        streamWriterFinish(&writer, NULL, NULL);
+        if (logged) {
+            LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  stream of %d roots", getpid(), worker->id,
+                     writer.reply.mtype, stream.numRoots);
+        }
+    } else if (ok && stream.hasValue) {
+        msgStreamSetValue(&writer.reply, stream.value);
+        streamWriterSend(&writer, 1);
+        if (logged) {
+            LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  stream result %Lg", getpid(), worker->id,
+                     writer.reply.mtype, stream.value);
+        }
+    } else {
+        streamWriterFinish(&writer, result_string, ok ? NULL : &worker->context.error);
+        if (logged) {
+            LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  %.*s", getpid(), worker->id,
+                     writer.reply.mtype, (int) strcspn(result_string, "\n"), result_string);
+        }
+    }
+}
+
+// 处理求值表请求：求出表达式在各点处的值，每个点的 "x<TAB>f(x)" 作为一条记录打包进回复，一条回复放不下时先发出当前回复再继续打包
+// stream为1时(MSG_TABLE_STREAM_COUNT)改为流式回复，函数值以long double的二进制形式按顺序放入回复块，错误为最后一块的错误码
+void handleTable(Worker *worker, const struct msgform *request, int length, int stream) {
+    struct msgform reply;
+    int replyUsed;
+    MsgTableRange range;
+    const char *expression;
+    char result_string[MAX_MSG_STRING_LENGTH];
+    CalculationStats stats;
+    int logged = logSample();
+
+    reply.mtype = request->source_pid;
+    reply.source_pid = getpid();
+    reply.send_time = 0;
+    reply.budget_ms = 0;
+    reply.seq = request->seq;
+    if (!msgTableParse(request, length, &range, &expression)) {
+        expression = "";
+        memset(&range, 0, sizeof(range));
+    }
+    if (logged) {
+        LOG_INFO("server(pid=%d, worker=%d) <= client(pid=%d):  table of %s on [%g, %g], %d points",
+                 getpid(), worker->id, request->source_pid, expression, range.from, range.to, range.numPoints);
+    }
+    long double *values = NULL;
+    if (range.numPoints > 0 && range.numPoints <= MAX_TABLE_POINTS) {
+        values = (long double *) malloc(range.numPoints * sizeof(long double));
+    }
+    long long start = monotonicNanoseconds();
+    calculationStatsBegin(&stats);
+    int ok = calculate_table_r(&worker->context, expression, range.from, range.to, range.numPoints, values,
+                               result_string, sizeof(result_string));
+    calculationStatsEnd();
+    worker->metrics->tables++;
+    if (worker->context.timedOut) {
+        worker->metrics->timeouts++;
+    }
+    metricsRecordCalculation(worker->metrics, &stats, ok, 0, 0, monotonicNanoseconds() - start);
+    if (stream) {
+        StreamWriter writer;
+        streamWriterInit(&writer, worker, request, MSG_STREAM_TABLE);
+        for (int i = 0; ok && i < range.numPoints; i++) {
+            streamWriterAppend(&writer, values[i]);
+        }
+        streamWriterFinish(&writer, NULL, ok ? NULL : &worker->context.error);
+        if (logged) {
+            LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  table stream of %d points",
+                     getpid(), worker->id, writer.reply.mtype, ok ? range.numPoints : 0);
+        }
+        free(values);
+        return;
+    }
+    // 出错时回复单条的错误信息
+    if (!ok) {
+        reply.msg_count = 0;
+        strcpy(reply.msg_string, result_string);
+        workerReply(worker, &reply, (int) strlen(reply.msg_string) + 1);
+        if (logged) {
+            LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  %.*s", getpid(), worker->id, reply.mtype,
+                     (int) strcspn(reply.msg_string, "\n"), reply.msg_string);
+        }
+        free(values);
+        return;
+    }
+    msgBatchInit(&reply, &replyUsed);
+    for (int i = 0; i < range.numPoints; i++) {
+        // 值很大时%Lf的输出很长，截断到一条记录能放下的长度
+        int resultLength = snprintf(result_string, sizeof(result_string), "%Lf\t%Lf",
+                                    calculateTablePoint(range.from, range.to, range.numPoints, i), values[i]);
+        if (resultLength > MAX_MSG_STRING_LENGTH - MSG_BATCH_HEADER_LENGTH) {
+            resultLength = MAX_MSG_STRING_LENGTH - MSG_BATCH_HEADER_LENGTH;
+        }
+        if (!msgBatchAppend(&reply, &replyUsed, result_string, resultLength)) {
+            workerReply(worker, &reply, replyUsed);
+            msgBatchInit(&reply, &replyUsed);
+            msgBatchAppend(&reply, &replyUsed, result_string, resultLength);
+        }
+    }
+    workerReply(worker, &reply, replyUsed);
+    if (logged) {
+        LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  table of %d points",
+                 getpid(), worker->id, reply.mtype, range.numPoints);
+    }
+    free(values);
+}
+
+// 工作者主循环：接收请求->计算->按source_pid回复，收到退出通知(消息队列的退出消息或共享内存的stopping标记)时返回
+void *workerLoop(void *arg) {
+    Worker worker;
+    memset(&worker, 0, sizeof(worker));
+    worker.id = (int) (long) arg;
+    worker.slotIndex = -1;
+    worker.cache = expressionCacheNew(cacheBytes);
+    worker.metrics = &serverMetrics->workers[(long) arg];
+    int workerId = worker.id;
+    struct msgform msg;
+    calcContextInit(&worker.context, NULL); // 使用命令行设置的默认配置
+    worker.lightOnly = workerId >= firstLightWorker;
+    worker.heavyFirst = workerId == 0 && firstLightWorker > 1;
 
-    // 循环等待客户端的请求
     for (;;) {
-        printf("server(pid=%d) is ready (msgqid=%d)... \n", getpid(), msgqid); // 显示服务器准备就绪
+        LOG_DEBUG("server(pid=%d, worker=%d) is ready (%s)...", getpid(), workerId,
+                  transport == TRANSPORT_SHM ? "shm" : "msg"); // 显示工作者准备就绪
 
-        // 接收客户端发送的消息
-        memset(msg.msg_string, 0, MAX_MSG_STRING_LENGTH);
-        msgrcv(msgqid, &msg, msgsize, 1, 0);
-        // 显示接收到的客户端消息
-        printf("server(pid=%d) <= client(pid=%d):  %s\n", getpid(), msg.source_pid, msg.msg_string);
+        // 接收客户端发送的消息(变长)
+        int length = workerReceive(&worker, &msg);
+        if (length < 0) {
+            break;
+        }
+        // 客户端带有发送时间时统计排队时间(同一台机器上的单调时钟，跨进程可比较)
+        worker.metrics->messages++;
+        worker.queueNanoseconds = msg.send_time > 0 ? monotonicNanoseconds() - msg.send_time : 0;
+        if (msg.send_time > 0) {
+            histogramRecord(&worker.metrics->stages[METRIC_QUEUE], worker.queueNanoseconds);
+        }
+        // 请求的期限，批量请求和求值表请求的所有计算共用一个期限
+        worker.context.deadline = requestDeadline(&msg);
+        // 统计请求单独处理
+        if (msg.msg_count == MSG_STATS_COUNT) {
+            handleStats(&worker, &msg);
+            continue;
+        }
+        // 求值表请求单独处理
+        if (msg.msg_count == MSG_TABLE_COUNT || msg.msg_count == MSG_TABLE_STREAM_COUNT) {
+            handleTable(&worker, &msg, length, msg.msg_count == MSG_TABLE_STREAM_COUNT);
+            continue;
+        }
+        // 流式请求单独处理
+        if (msg.msg_count == MSG_STREAM_COUNT) {
+            handleStream(&worker, &msg, length);
+            continue;
+        }
+        // 批量请求单独处理
+        if (msg.msg_count > 0) {
+            handleBatch(&worker, &msg);
+            continue;
+        }
+        // 显示接收到的客户端消息(按采样率记录)
+        int logged = logSample();
+        if (logged) {
+            LOG_INFO("server(pid=%d, worker=%d) <= client(pid=%d):  %s", getpid(), workerId, msg.source_pid,
+                     msg.msg_string);
+        }
 
         // 计算表达式，并检测错误
         char result_string[MAX_MSG_STRING_LENGTH];
-        calculate_expression(msg.msg_string, result_string);
+        workerCalculate(&worker, msg.msg_string, result_string, NULL);
         // 发送结果给客户端
         msg.mtype = msg.source_pid;
         msg.source_pid = getpid();
-        memset(msg.msg_string, 0, MAX_MSG_STRING_LENGTH);
+        msg.msg_count = 0;
+        msg.send_time = 0;
+        msg.budget_ms = 0;
+        // msg.seq保持不变，回复带回请求的序号
         strcpy(msg.msg_string, result_string);
-        // 显示发送给客户端的结果
-        printf("server(pid=%d) => client(pid=%d):  %s\n", getpid(), msg.source_pid, msg.msg_string);
+        // 显示发送给客户端的结果(去掉末尾的换行符)
+        if (logged) {
+            LOG_INFO("server(pid=%d, worker=%d) => client(pid=%ld):  %.*s", getpid(), workerId, msg.mtype,
+                     (int) strcspn(msg.msg_string, "\n"), msg.msg_string);
+        }
 
-        msgsnd(msgqid, &msg, msgsize, 0);
+        workerReply(&worker, &msg, (int) strlen(msg.msg_string) + 1); // 只发送结果字符串实际使用的部分
+    }
+    char cacheStats[128];
+    expressionCacheFormatStats(worker.cache, cacheStats, sizeof(cacheStats));
+    LOG_INFO("server(pid=%d, worker=%d) exit, %s", getpid(), workerId, cacheStats);
+    freeExpressionCache(worker.cache);
+    calcContextDestroy(&worker.context);
+    return NULL;
+}
 
+// 获取默认的工作者数量(在线CPU核数)
+int defaultWorkerCount() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+
+void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-m fork|thread] [-n workers] [-t msg|shm] [-c cache_bytes] [-p max_power] [-s max_sparse_power]"
+                    " [-P long|double|exact] [-M metrics_file] [-I seconds]"
+                    " [-l debug|info|warn|error|off] [-L sample_rate] [-B budget_ms] [-f light_workers]"
+                    " [-A max_cost] [-W backlog_ms]\n", name);
+    fprintf(stderr, "  -m  worker mode, fork (default) or thread\n");
+    fprintf(stderr, "  -n  worker count, default is the number of online CPUs\n");
+    fprintf(stderr, "  -t  transport, SysV message queue (default) or shared memory rings\n");
+    fprintf(stderr, "  -c  result cache size per worker in bytes, 0 disables (default %d)\n",
+            EXPRESSION_CACHE_DEFAULT_BYTES);
+    fprintf(stderr, "  -p  max power count of dense polynomials (default %d)\n", calcDefaultConfig.maxPowerCount);
+    fprintf(stderr, "  -s  max power count of sparse polynomials such as x^1000-1 (default %d)\n", calcDefaultConfig.maxSparsePowerCount);
+    fprintf(stderr, "  -P  precision, long double (default), double, or exact rational arithmetic\n");
+    fprintf(stderr, "  -M  append server metrics to this file periodically and on exit\n");
+    fprintf(stderr, "  -I  interval between metrics dumps in seconds (default %d)\n", metricsInterval);
+    fprintf(stderr, "  -l  log level (default info)\n");
+    fprintf(stderr, "  -L  log only one of every sample_rate requests (default 1)\n");
+    fprintf(stderr, "  -B  max time budget of each request in milliseconds, also used when the client sets none"
+                    " (default 0, no limit)\n");
+    fprintf(stderr, "  -f  workers serving only arithmetic requests, never equations or tables"
+                    " (default a quarter of the workers, message queue only)\n");
+    fprintf(stderr, "  -A  admission limit: max total estimated cost of equations being solved at once, about one unit"
+                    " per nanosecond (default 0, no limit)\n");
+    fprintf(stderr, "  -W  queue wait in milliseconds above which the admission limit is enforced (default %d)\n",
+            backlogMs);
+}
+
+int main(int argc, char *argv[]) {
+    WorkerMode mode = WORKER_FORK;
+    int numWorkers = defaultWorkerCount();
+    int opt;
+
+    // 解析命令行参数
+    while ((opt = getopt(argc, argv, "m:n:t:c:p:s:P:M:I:l:L:B:f:A:W:h")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "fork") == 0) {
+                    mode = WORKER_FORK;
+                } else if (strcmp(optarg, "thread") == 0) {
+                    mode = WORKER_THREAD;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                numWorkers = atoi(optarg);
+                if (numWorkers <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                cacheBytes = (size_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                calcDefaultConfig.maxPowerCount = atoi(optarg);
+                if (calcDefaultConfig.maxPowerCount <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                calcDefaultConfig.maxSparsePowerCount = atoi(optarg);
+                if (calcDefaultConfig.maxSparsePowerCount <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'P':
+                if (strcmp(optarg, "long") == 0) {
+                    calcDefaultConfig.precision = PRECISION_LONG_DOUBLE;
+                } else if (strcmp(optarg, "double") == 0) {
+                    calcDefaultConfig.precision = PRECISION_DOUBLE;
+                } else if (strcmp(optarg, "exact") == 0) {
+                    calcDefaultConfig.precision = PRECISION_EXACT;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'M':
+                metricsFile = optarg;
+                break;
+            case 'l':
+                logLevel = logParseLevel(optarg);
+                if (logLevel < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'L':
+                logSampleRate = atoi(optarg);
+                if (logSampleRate <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'B':
+                maxBudgetMs = atoi(optarg);
+                if (maxBudgetMs < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'f':
+                numLightWorkers = atoi(optarg);
+                if (numLightWorkers < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'A':
+                admissionLimit = atoll(optarg);
+                if (admissionLimit < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'W':
+                backlogMs = atoi(optarg);
+                if (backlogMs < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'I':
+                metricsInterval = atoi(optarg);
+                if (metricsInterval <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                if (strcmp(optarg, "msg") == 0) {
+                    transport = TRANSPORT_MSG;
+                } else if (strcmp(optarg, "shm") == 0) {
+                    transport = TRANSPORT_SHM;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (transport == TRANSPORT_SHM && numWorkers > SHM_MAX_WORKERS) {
+        numWorkers = SHM_MAX_WORKERS;
+    }
+    // 共享内存传输时每个客户端由固定的工作者负责，不区分轻重；至少保留一个普通工作者处理重量请求
+    if (transport == TRANSPORT_SHM) {
+        numLightWorkers = 0;
+    } else if (numLightWorkers < 0) {
+        numLightWorkers = numWorkers / 4;
+    } else if (numLightWorkers > numWorkers - 1) {
+        numLightWorkers = numWorkers - 1;
+    }
+    firstLightWorker = numWorkers - numLightWorkers;
+    logStart(); // 启动日志的后台线程
+    // 统计放在共享内存中，fork出的工作者写入的数据主进程也能读到
+    serverMetrics = metricsNew(numWorkers);
+    if (serverMetrics == NULL) {
+        perror("mmap");
+        return 1;
+    }
+
+    // 先屏蔽退出信号，工作者(子进程/线程)继承该屏蔽字，只由主进程统一处理
+    sigset_t stopSignals, oldMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigaddset(&stopSignals, SIGHUP);
+    sigaddset(&stopSignals, SIGQUIT);
+    sigaddset(&stopSignals, SIGALRM); // 定期输出统计的定时器也只由主进程处理
+    sigprocmask(SIG_BLOCK, &stopSignals, &oldMask);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStopSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+    sa.sa_handler = onAlarmSignal;
+    sigaction(SIGALRM, &sa, NULL);
+
+    if (transport == TRANSPORT_SHM) {
+        shmControl = shmServerCreate(numWorkers); // 创建共享内存
+        if (shmControl == NULL) {
+            perror("shm");
+            return 1;
+        }
+        LOG_INFO("server(pid=%d) starting %d %s worker(s) (shm=%s)",
+                 getpid(), numWorkers, mode == WORKER_FORK ? "fork" : "thread", SHM_NAME);
+    } else {
+        msgqid = msgget(MSGKEY, 0777 | IPC_CREAT); // 获取或创建消息队列
+        if (msgqid < 0) {
+            perror("msgget");
+            return 1;
+        }
+        LOG_INFO("server(pid=%d) starting %d %s worker(s) (msgqid=%d)",
+                 getpid(), numWorkers, mode == WORKER_FORK ? "fork" : "thread", msgqid);
     }
-}
\ No newline at end of file
+    fflush(stdout);
+
+    // 启动工作者
+    pid_t *childPids = NULL;
+    pthread_t *threads = NULL;
+    int numStarted = 0;
+    if (mode == WORKER_FORK) {
+        childPids = (pid_t *) malloc(numWorkers * sizeof(pid_t));
+        for (int i = 0; i < numWorkers; i++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                // 子进程：保持退出信号屏蔽，只通过退出消息结束；日志的后台线程不会被fork复制，需重新启动
+                logAfterFork();
+                workerLoop((void *) (long) i);
+                logStop();
+                fflush(stdout);
+                _exit(0);
+            }
+            if (pid < 0) {
+                perror("fork");
+                break;
+            }
+            childPids[numStarted++] = pid;
+        }
+    } else {
+        threads = (pthread_t *) malloc(numWorkers * sizeof(pthread_t));
+        for (int i = 0; i < numWorkers; i++) {
+            if (pthread_create(&threads[numStarted], NULL, workerLoop, (void *) (long) i) != 0) {
+                perror("pthread_create");
+                break;
+            }
+            numStarted++;
+        }
+    }
+
+    // 等待退出信号，期间按间隔输出统计
+    if (metricsFile != NULL) {
+        alarm(metricsInterval);
+    }
+    while (!stopRequested && numStarted > 0) {
+        sigsuspend(&oldMask);
+        if (dumpRequested) {
+            dumpRequested = 0;
+            if (!metricsDump(serverMetrics, metricsFile)) {
+                perror(metricsFile);
+            }
+            alarm(metricsInterval);
+        }
+    }
+    alarm(0);
+
+    // 优雅退出：通知每个工作者退出，退出前工作者会处理完已入队的请求
+    LOG_INFO("server(pid=%d) is shutting down...", getpid());
+    if (transport == TRANSPORT_SHM) {
+        shmServerStop(shmControl);
+    }
+    // 消息队列传输时分两批通知：先为每个普通工作者发送一条重量类型的退出消息，它们取完所有轻量请求和
+    // 排在前面的重量请求后才会取到；普通工作者都退出后，再为只处理轻量请求的工作者发送轻量类型的退出消息
+    int numNormalStarted = numStarted < firstLightWorker ? numStarted : firstLightWorker;
+    for (int batch = 0; batch < 2; batch++) {
+        int begin = batch == 0 ? 0 : numNormalStarted;
+        int end = batch == 0 ? numNormalStarted : numStarted;
+        if (transport == TRANSPORT_MSG) {
+            struct msgform stopMsg;
+            memset(&stopMsg, 0, sizeof(stopMsg));
+            stopMsg.mtype = batch == 0 ? MSG_TYPE_HEAVY : MSG_TYPE_LIGHT;
+            stopMsg.source_pid = MSG_STOP_PID;
+            for (int i = begin; i < end; i++) {
+                msgSendLength(&stopMsg, 0);
+            }
+        }
+        for (int i = begin; i < end; i++) {
+            if (mode == WORKER_FORK) {
+                waitpid(childPids[i], NULL, 0);
+            } else {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+    free(childPids);
+    free(threads);
+    // 退出前输出最终的统计
+    if (metricsFile != NULL && !metricsDump(serverMetrics, metricsFile)) {
+        perror(metricsFile);
+    }
+    freeMetrics(serverMetrics);
+    logStop();
+
+    if (transport == TRANSPORT_SHM) {
+        shmServerDestroy(shmControl); // 删除共享内存
+    } else {
+        msgctl(msgqid, IPC_RMID, 0); // 删除消息队列
+    }
+    return 0;
+}
@@ -0,0 +1,338 @@
+// 共享内存传输：每个客户端占用一个槽位，槽位中有请求/回复两个单生产者单消费者(SPSC)无锁环形队列
+// 消息格式与消息队列传输相同(struct msgform，变长，支持批量)，只是不再经过内核拷贝
+// 等待时先自旋，再通过futex休眠，唤醒方只有在确实有等待者时才进行系统调用
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SHM_NAME "/mycs_shm_1183" // 共享内存对象名(与MSGKEY对应)
+#define SHM_MAX_CLIENTS 64 // 最大同时连接的客户端数量
+#define SHM_MAX_WORKERS 64 // 最大工作者数量
+#define SHM_RING_SIZE 16 // 每个环形队列的容量(必须为2的幂)
+#define SHM_SPIN_COUNT 2000 // 休眠前的自旋次数
+#define SHM_WAIT_TIMEOUT_NS 100000000 // 每次futex休眠的最长时间(100ms)，醒来后调用者可检查服务端是否已退出
+#define SHM_REPLY_TIMEOUT_NS 1000000000LL // 回复队列一直满(客户端不取走回复)时工作者最多等待的时间(1s)，超过则丢弃回复
+
+// 事件：seq每次通知加1，等待者在seq上futex休眠，sleepers记录正在休眠的等待者数量
+typedef struct {
+    _Atomic unsigned int seq;
+    _Atomic unsigned int sleepers;
+} ShmEvent;
+
+// 环形队列中的一条消息，只有消息头和msg_string的前length字节有效
+typedef struct {
+    int length;
+    struct msgform msg;
+} ShmRingEntry;
+
+// SPSC环形队列：head只由生产者写，tail只由消费者写
+typedef struct {
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+    ShmRingEntry entries[SHM_RING_SIZE];
+} ShmRing;
+
+// 客户端槽位状态
+typedef enum {
+    SHM_SLOT_FREE = 0,
+    SHM_SLOT_USED = 1
+} ShmSlotState;
+
+// 客户端槽位
+typedef struct {
+    _Atomic int state; // ShmSlotState
+    _Atomic int pid; // 占用该槽位的客户端pid
+    ShmRing requests; // 客户端 -> 服务端
+    ShmRing replies; // 服务端 -> 客户端
+    ShmEvent requestSpace; // 请求队列有空位
+    ShmEvent replyData; // 回复队列有数据
+    ShmEvent replySpace; // 回复队列有空位
+} ShmSlot;
+
+// 共享内存的整体布局
+typedef struct {
+    _Atomic int ready; // 服务端初始化完成
+    _Atomic int stopping; // 服务端正在退出，工作者处理完已有请求后退出
+    _Atomic int stopped; // 所有工作者均已退出
+    int serverPid;
+    int numWorkers; // 槽位i由工作者 i % numWorkers 负责
+    ShmEvent doorbells[SHM_MAX_WORKERS]; // 每个工作者一个门铃，其负责的槽位有新请求时通知
+    ShmSlot slots[SHM_MAX_CLIENTS];
+} ShmControl;
+
+
+// 下面为futex和事件相关的函数
+long shmFutex(_Atomic unsigned int *address, int op, unsigned int value, const struct timespec *timeout) {
+    return syscall(SYS_futex, (unsigned int *) address, op, value, timeout, NULL, 0);
+}
+
+// 通知事件：seq加1，仅当有等待者时才调用futex唤醒
+void shmEventSignal(ShmEvent *event) {
+    atomic_fetch_add(&event->seq, 1);
+    if (atomic_load(&event->sleepers) > 0) {
+        shmFutex(&event->seq, FUTEX_WAKE, INT32_MAX, NULL);
+    }
+}
+
+// 等待事件：seq为等待前读到的值，在其改变前先自旋，再休眠(最长SHM_WAIT_TIMEOUT_NS)
+void shmEventWait(ShmEvent *event, unsigned int seq) {
+    for (int i = 0; i < SHM_SPIN_COUNT; i++) {
+        if (atomic_load_explicit(&event->seq, memory_order_acquire) != seq) {
+            return;
+        }
+    }
+    struct timespec timeout = {0, SHM_WAIT_TIMEOUT_NS};
+    atomic_fetch_add(&event->sleepers, 1);
+    if (atomic_load(&event->seq) == seq) {
+        shmFutex(&event->seq, FUTEX_WAIT, seq, &timeout);
+    }
+    atomic_fetch_sub(&event->sleepers, 1);
+}
+
+
+// 下面为SPSC环形队列的函数
+// 尝试写入一条消息(只拷贝消息头和msg_string的前length字节)，队列已满返回0
+int shmRingTryPush(ShmRing *ring, const struct msgform *msg, int length) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == SHM_RING_SIZE) {
+        return 0;
+    }
+    ShmRingEntry *entry = &ring->entries[head & (SHM_RING_SIZE - 1)];
+    entry->length = length;
+    memcpy(&entry->msg, msg, offsetof(struct msgform, msg_string) + length);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// 尝试读出一条消息，队列为空返回-1，否则返回msg_string的长度(单条消息保证以'\0'结尾)
+int shmRingTryPop(ShmRing *ring, struct msgform *msg) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) {
+        return -1;
+    }
+    ShmRingEntry *entry = &ring->entries[tail & (SHM_RING_SIZE - 1)];
+    int length = entry->length;
+    memcpy(msg, &entry->msg, offsetof(struct msgform, msg_string) + length);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    if (msg->msg_count == 0) {
+        msg->msg_string[length < MAX_MSG_STRING_LENGTH ? length : MAX_MSG_STRING_LENGTH - 1] = '\0';
+    }
+    return length;
+}
+
+
+// 下面为服务端使用的函数
+// 创建并初始化共享内存，失败返回NULL
+ShmControl *shmServerCreate(int numWorkers) {
+    int fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0777);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(ShmControl)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    ShmControl *control = (ShmControl *) mmap(NULL, sizeof(ShmControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (control == MAP_FAILED) {
+        return NULL;
+    }
+    memset(control, 0, sizeof(ShmControl));
+    control->serverPid = getpid();
+    control->numWorkers = numWorkers < SHM_MAX_WORKERS ? numWorkers : SHM_MAX_WORKERS;
+    atomic_store(&control->ready, 1);
+    return control;
+}
+
+// 服务端退出：通知所有工作者退出
+void shmServerStop(ShmControl *control) {
+    atomic_store(&control->stopping, 1);
+    for (int i = 0; i < control->numWorkers; i++) {
+        shmEventSignal(&control->doorbells[i]);
+    }
+}
+
+// 所有工作者退出后，标记服务端已停止(唤醒仍在等待的客户端)并删除共享内存
+void shmServerDestroy(ShmControl *control) {
+    atomic_store(&control->stopped, 1);
+    for (int i = 0; i < SHM_MAX_CLIENTS; i++) {
+        shmEventSignal(&control->slots[i].replyData);
+        shmEventSignal(&control->slots[i].requestSpace);
+    }
+    munmap(control, sizeof(ShmControl));
+    shm_unlink(SHM_NAME);
+}
+
+// 工作者接收一条请求：从上一次请求所在槽位(*slotIndex，-1表示还没有)的下一个开始轮流查找自己负责的槽位，
+// 一个客户端持续发送请求时其他槽位也不会被饿死；没有请求时在门铃上等待
+// 返回msg_string的长度，*slotIndex为请求所在槽位；服务端退出且请求已处理完时返回-1
+int shmWorkerReceive(ShmControl *control, int workerId, struct msgform *msg, int *slotIndex) {
+    ShmEvent *doorbell = &control->doorbells[workerId];
+    int numWorkers = control->numWorkers;
+    int numSlots = (SHM_MAX_CLIENTS - workerId + numWorkers - 1) / numWorkers; // 该工作者负责的槽位数
+    int first = *slotIndex >= workerId ? (*slotIndex - workerId) / numWorkers + 1 : 0;
+    for (;;) {
+        unsigned int seq = atomic_load(&doorbell->seq);
+        for (int k = 0; k < numSlots; k++) {
+            int i = workerId + (first + k) % numSlots * numWorkers;
+            int length = shmRingTryPop(&control->slots[i].requests, msg);
+            if (length >= 0) {
+                shmEventSignal(&control->slots[i].requestSpace);
+                *slotIndex = i;
+                return length;
+            }
+        }
+        if (atomic_load(&control->stopping)) {
+            return -1;
+        }
+        shmEventWait(doorbell, seq);
+    }
+}
+
+// 单调时钟的当前时间(纳秒)
+long long shmNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// 工作者向槽位发送回复，回复队列已满时等待客户端取走
+// 最多等待SHM_REPLY_TIMEOUT_NS，服务端正在退出时不等待，这两种情况都丢弃回复并返回-1(不让一个客户端拖住整个工作者)
+int shmWorkerReply(ShmControl *control, int slotIndex, const struct msgform *msg, int length) {
+    ShmSlot *slot = &control->slots[slotIndex];
+    long long deadline = 0;
+    for (;;) {
+        unsigned int seq = atomic_load(&slot->replySpace.seq);
+        if (shmRingTryPush(&slot->replies, msg, length)) {
+            shmEventSignal(&slot->replyData);
+            return 0;
+        }
+        // 客户端已经断开、已经崩溃(不会再取走回复)或槽位已被其他客户端回收，丢弃回复
+        int owner = atomic_load(&slot->pid);
+        if (atomic_load(&slot->state) == SHM_SLOT_FREE || owner != msg->mtype ||
+            (kill(owner, 0) < 0 && errno == ESRCH)) {
+            return -1;
+        }
+        if (atomic_load(&control->stopping)) {
+            return -1;
+        }
+        if (deadline == 0) {
+            deadline = shmNow() + SHM_REPLY_TIMEOUT_NS;
+        } else if (shmNow() >= deadline) {
+            return -1;
+        }
+        shmEventWait(&slot->replySpace, seq);
+    }
+}
+
+
+// 下面为客户端使用的函数
+// 客户端连接：映射共享内存并占用一个空闲槽位(占用者已退出的槽位也会被回收)，失败返回NULL
+ShmControl *shmClientAttach(int *slotIndex) {
+    int fd = shm_open(SHM_NAME, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    ShmControl *control = (ShmControl *) mmap(NULL, sizeof(ShmControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (control == MAP_FAILED) {
+        return NULL;
+    }
+    if (!atomic_load(&control->ready) || atomic_load(&control->stopping)) {
+        munmap(control, sizeof(ShmControl));
+        errno = ECONNREFUSED;
+        return NULL;
+    }
+    for (int i = 0; i < SHM_MAX_CLIENTS; i++) {
+        ShmSlot *slot = &control->slots[i];
+        int expected = SHM_SLOT_FREE;
+        if (atomic_compare_exchange_strong(&slot->state, &expected, SHM_SLOT_USED)) {
+            atomic_store(&slot->pid, getpid());
+            *slotIndex = i;
+            return control;
+        }
+        // 回收占用者已退出的槽位：在pid上从旧占用者CAS为本进程，多个客户端同时回收时只有一个成功
+        // 上一个占用者遗留的请求仍会被处理，其回复的mtype不是本进程pid，接收时会被丢弃
+        int owner = atomic_load(&slot->pid);
+        if (expected == SHM_SLOT_USED && owner > 0 && kill(owner, 0) < 0 && errno == ESRCH &&
+            atomic_compare_exchange_strong(&slot->pid, &owner, getpid())) {
+            *slotIndex = i;
+            return control;
+        }
+    }
+    munmap(control, sizeof(ShmControl));
+    errno = EBUSY;
+    return NULL;
+}
+
+// 客户端断开：释放槽位
+void shmClientDetach(ShmControl *control, int slotIndex) {
+    atomic_store(&control->slots[slotIndex].pid, 0);
+    atomic_store(&control->slots[slotIndex].state, SHM_SLOT_FREE);
+    shmEventSignal(&control->slots[slotIndex].replySpace);
+    munmap(control, sizeof(ShmControl));
+}
+
+// 客户端发送请求，请求队列已满时等待；服务端已停止返回-1
+int shmClientSend(ShmControl *control, int slotIndex, const struct msgform *msg, int length) {
+    ShmSlot *slot = &control->slots[slotIndex];
+    for (;;) {
+        unsigned int seq = atomic_load(&slot->requestSpace.seq);
+        if (shmRingTryPush(&slot->requests, msg, length)) {
+            shmEventSignal(&control->doorbells[slotIndex % control->numWorkers]);
+            return 0;
+        }
+        if (atomic_load(&control->stopped)) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        shmEventWait(&slot->requestSpace, seq);
+    }
+}
+
+// 客户端不阻塞地发送请求，请求队列已满返回0，发送成功返回1，服务端已停止返回-1
+int shmClientTrySend(ShmControl *control, int slotIndex, const struct msgform *msg, int length) {
+    if (shmRingTryPush(&control->slots[slotIndex].requests, msg, length)) {
+        shmEventSignal(&control->doorbells[slotIndex % control->numWorkers]);
+        return 1;
+    }
+    if (atomic_load(&control->stopped)) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    return 0;
+}
+
+// 客户端接收回复(回复的mtype与消息队列传输一样为客户端pid)，返回msg_string的长度；服务端已停止返回-1
+int shmClientReceive(ShmControl *control, int slotIndex, struct msgform *msg) {
+    ShmSlot *slot = &control->slots[slotIndex];
+    long pid = atomic_load(&slot->pid);
+    for (;;) {
+        unsigned int seq = atomic_load(&slot->replyData.seq);
+        int length = shmRingTryPop(&slot->replies, msg);
+        if (length >= 0) {
+            shmEventSignal(&slot->replySpace);
+            if (msg->mtype != pid) {
+                continue; // 上一个占用者的回复
+            }
+            return length;
+        }
+        if (atomic_load(&control->stopped)) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        shmEventWait(&slot->replyData, seq);
+    }
+}